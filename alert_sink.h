@@ -0,0 +1,96 @@
+#ifndef ALERT_SINK_H
+#define ALERT_SINK_H
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include "common.h"
+#include "clock_timer.h"
+#include "change_detector.h"
+
+using boost::asio::ip::udp;
+using boost::asio::ip::address_v4;
+
+const int ALERT_SINK_INTERVAL_MS = 200;    // co ile ms przekazywać alarmy do ujścia (opcja -E)
+
+/* Ujście alarmów (opcja -E): co ALERT_SINK_INTERVAL_MS przekazuje nowe
+ * alarmy z kolejki jako wiersze LatencyAlert::to_record - dopisuje je do
+ * pliku albo, dla celu "udp:adres:port", wysyła każdy osobnym datagramem
+ * przez nieblokujące gniazdo. Działa w wątku UI, więc wolny dysk ani
+ * odbiorca nie wstrzymują pomiarów; alarmy nadpisane w kolejce, zanim
+ * zdążyły trafić do ujścia, są zliczane. */
+class AlertSink {
+public:
+  AlertSink(boost::asio::io_service& io_service, AlertQueue const& alerts,
+      std::string const& target) :
+          timer(io_service),
+          socket(io_service),
+          alerts(alerts),
+          cursor(alerts.head()),
+          missed(0) {
+    if (target.compare(0, 4, "udp:") == 0) {
+      std::size_t colon = target.rfind(':');
+      boost::system::error_code error;
+      address_v4 address = address_v4::from_string(target.substr(4, colon - 4), error);
+      int port = std::atoi(target.c_str() + colon + 1);
+      if (colon < 4 || error || port <= 0 || port > 65535) {
+        std::cerr << "Invalid alert sink " << target << "\n";
+        return;
+      }
+      endpoint = udp::endpoint(address, port);
+      socket.open(udp::v4());
+      socket.non_blocking(true);
+    } else {
+      file.open(target.c_str(), std::ios::app);
+      if (!file) {
+        std::cerr << "Cannot open alert sink " << target << "\n";
+        return;
+      }
+    }
+    reset_timer();
+  }
+
+private:
+  /* Przekazuje do ujścia alarmy dodane od poprzedniego wywołania. */
+  void deliver() {
+    LatencyAlert alert;
+    uint64_t overwritten = 0;
+    while (alerts.poll(cursor, alert, overwritten)) {
+      std::string record = alert.to_record();
+      if (socket.is_open()) {
+        boost::system::error_code error;    // niewysłany alarm jest pomijany
+        socket.send_to(boost::asio::buffer(record), endpoint, 0, error);
+      } else {
+        file << record;
+      }
+    }
+    if (file.is_open())
+      file.flush();
+    if (overwritten) {
+      missed += overwritten;
+      std::cerr << "Alert sink: " << overwritten << " alerts overwritten before delivery ("
+          << missed << " total)\n";
+    }
+
+    reset_timer();
+  }
+
+  void reset_timer() {
+    timer.expires_from_now(boost::posix_time::milliseconds(ALERT_SINK_INTERVAL_MS));
+    timer.async_wait(boost::bind(&AlertSink::deliver, this));
+  }
+
+
+  clock_timer timer;
+  udp::socket socket;         // otwarte dla celu "udp:..."
+  udp::endpoint endpoint;
+  std::ofstream file;         // otwarty dla ścieżki pliku
+
+  AlertQueue const& alerts;
+  uint64_t cursor;            // ostatni przekazany alarm
+  uint64_t missed;            // alarmy nadpisane przed przekazaniem
+};
+
+#endif  // ALERT_SINK_H
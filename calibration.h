@@ -0,0 +1,124 @@
+#ifndef CALIBRATION_H
+#define CALIBRATION_H
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include "common.h"
+#include "clock_timer.h"
+#include "clock_source.h"
+#include "server.h"
+
+using boost::asio::ip::address;
+using boost::asio::ip::address_v4;
+
+/* Parametry trybu kalibracji (opcje -C, -L, -B). */
+struct CalibrationConfig {
+  int seconds;              // czas kalibracji (0 - kalibracja wyłączona)
+  int load_hosts;           // liczba dodatkowych serwerów obciążających pętlę pomiarów
+  bool subtract_baseline;   // czy po kalibracji działać dalej, odejmując narzut od pomiarów
+};
+
+/* Mierzy narzut samego programu na pomiary opóźnień. Przez zadany czas
+ * mierzy lokalny MeasurementServer (UDP), ICMP na 127.0.0.1 oraz połączenie
+ * TCP z lokalnym serwerem telnetu - opóźnienie sieci jest tu pomijalne, więc
+ * wynik to głównie narzut programu (asio, pomiar czasu, parsowanie).
+ *
+ * Obciążenie syntetyczne to 'load_hosts' serwerów o adresach 127.2.x.y mierzonych
+ * tą samą ścieżką co prawdziwe serwery (UDP przez lokalny MeasurementServer, ICMP
+ * przez jądro). Odpowiedzi UDP od nich wracają z adresu 127.0.0.1 i są odrzucane
+ * przy dopasowaniu identyfikatora, ale przechodzą całą ścieżkę odbioru.
+ *
+ * Po kalibracji wypisuje rozkład narzutu dla każdego protokołu (w ns) oraz
+ * źródło czasu pomiarów, koszt jego odczytu i dryf TSC od startu. Jeśli
+ * 'subtract_baseline', mediany stają się narzutem odejmowanym od wszystkich
+ * pomiarów i program działa dalej; w przeciwnym razie zatrzymuje 'io_service'. */
+class Calibrator {
+public:
+  Calibrator(boost::asio::io_service& io_service, servers_ptr servers,
+      ProbeContext& context, int ui_port, CalibrationConfig const& config) :
+          timer(io_service),
+          io_service(io_service),
+          context(context),
+          servers(servers),
+          config(config) {
+    if (config.seconds <= 0)
+      return;
+
+    /* serwer mierzony (127.0.0.1), TCP łączy się z serwerem telnetu: */
+    add_host(address_v4::loopback(), ui_port, true)
+        .set_sample_listener(boost::bind(&Calibrator::add_sample, this, _1, _2));
+    for (int i = 0; i < config.load_hosts; i++)
+      add_host(address_v4(CALIBRATION_LOAD_BASE_ADDRESS + i), SSH_PORT, false);
+
+    timer.expires_from_now(boost::posix_time::seconds(config.seconds));
+    timer.async_wait(boost::bind(&Calibrator::finish, this));
+  }
+
+private:
+  /* Dodaje do mapy serwer kalibracyjny o adresie 'ip', mierzony przez UDP
+   * i ICMP oraz, jeśli 'measure_tcp', przez TCP na port 'tcp_port'. */
+  Server& add_host(address_v4 const& ip, int tcp_port, bool measure_tcp) {
+    auto iter = servers->emplace(address(ip), Server(ip, context, tcp_port)).first;
+    iter->second.enable_udp(config.seconds);
+    if (measure_tcp)
+      iter->second.enable_tcp(config.seconds);
+    calibration_hosts.push_back(&iter->second);
+    return iter->second;
+  }
+
+  void add_sample(int protocol, time_type delay) {
+    samples[protocol].push_back(delay);
+  }
+
+  /* Kończy kalibrację: wyłącza serwery kalibracyjne i wypisuje raport. */
+  void finish() {
+    for (int i = 0; i < calibration_hosts.size(); i++) {
+      calibration_hosts[i]->set_sample_listener(sample_listener());
+      calibration_hosts[i]->disable_udp();
+      calibration_hosts[i]->disable_tcp();
+    }
+
+    std::cout << "Measurement overhead [ns] with " << config.load_hosts << " load hosts:\n"
+        << "proto  samples      min      p50      p90      p99      max\n";
+    for (int proto = 0; proto < PROTOCOL_COUNT; proto++) {
+      std::vector<time_type>& s = samples[proto];
+      std::sort(s.begin(), s.end());
+      std::cout << std::setw(5) << EnabledProbes::name(proto) << std::setw(9) << s.size();
+      if (!s.empty()) {
+        std::cout << std::setw(9) << s.front() << std::setw(9) << percentile(s, 50)
+            << std::setw(9) << percentile(s, 90) << std::setw(9) << percentile(s, 99)
+            << std::setw(9) << s.back();
+      }
+      std::cout << "\n";
+      if (config.subtract_baseline && !s.empty())
+        Server::set_delay_baseline(proto, percentile(s, 50));
+    }
+    ClockSource::instance().report(std::cout);
+
+    if (!config.subtract_baseline)
+      io_service.stop();      // sam tryb kalibracji - kończymy program
+  }
+
+  /* Percentyl 'p' posortowanego, niepustego wektora 's'. */
+  static time_type percentile(std::vector<time_type> const& s, int p) {
+    return s[std::min(s.size() - 1, s.size() * p / 100)];
+  }
+
+
+  static const uint32_t CALIBRATION_LOAD_BASE_ADDRESS = 0x7F020001;  // 127.2.0.1
+
+  clock_timer timer;
+  boost::asio::io_service& io_service;
+  ProbeContext& context;
+  servers_ptr servers;
+  CalibrationConfig config;
+
+  std::vector<Server*> calibration_hosts;           // serwery dodane na czas kalibracji
+  std::vector<time_type> samples[PROTOCOL_COUNT];   // pomiary serwera 127.0.0.1
+};
+
+#endif  // CALIBRATION_H
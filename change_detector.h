@@ -0,0 +1,267 @@
+#ifndef CHANGE_DETECTOR_H
+#define CHANGE_DETECTOR_H
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+#include <string>
+#include <boost/asio.hpp>
+#include "common.h"
+#include "get_time_usec.h"
+#include "probe_policy.h"
+
+const int CHANGE_WARMUP_SAMPLES = 16;      // pomiary przed wykrywaniem zmian opóźnienia
+const float CHANGE_SLACK = 0.5;            // CUSUM: tolerowana zmiana (w odchyleniach),
+const float CHANGE_THRESHOLD = 8;          //   próg alarmu
+const float CHANGE_CLAMP = 3;              //   i maks. wkład jednego pomiaru
+const float CHANGE_MIN_DEVIATION_USEC = 100;   // min. odchylenie przy wykrywaniu zmian
+const float CHANGE_MIN_DEVIATION_RATIO = 0.1;  //   (także względem opóźnienia)
+const int CHANGE_LOSS_BURST = 5;           // alarm po tylu kolejnych zgubionych pomiarach
+const std::size_t ALERT_QUEUE_SIZE = 256;  // pojemność kolejki alarmów
+
+/* Rodzaj alarmu. */
+enum class AlertKind : uint8_t { SHIFT_UP, SHIFT_DOWN, LOSS_BURST, HOST_GONE };
+
+/* Alarm o zmianie stanu serwera. */
+struct LatencyAlert {
+  uint64_t time_usec;         // czas zgłoszenia (zegar systemowy)
+  uint32_t ip;
+  int8_t protocol;            // typ pomiaru (-1 - cały serwer)
+  AlertKind kind;
+  uint16_t lost;              // LOSS_BURST: kolejne zgubione pomiary
+  float before_usec;          // opóźnienie przed zmianą (-1 - nieznane)
+  float after_usec;           // SHIFT_*: opóźnienie po zmianie
+
+  static char const* kind_name(AlertKind kind) {
+    switch (kind) {
+      case AlertKind::SHIFT_UP: return "shift-up";
+      case AlertKind::SHIFT_DOWN: return "shift-down";
+      case AlertKind::LOSS_BURST: return "loss-burst";
+      default: return "host-gone";
+    }
+  }
+
+  char const* protocol_name() const {
+    return protocol < 0 ? "-" : EnabledProbes::name(protocol);
+  }
+
+  /* Wiersz dla ujścia alarmów: "czas ip typ rodzaj przed_ms po_ms zgubione"
+   * (czas w sekundach od epoki, -1 - brak wartości). */
+  std::string to_record() const {
+    char line[128];
+    std::snprintf(line, sizeof(line), "%llu.%06llu %s %s %s %.3f %.3f %u\n",
+        (unsigned long long) (time_usec / SEC_TO_USEC), (unsigned long long) (time_usec % SEC_TO_USEC),
+        boost::asio::ip::address_v4(ip).to_string().c_str(), protocol_name(), kind_name(kind),
+        before_usec < 0 ? -1 : before_usec / 1000, after_usec < 0 ? -1 : after_usec / 1000,
+        (unsigned) lost);
+    return line;
+  }
+
+  /* Opis dla UI (czas lokalny, opóźnienia w ms). */
+  std::string to_text() const {
+    char clock[16];
+    std::time_t seconds = time_usec / SEC_TO_USEC;
+    std::tm local;
+    std::strftime(clock, sizeof(clock), "%H:%M:%S", localtime_r(&seconds, &local));
+    char line[128];
+    std::string address = boost::asio::ip::address_v4(ip).to_string();
+    if (kind == AlertKind::SHIFT_UP || kind == AlertKind::SHIFT_DOWN) {
+      std::snprintf(line, sizeof(line), "%s %-15s %-4s %-10s %.3f -> %.3f ms", clock, address.c_str(),
+          protocol_name(), kind_name(kind), before_usec / 1000, after_usec / 1000);
+    } else if (kind == AlertKind::LOSS_BURST) {
+      std::snprintf(line, sizeof(line), "%s %-15s %-4s %-10s %u lost", clock, address.c_str(),
+          protocol_name(), kind_name(kind), (unsigned) lost);
+    } else {
+      std::snprintf(line, sizeof(line), "%s %-15s %-4s %s", clock, address.c_str(),
+          protocol_name(), kind_name(kind));
+    }
+    return line;
+  }
+};
+
+/* Ograniczona kolejka alarmów z jednym piszącym (wątek pomiarów) i wieloma
+ * czytelnikami (UI, ujście alarmów), z których każdy ma własny kursor.
+ * Zapis nigdy nie czeka: nowy alarm nadpisuje najstarszy, a czytelnik,
+ * który nie nadążył, pomija nadpisane alarmy i dowiaduje się, ile ich było.
+ * Miejsca są chronione numerem sekwencyjnym (seqlock). */
+class AlertQueue {
+public:
+  AlertQueue() : published(0) {
+    for (std::size_t i = 0; i < ALERT_QUEUE_SIZE; i++)
+      slots[i].sequence.store(0, std::memory_order_relaxed);
+  }
+
+  /* Dodaje alarm (tylko wątek pomiarów). */
+  void push(LatencyAlert const& alert) {
+    uint64_t sequence = published.load(std::memory_order_relaxed) + 1;
+    Slot& slot = slots[sequence % ALERT_QUEUE_SIZE];
+    slot.sequence.store(0, std::memory_order_relaxed);    // zapis w toku
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.alert = alert;
+    slot.sequence.store(sequence, std::memory_order_release);
+    published.store(sequence, std::memory_order_release);
+  }
+
+  /* Numer ostatniego dodanego alarmu (kursor czytelnika, który nie chce
+   * starszych alarmów). */
+  uint64_t head() const { return published.load(std::memory_order_acquire); }
+
+  /* Kopiuje do 'alert' pierwszy alarm po 'cursor' i przesuwa kursor.
+   * Zwraca false, jeśli nowych alarmów nie ma; 'missed' zwiększa o liczbę
+   * alarmów nadpisanych, zanim zdążyliśmy je przeczytać. */
+  bool poll(uint64_t& cursor, LatencyAlert& alert, uint64_t& missed) const {
+    uint64_t last = published.load(std::memory_order_acquire);
+    while (cursor < last) {
+      if (last - cursor > ALERT_QUEUE_SIZE) {
+        missed += last - ALERT_QUEUE_SIZE - cursor;
+        cursor = last - ALERT_QUEUE_SIZE;
+      }
+      uint64_t sequence = ++cursor;
+      Slot const& slot = slots[sequence % ALERT_QUEUE_SIZE];
+      if (slot.sequence.load(std::memory_order_acquire) == sequence) {
+        alert = slot.alert;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.sequence.load(std::memory_order_relaxed) == sequence)
+          return true;
+      }
+      missed++;     // nadpisany w trakcie odczytu
+    }
+    return false;
+  }
+
+private:
+  struct Slot {
+    std::atomic<uint64_t> sequence;   // numer zapisanego alarmu (0 - zapis w toku)
+    LatencyAlert alert;
+  };
+
+  Slot slots[ALERT_QUEUE_SIZE];
+  std::atomic<uint64_t> published;    // numer ostatniego alarmu
+};
+
+/* Stan wykrywania zmian jednego typu pomiaru jednego serwera. */
+struct ChangeState {
+  float mean_delay;           // poziom odniesienia (us)
+  float mean_deviation;       // wygładzone odchylenie od 'mean_delay' (us)
+  float upper, lower;         // sumy CUSUM wzrostu i spadku (w odchyleniach)
+  float upper_sum, lower_sum; // suma opóźnień od chwili, gdy sumy CUSUM były zerem
+  uint16_t upper_count, lower_count;
+  uint8_t samples;            // liczba pomiarów (do CHANGE_WARMUP_SAMPLES)
+  uint8_t losses;             // kolejne zgubione pomiary
+};
+
+/* Strumieniowe wykrywanie zmian opóźnienia (O(1) na pomiar). Poziom
+ * odniesienia i odchylenie liczone są jak SRTT/RTTVAR (średnie wykładnicze),
+ * a od niego mierzone są dwustronne sumy CUSUM: pomiar odległy o z odchyleń
+ * (najwyżej CHANGE_CLAMP, żeby pojedynczy skok nie wywołał alarmu) zwiększa
+ * sumę wzrostu o z - CHANGE_SLACK. Suma powyżej CHANGE_THRESHOLD oznacza
+ * trwałą zmianę: zgłaszany jest alarm ze średnią pomiarów od początku zmiany,
+ * która staje się nowym poziomem odniesienia (z odchyleniem równym jego
+ * połowie, jak po pierwszym pomiarze). Poziom podąża za pomiarami przyciętymi
+ * do CHANGE_CLAMP odchyleń i tylko wtedy, gdy żadna suma nie przekracza
+ * połowy progu.
+ *
+ * Alarmy zgłaszane są też po CHANGE_LOSS_BURST kolejnych zgubionych
+ * pomiarach i po wygaśnięciu wpisów serwera (TTL). Trafiają do ograniczonej
+ * kolejki, skąd czytają je UI i ujście alarmów (AlertSink). */
+class ChangeDetector {
+public:
+  AlertQueue const& get_alerts() const { return alerts; }
+
+  void init(ChangeState& state) const {
+    state.mean_delay = state.mean_deviation = 0;
+    state.upper = state.lower = state.upper_sum = state.lower_sum = 0;
+    state.upper_count = state.lower_count = 0;
+    state.samples = state.losses = 0;
+  }
+
+  /* Uwzględnia ukończony pomiar 'delay_nsec' typu 'protocol' serwera 'ip'. */
+  void add_sample(ChangeState& state, uint32_t ip, int protocol, time_type delay_nsec) {
+    float delay = (float) delay_nsec / USEC_TO_NSEC;
+    float error = delay - state.mean_delay;
+    state.losses = 0;
+    if (state.samples < CHANGE_WARMUP_SAMPLES) {
+      if (state.samples++ == 0) {
+        state.mean_delay = delay;
+        state.mean_deviation = delay / 2;
+      } else {
+        update_baseline(state, error);
+      }
+      return;
+    }
+
+    float deviation = std::max(state.mean_deviation,
+        std::max(CHANGE_MIN_DEVIATION_USEC, CHANGE_MIN_DEVIATION_RATIO * state.mean_delay));
+    float z = std::max(-CHANGE_CLAMP, std::min(CHANGE_CLAMP, error / deviation));
+    accumulate(state.upper, state.upper_sum, state.upper_count, z, delay);
+    accumulate(state.lower, state.lower_sum, state.lower_count, -z, delay);
+
+    if (state.upper > CHANGE_THRESHOLD || state.lower > CHANGE_THRESHOLD) {
+      bool up = state.upper > CHANGE_THRESHOLD;
+      float level = up ? state.upper_sum / state.upper_count : state.lower_sum / state.lower_count;
+      LatencyAlert alert = make_alert(ip, protocol, up ? AlertKind::SHIFT_UP : AlertKind::SHIFT_DOWN);
+      alert.before_usec = state.mean_delay;
+      alert.after_usec = level;
+      alerts.push(alert);
+
+      state.mean_delay = level;     // nowy poziom odniesienia, odchylenie jak po pierwszym pomiarze
+      state.mean_deviation = level / 2;
+      state.upper = state.lower = state.upper_sum = state.lower_sum = 0;
+      state.upper_count = state.lower_count = 0;
+    } else if (state.upper <= CHANGE_THRESHOLD / 2 && state.lower <= CHANGE_THRESHOLD / 2) {
+      update_baseline(state, z * deviation);  // odległe pomiary tylko do CHANGE_CLAMP odchyleń
+    }
+  }
+
+  /* Uwzględnia zgubiony pomiar typu 'protocol' serwera 'ip'. */
+  void add_loss(ChangeState& state, uint32_t ip, int protocol) {
+    if (state.losses < 255 && ++state.losses == CHANGE_LOSS_BURST) {
+      LatencyAlert alert = make_alert(ip, protocol, AlertKind::LOSS_BURST);
+      alert.lost = state.losses;
+      alert.before_usec = state.samples ? state.mean_delay : -1;
+      alerts.push(alert);
+    }
+  }
+
+  /* Zgłasza zniknięcie serwera 'ip' (wygaśnięcie wszystkich jego wpisów). */
+  void host_gone(uint32_t ip) {
+    alerts.push(make_alert(ip, -1, AlertKind::HOST_GONE));
+  }
+
+private:
+  static void update_baseline(ChangeState& state, float error) {
+    state.mean_deviation += (std::abs(error) - state.mean_deviation) / 16;
+    state.mean_delay += error / 16;
+  }
+
+  /* Dodaje do sumy CUSUM odchylenie 'z' pomiaru 'delay' (średnia zmiany
+   * liczona jest od chwili, gdy suma była zerem). */
+  static void accumulate(float& sum, float& delay_sum, uint16_t& count, float z, float delay) {
+    sum = std::max(0.0f, sum + z - CHANGE_SLACK);
+    if (sum == 0) {
+      delay_sum = 0;
+      count = 0;
+    } else if (count < 65535) {
+      delay_sum += delay;
+      count++;
+    }
+  }
+
+  static LatencyAlert make_alert(uint32_t ip, int protocol, AlertKind kind) {
+    LatencyAlert alert;
+    alert.time_usec = get_time_usec();
+    alert.ip = ip;
+    alert.protocol = protocol;
+    alert.kind = kind;
+    alert.lost = 0;
+    alert.before_usec = alert.after_usec = -1;
+    return alert;
+  }
+
+
+  AlertQueue alerts;
+};
+
+#endif  // CHANGE_DETECTOR_H
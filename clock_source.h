@@ -0,0 +1,183 @@
+#ifndef CLOCK_SOURCE_H
+#define CLOCK_SOURCE_H
+
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <sys/time.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+#include "common.h"
+#include "get_time_usec.h"
+
+const long CLOCK_CALIBRATION_USEC = 20000;   // kalibracja TSC przy pierwszym odczycie czasu
+const int CLOCK_PAIR_READS = 5;            // odczyty TSC i CLOCK_MONOTONIC_RAW w parze
+const int CLOCK_READ_COST_SAMPLES = 1000000;  // odczyty przy pomiarze kosztu zegara
+
+/* Zegar pomiarów: monotoniczny czas w ns, na którym liczone są opóźnienia,
+ * TTL serwerów i harmonogram pomiarów. W przeciwieństwie do gettimeofday
+ * nie skacze przy korekcie zegara przez NTP.
+ *
+ * Jeśli procesor ma stały licznik TSC (invariant TSC), czas to odczyt rdtsc
+ * przeliczony przez mnożnik wyznaczony przy starcie względem
+ * CLOCK_MONOTONIC_RAW (kalibracja trwa CLOCK_CALIBRATION_USEC); w przeciwnym
+ * razie (albo z opcją -K) czas to CLOCK_MONOTONIC_RAW. Odliczenia czasu
+ * asio (clock_timer) i znaczniki zapisywane na dysk zostają przy zegarze
+ * systemowym. */
+class ClockSource {
+public:
+  /* Czy używać TSC - ustawiane przed pierwszym odczytem czasu. */
+  static bool& prefer_tsc() {
+    static bool value = CLOCK_USE_TSC_DEFAULT;
+    return value;
+  }
+
+  static ClockSource& instance() {
+    static ClockSource clock(prefer_tsc());
+    return clock;
+  }
+
+  time_type now_nsec() const {
+#if defined(__x86_64__) || defined(__i386__)
+    if (tsc)
+      return tsc_to_nsec(__rdtsc());
+#endif
+    return monotonic_raw_nsec();
+  }
+
+  /* Rozbieżność (ns) czasu z TSC względem CLOCK_MONOTONIC_RAW narosła od
+   * kalibracji; 'elapsed_nsec' to czas, który upłynął od kalibracji. */
+  long drift_nsec(time_type& elapsed_nsec) const {
+    if (!tsc) {
+      elapsed_nsec = 0;
+      return 0;
+    }
+    uint64_t ticks;
+    time_type raw = read_pair(ticks);
+    elapsed_nsec = raw - base_nsec;
+    return static_cast<long>(tsc_to_nsec(ticks) - raw);
+  }
+
+  /* Wypisuje źródło czasu, koszt odczytu (w porównaniu z CLOCK_MONOTONIC_RAW
+   * i gettimeofday) i dryf TSC od kalibracji. */
+  void report(std::ostream& os) const {
+    std::streamsize precision = os.precision();
+    os << "Clock: " << (tsc ? "TSC" : "CLOCK_MONOTONIC_RAW");
+    if (tsc)
+      os << " " << std::setprecision(6) << (double) (1ULL << TSC_SHIFT) / mult << " GHz";
+    os << ", read cost [ns]: clock " << std::setprecision(3) << read_cost([this] { return now_nsec(); })
+        << ", CLOCK_MONOTONIC_RAW " << read_cost(&ClockSource::monotonic_raw_nsec)
+        << ", gettimeofday " << read_cost(&wall_clock_usec) << "\n";
+    if (tsc) {
+      time_type elapsed;
+      long drift = drift_nsec(elapsed);
+      os << "TSC drift: " << drift << " ns over " << (double) elapsed / SEC_TO_NSEC << " s ("
+          << (elapsed ? drift * 1e6 / elapsed : 0) << " ppm)\n";
+    }
+    os << std::setprecision(precision) << std::flush;
+  }
+
+  static time_type monotonic_raw_nsec() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+    return now.tv_sec * (time_type) SEC_TO_NSEC + now.tv_nsec;
+  }
+
+private:
+  ClockSource(bool use_tsc) : tsc(false), mult(0), base_ticks(0), base_nsec(0) {
+    if (use_tsc && has_invariant_tsc())
+      calibrate();
+  }
+
+  static bool has_invariant_tsc() {
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned int eax, ebx, ecx, edx;
+    return __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) && (edx & (1 << 8));
+#else
+    return false;
+#endif
+  }
+
+  /* Wyznacza mnożnik TSC -> ns z odczytów na początku i końcu okresu kalibracji. */
+  void calibrate() {
+    uint64_t start_ticks, end_ticks;
+    time_type start_nsec = read_pair(start_ticks);
+    time_type end_nsec;
+    do {
+      end_nsec = read_pair(end_ticks);
+    } while (end_nsec - start_nsec < CLOCK_CALIBRATION_USEC * USEC_TO_NSEC);
+    if (end_ticks <= start_ticks)
+      return;                 // licznik nie rośnie - zostajemy przy CLOCK_MONOTONIC_RAW
+    mult = ((unsigned __int128) (end_nsec - start_nsec) << TSC_SHIFT) / (end_ticks - start_ticks);
+    base_ticks = end_ticks;
+    base_nsec = end_nsec;
+    tsc = true;
+  }
+
+  /* Odczytuje CLOCK_MONOTONIC_RAW i TSC (środek najkrótszego z kilku odczytów,
+   * żeby przerwanie między nimi nie zaburzyło kalibracji). */
+  static time_type read_pair(uint64_t& ticks) {
+    time_type result = 0;
+    ticks = 0;
+#if defined(__x86_64__) || defined(__i386__)
+    uint64_t best = std::numeric_limits<uint64_t>::max();
+    for (int i = 0; i < CLOCK_PAIR_READS; i++) {
+      uint64_t before = __rdtsc();
+      time_type nsec = monotonic_raw_nsec();
+      uint64_t after = __rdtsc();
+      if (after - before < best) {
+        best = after - before;
+        ticks = before + (after - before) / 2;
+        result = nsec;
+      }
+    }
+#endif
+    return result;
+  }
+
+  time_type tsc_to_nsec(uint64_t ticks) const {
+    int64_t delta = ticks - base_ticks;     // odczyt sprzed kalibracji daje ujemną różnicę
+    if (delta >= 0)
+      return base_nsec + (time_type) (((unsigned __int128) delta * mult) >> TSC_SHIFT);
+    return base_nsec - (time_type) (((unsigned __int128) -delta * mult) >> TSC_SHIFT);
+  }
+
+  static time_type wall_clock_usec() {
+    timeval now;
+    gettimeofday(&now, NULL);
+    return now.tv_sec * (time_type) SEC_TO_USEC + now.tv_usec;
+  }
+
+  /* Średni czas (ns) wywołania 'read'. */
+  template <typename Read>
+  static double read_cost(Read read) {
+    time_type sink = 0;
+    time_type start = monotonic_raw_nsec();
+    for (int i = 0; i < CLOCK_READ_COST_SAMPLES; i++)
+      sink += read();
+    time_type end = monotonic_raw_nsec();
+    volatile time_type keep = sink;     // żeby kompilator nie usunął pętli
+    (void) keep;
+    return (double) (end - start) / CLOCK_READ_COST_SAMPLES;
+  }
+
+
+  static const int TSC_SHIFT = 32;  // mnożnik w formacie stałoprzecinkowym 32.32
+
+  bool tsc;                 // czy czas pochodzi z TSC
+  uint64_t mult;            // ns na takt TSC * 2^TSC_SHIFT
+  uint64_t base_ticks;      // odczyt TSC na końcu kalibracji
+  time_type base_nsec;      // odpowiadający mu CLOCK_MONOTONIC_RAW
+};
+
+/* Czas zegara pomiarów w ns (w czasie wirtualnym - virtual_time_usec). */
+inline time_type get_time_nsec() {
+  if (virtual_time_usec())
+    return virtual_time_usec() * USEC_TO_NSEC;
+  return ClockSource::instance().now_nsec();
+}
+
+#endif  // CLOCK_SOURCE_H
@@ -0,0 +1,27 @@
+#ifndef CLOCK_TIMER_H
+#define CLOCK_TIMER_H
+
+#include <boost/asio.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/date_time/posix_time/conversion.hpp>
+#include "get_time_usec.h"
+
+/* Czas liczników asio brany z tego samego zegara co get_time_usec():
+ * systemowego albo wirtualnego (virtual_time_usec). Program działający na
+ * czasie wirtualnym musi być zbudowany z BOOST_ASIO_DISABLE_EPOLL - reaktor
+ * select() sprawdza liczniki przy każdym poll(), a epoll tylko po sygnale
+ * timerfd, który przychodzi w czasie rzeczywistym. */
+struct ClockTimeTraits : boost::asio::time_traits<boost::posix_time::ptime> {
+  static boost::posix_time::ptime now() {
+    if (virtual_time_usec()) {
+      return boost::posix_time::from_time_t(0)
+          + boost::posix_time::microseconds(static_cast<int64_t>(virtual_time_usec()));
+    }
+    return boost::asio::time_traits<boost::posix_time::ptime>::now();
+  }
+};
+
+/* Licznik czasu używany przez wszystkie klasy programu. */
+typedef boost::asio::basic_deadline_timer<boost::posix_time::ptime, ClockTimeTraits> clock_timer;
+
+#endif  // CLOCK_TIMER_H
@@ -6,11 +6,6 @@
 
 /* ################## typedefs #################### */
 
-const int PROTOCOL_COUNT = 3;
-enum PROTOCOL {
-  UDP, TCP, ICMP
-};
-
 class Server;
 typedef std::map<boost::asio::ip::address, Server> servers_map;   // główna mapa serwerów
 typedef std::shared_ptr<servers_map> servers_ptr;
@@ -21,6 +16,8 @@ typedef uint64_t time_type;
 /* ################## constants #################### */
 
 const long SEC_TO_USEC = 1000000L;    // zamiana sekund na mikrosekundy
+const long SEC_TO_NSEC = 1000000000L; // zamiana sekund na nanosekundy
+const long USEC_TO_NSEC = 1000L;      // zamiana mikrosekund na nanosekundy
 const int BUFFER_SIZE = 512;
 const int UI_SCREEN_WIDTH = 80;
 const int UI_SCREEN_HEIGHT = 24;
@@ -45,11 +42,27 @@ const std::string ICMP_MESSAGE = "34686203";
 
 const int UDP_PORT_DEFAULT = 3382;
 const int UI_PORT_DEFAULT = 3673;
+const int MATRIX_PORT_DEFAULT = 3384;     // port wymiany macierzy opóźnień
+const int VIVALDI_PORT_DEFAULT = 3385;    // port wymiany współrzędnych sieciowych
 
 const int MEASUREMENT_INTERVAL_DEFAULT = 1;
 const int MDNS_INTERVAL_DEFAULT = 10;
 const float UI_REFRESH_INTERVAL_DEFAULT = 1.0;
 const bool BROADCAST_SSH_DEFAULT = false;
+const bool ADAPTIVE_PROBING_DEFAULT = false;
+const float PROBE_BUDGET_DEFAULT = 0;     // pakiety pomiarowe na sekundę (0 - bez limitu)
+const bool MATRIX_EXCHANGE_DEFAULT = false;
+const std::string MATRIX_EXPORT_PATH_DEFAULT = "";  // pusta - bez eksportu macierzy
+const int VIVALDI_NEIGHBORS_DEFAULT = 0;  // 0 - mierzenie wszystkich węzłów, bez współrzędnych
+const std::string SNAPSHOT_PATH_DEFAULT = "";   // pusta - bez zapisywania stanu
+const int CALIBRATION_SECONDS_DEFAULT = 0;      // 0 - bez kalibracji
+const int CALIBRATION_LOAD_HOSTS_DEFAULT = 0;
+const bool SUBTRACT_BASELINE_DEFAULT = false;
+const int RECEIVE_THREAD_CPU_DEFAULT = -1;      // -1 - bez przypinania do procesora
+const int RECEIVE_THREAD_PRIORITY_DEFAULT = 0;  // 0 - bez priorytetu czasu rzeczywistego
+const bool CLOCK_USE_TSC_DEFAULT = true;        // zegar pomiarów z TSC, jeśli jest stabilny
+const std::string ALERT_SINK_DEFAULT = "";      // pusty - alarmy tylko w UI
+const bool LATENCY_HISTORY_DEFAULT = false;     // historia opóźnień serwerów (opcja -H)
 
 
 
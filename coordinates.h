@@ -0,0 +1,380 @@
+#ifndef COORDINATES_H
+#define COORDINATES_H
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <vector>
+#include <boost/array.hpp>
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include "common.h"
+#include "clock_timer.h"
+#include "clock_source.h"
+#include "server.h"
+#include "mdns_message.h"
+
+using boost::asio::ip::udp;
+using boost::asio::ip::address;
+using boost::asio::ip::address_v4;
+
+const int VIVALDI_DIMENSIONS = 2;          // wymiar współrzędnych (poza wysokością)
+const int VIVALDI_ROUND_INTERVAL = 1;      // co ile sekund poprawiać i wysyłać współrzędne
+const int VIVALDI_ROTATE_INTERVAL = 30;    // co ile sekund wymieniać jednego sąsiada
+const int VIVALDI_REPORT_INTERVAL = 60;    // co ile sekund wypisywać błąd współrzędnych
+const int VIVALDI_COORDINATE_TTL = 300;    // po ilu sekundach bez nowej wersji zapominać węzeł
+const std::size_t VIVALDI_GOSSIP_ENTRIES = 32; // cudze współrzędne w jednym pakiecie
+const float VIVALDI_CC = 0.25;             // stałe kroku pozycji i błędu
+const float VIVALDI_CE = 0.25;             //   algorytmu Vivaldi
+const float VIVALDI_INITIAL_ERROR = 1.0;
+const float VIVALDI_MIN_ERROR = 0.01;
+const float VIVALDI_MIN_HEIGHT_USEC = 10;
+
+/* Współrzędne sieciowe węzła (Vivaldi z wysokością). Odległość dwóch
+ * węzłów przybliża ich opóźnienie. */
+struct Coordinate {
+  float position[VIVALDI_DIMENSIONS];   // us
+  float height;               // us - opóźnienie łącza dostępowego
+  float error;                // względny błąd przewidywań węzła
+};
+
+/* Parametry trybu współrzędnych (opcja -V). */
+struct CoordinateConfig {
+  int neighbors;              // liczba mierzonych sąsiadów (0 - tryb wyłączony)
+  int port;
+};
+
+/* Przewidywanie opóźnień z współrzędnych Vivaldi (opcja -V k).
+ *
+ * Spośród węzłów opoznienia mierzonych jest tylko k sąsiadów; co
+ * VIVALDI_ROTATE_INTERVAL sekund jeden z nich jest zastępowany losowym
+ * innym węzłem. Serwery spoza usługi opoznienia (tylko ssh) mierzone są
+ * jak zwykle. Raz na VIVALDI_ROUND_INTERVAL sekund:
+ *  - własne współrzędne są poprawiane względem każdego sąsiada o znanych
+ *    współrzędnych i zmierzonym opóźnieniu (Dabek i in., "Vivaldi: A
+ *    Decentralized Network Coordinate System", 2004, z cc = ce = 0.25),
+ *  - własne współrzędne i porcja znanych współrzędnych innych węzłów
+ *    (kolejne adresy, w jednym pakiecie) trafiają do kolejnego węzła
+ *    opoznienia; odbiorca zachowuje najnowsze wersje.
+ * Opóźnienie do węzła to odległość współrzędnych, a jego błąd - średni
+ * błąd względny obu węzłów. */
+class CoordinateExchange {
+  static_assert(PROTOCOL::UDP >= 0, "coordinates are fitted to UDP probe delays");
+
+public:
+  CoordinateExchange(boost::asio::io_service& io_service, servers_ptr servers,
+      CoordinateConfig const& config) :
+          timer(io_service),
+          socket(io_service, udp::endpoint(udp::v4(), config.port)),
+          route_socket(io_service, udp::v4()),
+          servers(servers),
+          port(config.port),
+          neighbors_count(config.neighbors),
+          random_generator(std::random_device()()),
+          own_ip(0),
+          own_version(0),
+          last_peer(0),
+          gossip_cursor(0),
+          rounds(0) {
+    own.height = VIVALDI_MIN_HEIGHT_USEC;
+    own.error = VIVALDI_INITIAL_ERROR;
+    for (int i = 0; i < VIVALDI_DIMENSIONS; i++)
+      own.position[i] = 0;
+    start_receive();
+    round();
+  }
+
+  /* Czy serwer 'ip' jest mierzony (sąsiad, my sami albo serwer spoza opoznienia). */
+  bool probes(address const& ip, Server const& server) const {
+    uint32_t ip_value = ip.to_v4().to_ulong();
+    return !server.measures(PROTOCOL::UDP) || ip_value == own_ip || is_neighbor(ip_value);
+  }
+
+  /* Przewiduje opóźnienie do węzła 'ip' i jego błąd (w sekundach).
+   * Zwraca false, jeśli współrzędne węzła nie są znane. */
+  bool predict(uint32_t ip, float& delay_sec, float& error_sec) const {
+    auto it = known.find(ip);
+    if (it == known.end() || ip == own_ip)
+      return false;
+    float delay = distance(own, it->second.coordinate);
+    delay_sec = delay / SEC_TO_USEC;
+    error_sec = delay_sec * std::min(1.0f, (own.error + it->second.coordinate.error) / 2);
+    return true;
+  }
+
+private:
+  /* Współrzędne innego węzła. */
+  struct KnownCoordinate {
+    Coordinate coordinate;
+    uint32_t version;         // czas nadania współrzędnych przez węzeł (s)
+    time_type updated_at;     // czas odebrania wersji (zegar pomiarów)
+  };
+
+  void round() {
+    uint32_t ip = get_own_address();
+    if (ip != 0)
+      own_ip = ip;
+    expire_known();
+    update_neighbors();
+    for (auto it = neighbors.begin(); it != neighbors.end(); ++it)
+      update_coordinate(*it);
+    own_version = std::max(own_version + 1, static_cast<uint32_t>(get_time_usec() / SEC_TO_USEC));
+
+    auto peer = next_peer();
+    if (peer != servers->end())
+      send_coordinates(peer->first.to_v4().to_ulong());
+
+    rounds++;
+    if (rounds % (VIVALDI_REPORT_INTERVAL / VIVALDI_ROUND_INTERVAL) == 0)
+      report(std::cout);
+
+    timer.expires_from_now(boost::posix_time::seconds(VIVALDI_ROUND_INTERVAL));
+    timer.async_wait(boost::bind(&CoordinateExchange::round, this));
+  }
+
+  bool is_neighbor(uint32_t ip) const {
+    return std::find(neighbors.begin(), neighbors.end(), ip) != neighbors.end();
+  }
+
+  /* Usuwa zniknięte serwery z sąsiadów, uzupełnia ich do 'neighbors_count'
+   * losowymi węzłami i co VIVALDI_ROTATE_INTERVAL sekund wymienia jednego.
+   * Wymieniony sąsiad nie jest już mierzony, więc zapomina swoje pomiary. */
+  void update_neighbors() {
+    auto gone = std::remove_if(neighbors.begin(), neighbors.end(), [this](uint32_t ip) {
+      auto it = servers->find(address(address_v4(ip)));
+      return it == servers->end() || !it->second.measures(PROTOCOL::UDP);
+    });
+    neighbors.erase(gone, neighbors.end());
+
+    std::vector<uint32_t> candidates;
+    for (auto it = servers->begin(); it != servers->end(); ++it) {
+      uint32_t ip = it->first.to_v4().to_ulong();
+      if (it->second.measures(PROTOCOL::UDP) && ip != own_ip && !is_neighbor(ip))
+        candidates.push_back(ip);
+    }
+    std::shuffle(candidates.begin(), candidates.end(), random_generator);
+
+    auto candidate = candidates.begin();
+    if (rounds % (VIVALDI_ROTATE_INTERVAL / VIVALDI_ROUND_INTERVAL) == 0
+        && neighbors.size() == neighbors_count && candidate != candidates.end()) {
+      std::uniform_int_distribution<int> pick(0, neighbors.size() - 1);
+      uint32_t& replaced = neighbors[pick(random_generator)];
+      servers->find(address(address_v4(replaced)))->second.forget_delays();
+      replaced = *candidate++;
+    }
+    while (neighbors.size() < neighbors_count && candidate != candidates.end())
+      neighbors.push_back(*candidate++);
+  }
+
+  /* Krok Vivaldi względem sąsiada 'ip' (jeśli znamy jego współrzędne i opóźnienie). */
+  void update_coordinate(uint32_t ip) {
+    auto remote = known.find(ip);
+    auto server = servers->find(address(address_v4(ip)));
+    if (remote == known.end() || server == servers->end())
+      return;
+    float rtt = server->second.host_stats().delay_sec[PROTOCOL::UDP] * SEC_TO_USEC;
+    if (rtt <= 0)
+      return;
+
+    Coordinate const& other = remote->second.coordinate;
+    float predicted = distance(own, other);
+    float weight = own.error / (own.error + other.error);
+    float sample_error = std::abs(predicted - rtt) / rtt;
+    own.error = sample_error * VIVALDI_CE * weight + own.error * (1 - VIVALDI_CE * weight);
+    own.error = std::max(own.error, VIVALDI_MIN_ERROR);
+
+    /* przesuwamy się wzdłuż wektora od sąsiada [x_i - x_j, h_i + h_j]; krok
+     * dzielimy między pozycję i wysokość według ich udziału w długości tego
+     * wektora (|x_i - x_j| + h_i + h_j, jak w distance): */
+    float direction[VIVALDI_DIMENSIONS];
+    float planar = 0;
+    for (int i = 0; i < VIVALDI_DIMENSIONS; i++) {
+      direction[i] = own.position[i] - other.position[i];
+      planar += direction[i] * direction[i];
+    }
+    planar = std::sqrt(planar);
+    if (planar < 1) {         // te same pozycje - losowy kierunek długości 1 us
+      std::normal_distribution<float> random_direction;
+      planar = 0;
+      for (int i = 0; i < VIVALDI_DIMENSIONS; i++) {
+        direction[i] = random_direction(random_generator);
+        planar += direction[i] * direction[i];
+      }
+      planar = std::sqrt(planar);
+      for (int i = 0; i < VIVALDI_DIMENSIONS; i++)
+        direction[i] /= planar;
+      planar = 1;
+    }
+    float heights = own.height + other.height;
+    float length = planar + heights;
+
+    float step = VIVALDI_CC * weight * (rtt - predicted);
+    for (int i = 0; i < VIVALDI_DIMENSIONS; i++)
+      own.position[i] += step * direction[i] / length;
+    own.height = std::max(VIVALDI_MIN_HEIGHT_USEC, own.height + step * heights / length);
+  }
+
+  static float distance(Coordinate const& a, Coordinate const& b) {
+    float sum = 0;
+    for (int i = 0; i < VIVALDI_DIMENSIONS; i++)
+      sum += (a.position[i] - b.position[i]) * (a.position[i] - b.position[i]);
+    return std::sqrt(sum) + a.height + b.height;
+  }
+
+  /* Usuwa współrzędne, których węzeł nie odświeżył od VIVALDI_COORDINATE_TTL sekund. */
+  void expire_known() {
+    time_type now = get_time_nsec();
+    for (auto it = known.begin(); it != known.end();) {
+      if (now - it->second.updated_at > VIVALDI_COORDINATE_TTL * SEC_TO_NSEC)
+        it = known.erase(it);
+      else
+        ++it;
+    }
+  }
+
+  /* Wypisuje własny błąd i faktyczny średni błąd przewidywań dla sąsiadów. */
+  void report(std::ostream& os) const {
+    float error_sum = 0;
+    int compared = 0;
+    for (auto it = neighbors.begin(); it != neighbors.end(); ++it) {
+      auto server = servers->find(address(address_v4(*it)));
+      float measured = server == servers->end() ? -1 : server->second.host_stats().delay_sec[PROTOCOL::UDP];
+      float predicted, error;
+      if (measured > 0 && predict(*it, predicted, error)) {
+        error_sum += std::abs(predicted - measured) / measured;
+        compared++;
+      }
+    }
+    os << "Coordinates: estimated error " << own.error * 100 << "%, "
+        << neighbors.size() << " neighbors, " << known.size() << " nodes known";
+    if (compared)
+      os << ", neighbor prediction error " << error_sum / compared * 100 << "%";
+    os << std::endl;
+  }
+
+  /* Zwraca adres, pod którym znają nas inne węzły (jak MatrixExchange). */
+  uint32_t get_own_address() {
+    boost::system::error_code error;
+    route_socket.connect(udp::endpoint(address::from_string(MDNS_ADDRESS), MDNS_PORT), error);
+    udp::endpoint local_endpoint = route_socket.local_endpoint(error);
+    return error ? 0 : local_endpoint.address().to_v4().to_ulong();
+  }
+
+  /* Kolejny (po 'last_peer') węzeł opoznienia z mapy serwerów. */
+  servers_map::iterator next_peer() {
+    auto start = servers->upper_bound(address(address_v4(last_peer)));
+    for (int pass = 0; pass < 2; pass++) {
+      for (auto it = pass ? servers->begin() : start; it != servers->end(); ++it) {
+        uint32_t ip = it->first.to_v4().to_ulong();
+        if (it->second.measures(PROTOCOL::UDP) && ip != own_ip) {
+          last_peer = ip;
+          return it;
+        }
+      }
+    }
+    return servers->end();
+  }
+
+  /* Pakiet: magic | liczba | wpisy...
+   * wpis: adres | wersja | pozycja (int32 us)... | wysokość (int32 us) | błąd (uint32, 1e-6)
+   * Pierwszy wpis to własne współrzędne, kolejne - znane współrzędne od 'gossip_cursor'. */
+  void send_coordinates(uint32_t peer) {
+    if (own_ip == 0)
+      return;
+    std::ostringstream packet;
+    std::vector<std::pair<uint32_t, KnownCoordinate const*> > entries;
+    auto it = known.upper_bound(gossip_cursor);
+    for (int i = 0; i < known.size() && entries.size() < VIVALDI_GOSSIP_ENTRIES; i++, ++it) {
+      if (it == known.end())
+        it = known.begin();
+      if (it->first != peer)
+        entries.push_back(std::make_pair(it->first, &it->second));
+      gossip_cursor = it->first;
+    }
+
+    write_be(packet, VIVALDI_MAGIC);
+    write_be(packet, static_cast<uint16_t>(entries.size() + 1));
+    write_entry(packet, own_ip, own_version, own);
+    for (auto entry = entries.begin(); entry != entries.end(); ++entry)
+      write_entry(packet, entry->first, entry->second->version, entry->second->coordinate);
+
+    boost::system::error_code error;
+    socket.send_to(boost::asio::buffer(packet.str()), udp::endpoint(address_v4(peer), port), 0, error);
+  }
+
+  static void write_entry(std::ostream& os, uint32_t ip, uint32_t version, Coordinate const& coordinate) {
+    write_be(os, ip);
+    write_be(os, version);
+    for (int i = 0; i < VIVALDI_DIMENSIONS; i++)
+      write_be(os, static_cast<uint32_t>(static_cast<int32_t>(coordinate.position[i])));
+    write_be(os, static_cast<uint32_t>(coordinate.height));
+    write_be(os, static_cast<uint32_t>(coordinate.error * 1000000));
+  }
+
+  void start_receive() {
+    socket.async_receive_from(boost::asio::buffer(receive_buffer), remote_endpoint,
+        boost::bind(&CoordinateExchange::handle_receive, this,
+          boost::asio::placeholders::error,
+          boost::asio::placeholders::bytes_transferred));
+  }
+
+  void handle_receive(boost::system::error_code const& error, std::size_t bytes_transferred) {
+    /* przyjmujemy pakiety tylko od znanych węzłów: */
+    if (!error && servers->count(remote_endpoint.address())) {
+      std::istringstream is(std::string(receive_buffer.data(), bytes_transferred));
+      uint32_t magic = 0;
+      uint16_t count = 0;
+      read_be(is, magic);
+      read_be(is, count);
+      for (int i = 0; i < count && is && magic == VIVALDI_MAGIC; i++) {
+        uint32_t ip = 0, version = 0, value = 0;
+        Coordinate coordinate;
+        read_be(is, ip);
+        read_be(is, version);
+        for (int d = 0; d < VIVALDI_DIMENSIONS; d++) {
+          read_be(is, value);
+          coordinate.position[d] = static_cast<int32_t>(value);
+        }
+        read_be(is, value);
+        coordinate.height = value;
+        read_be(is, value);
+        coordinate.error = (float) value / 1000000;
+
+        auto it = known.find(ip);
+        if (is && ip != own_ip && coordinate.error > 0
+            && (it == known.end() || it->second.version < version))
+          known[ip] = KnownCoordinate{coordinate, version, get_time_nsec()};
+      }
+    }
+
+    start_receive();
+  }
+
+
+  static const uint32_t VIVALDI_MAGIC = 0x4f505a56;  // "OPZV"
+
+  clock_timer timer;
+  udp::socket socket;           // gniazdo wymiany współrzędnych
+  udp::socket route_socket;     // do ustalania własnego adresu
+  udp::endpoint remote_endpoint;
+  boost::array<char, BUFFER_SIZE * 4> receive_buffer;
+
+  servers_ptr servers;
+  int port;
+  std::size_t neighbors_count;
+  std::mt19937 random_generator;
+
+  Coordinate own;
+  uint32_t own_ip;
+  uint32_t own_version;
+  std::vector<uint32_t> neighbors;              // mierzeni sąsiedzi
+  std::map<uint32_t, KnownCoordinate> known;    // współrzędne innych węzłów
+  uint32_t last_peer;           // ostatni węzeł, do którego wysłano współrzędne
+  uint32_t gossip_cursor;       // ostatni wysłany wpis 'known'
+  unsigned long rounds;
+};
+
+#endif  // COORDINATES_H
@@ -0,0 +1,753 @@
+/* Symulator floty: emuluje N komputerów z usługą _opoznienia._udp (i opcjonalnie
+ * _ssh._tcp) na jednej maszynie z Linuksem, używając kolejnych adresów 127.1.x.y.
+ *
+ * Każdy symulowany komputer ma:
+ *  - odpowiedź mDNS (PTR + A w sekcji Additional, A na pytania o nazwę),
+ *  - serwer pomiarów UDP zgodny z MeasurementServer, ze sztucznym opóźnieniem
+ *    i gubieniem pakietów,
+ *  - (z opcją -s) nasłuchujące gniazdo TCP na porcie 22.
+ * ICMP Echo na adresy 127/8 obsługuje jądro (bez sztucznego opóźnienia).
+ *
+ * Sterownik uruchamia program `opoznienia` (z opcją -S, a jego serwer pomiarów
+ * UDP z opcją -u na porcie SIM_DAEMON_UDP_PORT), stopniowo zwiększa
+ * liczbę komputerów i po każdym kroku raportuje zużycie CPU i pamięci przez
+ * program, liczbę wykrytych komputerów oraz błąd pomiaru UDP względem
+ * wprowadzonego opóźnienia (na podstawie pliku stanu programu). Na koniec
+ * wypisuje największą liczbę komputerów, przy której program działał poprawnie.
+ *
+ * Z opcją -m symulator nie uruchamia programu, tylko tworzy w sobie mapę
+ * 'hosts' serwerów (klasa Server programu), wysyła do nich kilka rund pomiarów
+ * i raportuje zużycie pamięci na jeden serwer (z opcją -H - razem z historią
+ * opóźnień, jak program z opcją -H). Przy co najmniej MEMORY_TEST_MIN_HOSTS
+ * serwerach zużycie ponad MEMORY_TEST_BUDGET (plus rozmiar historii) kończy
+ * program błędem.
+ *
+ * Z opcją -a symulator uruchamia w sobie MeasurementServer i MeasurementClient
+ * programu, mierzące przez UDP, TCP (połączenia przyjmuje symulator) i ICMP
+ * adres 127.0.0.1, i po ALLOC_TEST_WARMUP_SEC sekundach rozgrzewki liczy przez
+ * 'sekundy' s wywołania operator new. Cykl pomiaru i odbicia pakietu w stanie
+ * ustalonym nie powinien alokować - każda alokacja kończy program błędem.
+ * Wykrywanie mDNS (składanie nazw w zapytaniach i odpowiedziach) alokuje
+ * i nie jest objęte testem.
+ *
+ * Użycie: fleet-sim [-p ścieżka_do_opoznienia] [-n początkowe_N] [-N maks_N]
+ *                   [-k krok] [-d opóźnienie_ms] [-j rozrzut_ms] [-l gubienie_%]
+ *                   [-w czas_kroku_s] [-e dopuszczalny_błąd_ms] [-U port_ui] [-s]
+ *                   [-x niestabilne_N] [-o "opcje programu"]
+ *        fleet-sim -m hosts [-H]
+ *        fleet-sim -a sekundy
+ *
+ * Pierwsze 'niestabilne_N' komputerów (-x) odpowiada z losowym opóźnieniem
+ * od 1 do 4 razy większym od wprowadzonego. Opcje -o są przekazywane programowi. */
+
+#include <atomic>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <map>
+#include <cstring>
+#include <csignal>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/array.hpp>
+#include <endian.h>
+
+#include "common.h"
+#include "get_time_usec.h"
+#include "mdns_message.h"
+#include "probe_context.h"
+#include "server.h"
+#include "clock_timer.h"
+#include "handler_allocator.h"
+#include "measurement_server.h"
+#include "measurement_client.h"
+
+using boost::asio::ip::udp;
+using boost::asio::ip::tcp;
+using boost::asio::ip::icmp;
+using boost::asio::ip::address;
+using boost::asio::ip::address_v4;
+
+const uint32_t SIM_BASE_ADDRESS = 0x7F010001;    // 127.1.0.1 - adres pierwszego komputera
+const int SIM_MAX_PEERS = 60000;
+const std::string SIM_SNAPSHOT_PATH = "/tmp/fleet-sim.snapshot";
+const int SIM_UI_PORT_DEFAULT = 13673;
+const int SIM_DAEMON_UDP_PORT = UDP_PORT_DEFAULT + 1;  // serwer pomiarów programu (port
+                                        // UDP_PORT_DEFAULT zajmują symulowane komputery)
+const uint32_t MEMORY_TEST_BASE_ADDRESS = 0x7F030001;  // 127.3.0.1 - serwery trybu -m
+const int MEMORY_TEST_ROUNDS = 3;
+const long MEMORY_TEST_BUDGET = 1024;   // tryb -m: dopuszczalna pamięć na serwer w B (bez historii)
+const int MEMORY_TEST_MIN_HOSTS = 10000;  // tryb -m: mniej serwerów - pomiar zbyt zgrubny
+const int ALLOC_TEST_WARMUP_SEC = 2 * MAX_DELAYED_QUERIES;  // tryb -a: czas przed liczeniem
+                                        // alokacji (pełny pierścień gniazd pomiarów TCP)
+
+
+/* Parametry symulacji. */
+struct SimConfig {
+  std::string daemon_path = "./opoznienia";
+  int start_peers = 100;
+  int max_peers = 1000;
+  int step = 100;
+  int delay_ms = 5;           // bazowe sztuczne opóźnienie serwera UDP
+  int spread_ms = 0;          // komputer i ma opóźnienie delay_ms + i % (spread_ms + 1)
+  float loss = 0;             // prawdopodobieństwo zgubienia pakietu UDP (0..1)
+  int step_seconds = 30;      // czas trwania jednego kroku
+  float max_error_ms = 2;     // dopuszczalny średni błąd pomiaru
+  int ui_port = SIM_UI_PORT_DEFAULT;
+  bool ssh = false;           // czy rozgłaszać _ssh._tcp i nasłuchiwać na porcie 22
+  int memory_hosts = 0;       // tryb -m: liczba serwerów (0 - zwykła symulacja)
+  int alloc_seconds = 0;      // tryb -a: czas liczenia alokacji (0 - zwykła symulacja)
+  int unstable_peers = 0;     // liczba komputerów o zmiennym opóźnieniu
+  std::string daemon_options; // dodatkowe opcje programu
+};
+
+
+/* Symulowany komputer: serwer pomiarów UDP ze sztucznym opóźnieniem
+ * i gubieniem pakietów oraz opcjonalnie gniazdo TCP na porcie 22. */
+class SimPeer {
+public:
+  SimPeer(boost::asio::io_service& io_service, SimConfig const& config, int index,
+      std::mt19937& random_generator, std::atomic<unsigned long>& probes) :
+          io_service(io_service),
+          ip(address_v4(SIM_BASE_ADDRESS + index)),
+          delay_usec((config.delay_ms + index % (config.spread_ms + 1)) * 1000L),
+          loss(config.loss),
+          unstable(index < config.unstable_peers),
+          random_generator(random_generator),
+          probes(probes),
+          socket(io_service),
+          acceptor(io_service),
+          tcp_socket(io_service),
+          ssh(false) {
+    socket.open(udp::v4());
+    socket.set_option(udp::socket::reuse_address(true));
+    socket.bind(udp::endpoint(ip, UDP_PORT_DEFAULT));
+    start_receive();
+
+    if (config.ssh) {
+      boost::system::error_code error;
+      acceptor.open(tcp::v4(), error);
+      acceptor.set_option(tcp::acceptor::reuse_address(true), error);
+      acceptor.bind(tcp::endpoint(ip, SSH_PORT), error);
+      if (!error)
+        acceptor.listen(boost::asio::socket_base::max_connections, error);
+      ssh = !error;       // rozgłaszamy ssh tylko, jeśli udało się nasłuchiwać
+      if (ssh)
+        start_accept();
+    }
+  }
+
+  address_v4 get_ip() const { return ip; }
+  time_type get_delay_usec() const { return delay_usec; }
+  bool has_ssh() const { return ssh; }
+
+private:
+  void start_receive() {
+    socket.async_receive_from(boost::asio::buffer(time_buffer), remote_endpoint,
+        boost::bind(&SimPeer::handle_receive, this,
+          boost::asio::placeholders::error,
+          boost::asio::placeholders::bytes_transferred));
+  }
+
+  /* Jak MeasurementServer, ale odpowiedź wysyłana jest po 'delay_usec'
+   * (1-4 razy dłużej dla niestabilnych komputerów) lub wcale,
+   * z prawdopodobieństwem 'loss'. */
+  void handle_receive(boost::system::error_code const& error, std::size_t bytes_transferred) {
+    if (!error)
+      probes++;
+    if (!error && bytes_transferred >= sizeof(uint64_t)
+        && std::uniform_real_distribution<float>(0, 1)(random_generator) >= loss) {
+      time_type delay = unstable ?
+          delay_usec * std::uniform_real_distribution<float>(1, 4)(random_generator) : delay_usec;
+      std::shared_ptr<boost::array<uint64_t, 2> > reply(new boost::array<uint64_t, 2>(time_buffer));
+      std::shared_ptr<boost::asio::deadline_timer> timer(new boost::asio::deadline_timer(io_service,
+          boost::posix_time::microseconds(delay)));
+      timer->async_wait(boost::bind(&SimPeer::send_reply, this, reply, remote_endpoint, timer));
+    }
+
+    start_receive();
+  }
+
+  void send_reply(std::shared_ptr<boost::array<uint64_t, 2> > reply, udp::endpoint destination,
+      std::shared_ptr<boost::asio::deadline_timer> /* timer */) {
+    (*reply)[1] = htobe64(get_time_usec());
+    socket.async_send_to(boost::asio::buffer(*reply), destination,
+        boost::bind(&SimPeer::handle_send, this, reply));
+  }
+
+  void handle_send(std::shared_ptr<boost::array<uint64_t, 2> > /* reply */) {}
+
+  /* Akceptuje i od razu zamyka połączenia TCP (liczy się tylko nawiązanie). */
+  void start_accept() {
+    acceptor.async_accept(tcp_socket, boost::bind(&SimPeer::handle_accept, this,
+        boost::asio::placeholders::error));
+  }
+
+  void handle_accept(boost::system::error_code const& error) {
+    boost::system::error_code ignored;
+    tcp_socket.close(ignored);
+    if (error != boost::asio::error::operation_aborted)
+      start_accept();
+  }
+
+
+  boost::asio::io_service& io_service;
+  address_v4 ip;
+  time_type delay_usec;       // sztuczne opóźnienie odpowiedzi UDP
+  float loss;                 // prawdopodobieństwo zgubienia pakietu
+  bool unstable;              // czy opóźnienie jest losowo zmienne
+  std::mt19937& random_generator;
+  std::atomic<unsigned long>& probes;   // licznik odebranych pomiarów UDP floty
+
+  boost::array<uint64_t, 2> time_buffer;
+  udp::socket socket;
+  udp::endpoint remote_endpoint;
+  tcp::acceptor acceptor;
+  tcp::socket tcp_socket;
+  bool ssh;                   // czy komputer nasłuchuje na porcie 22
+};
+
+
+/* Odpowiada na pytania mDNS w imieniu wszystkich symulowanych komputerów.
+ * Każdy komputer odpowiada osobnym pakietem po losowym opóźnieniu 20-120 ms,
+ * tak jak robiłby to osobny serwer. */
+class SimMdnsResponder {
+public:
+  SimMdnsResponder(boost::asio::io_service& io_service, std::vector<std::unique_ptr<SimPeer> > const& peers,
+      std::mt19937& random_generator) :
+          peers(peers),
+          random_generator(random_generator),
+          recv_buffer(),
+          recv_stream(&recv_buffer),
+          multicast_endpoint(address::from_string(MDNS_ADDRESS), MDNS_PORT),
+          socket(io_service),
+          send_timer(io_service),
+          timer_active(false),
+          opoznienia_service(OPOZNIENIA_SERVICE),
+          ssh_service(SSH_SERVICE) {
+    socket.open(udp::v4());
+    socket.set_option(udp::socket::reuse_address(true));
+    socket.bind(udp::endpoint(udp::v4(), MDNS_PORT));
+    socket.set_option(boost::asio::ip::multicast::join_group(multicast_endpoint.address()));
+    start_receive();
+  }
+
+  /* Zapamiętuje nazwy nowego komputera o indeksie 'index' (do pytań typu A). */
+  void peer_added(int index) {
+    peer_names[MdnsDomainName(peer_name(index, OPOZNIENIA_SERVICE))] = index;
+    if (peers[index]->has_ssh())
+      peer_names[MdnsDomainName(peer_name(index, SSH_SERVICE))] = index;
+  }
+
+private:
+  /* Nazwa komputera o indeksie 'index' w usłudze 'service'. */
+  static std::string peer_name(int index, std::string const& service) {
+    return "sim" + std::to_string(index) + '.' + service;
+  }
+
+  void start_receive() {
+    recv_buffer.consume(recv_buffer.size());
+    socket.async_receive_from(recv_buffer.prepare(BUFFER_SIZE), remote_endpoint,
+        boost::bind(&SimMdnsResponder::handle_receive, this,
+          boost::asio::placeholders::error,
+          boost::asio::placeholders::bytes_transferred));
+  }
+
+  void handle_receive(boost::system::error_code const& error, std::size_t bytes_transferred) {
+    if (!error) {
+      recv_buffer.commit(bytes_transferred);
+      MdnsQuery query;
+      try {
+        if (query.try_read(recv_stream)) {
+          std::vector<MdnsQuestion> const& questions = query.get_questions();
+          for (int i = 0; i < questions.size(); i++)
+            answer(questions[i]);
+        }
+      } catch (InvalidMdnsMessageException const&) {}
+    }
+
+    start_receive();
+  }
+
+  /* Planuje odpowiedzi symulowanych komputerów na pytanie 'question':
+   * na pytanie PTR odpowiadają wszystkie, na pytanie A - tylko właściciel nazwy. */
+  void answer(MdnsQuestion const& question) {
+    udp::endpoint destination = question.unicast_response() ? remote_endpoint : multicast_endpoint;
+    uint16_t ptr = static_cast<uint16_t>(QTYPE::PTR);
+    uint16_t a = static_cast<uint16_t>(QTYPE::A);
+    MdnsDomainName name = question.get_name();
+
+    if (question.get_qtype() == ptr && (name == opoznienia_service || name == ssh_service)) {
+      std::string const& service = name == opoznienia_service ? OPOZNIENIA_SERVICE : SSH_SERVICE;
+      for (int i = 0; i < peers.size(); i++) {
+        if (name == ssh_service && !peers[i]->has_ssh())
+          continue;
+        MdnsDomainName server_name(peer_name(i, service));
+        MdnsResponse response;
+        response.add_answer(MdnsAnswer(name, ptr, INTERNET_CLASS, TTL_DEFAULT, server_name));
+        response.add_additional(MdnsAnswer(server_name, a, INTERNET_CLASS, TTL_DEFAULT,
+            peers[i]->get_ip().to_ulong()));
+        schedule(response, destination);
+      }
+    } else if (question.get_qtype() == a) {
+      auto it = peer_names.find(name);
+      if (it != peer_names.end()) {
+        MdnsResponse response;
+        response.add_answer(MdnsAnswer(name, a, INTERNET_CLASS, TTL_DEFAULT,
+            peers[it->second]->get_ip().to_ulong()));
+        schedule(response, destination);
+      }
+    }
+
+    if (!scheduled.empty() && !timer_active)
+      reset_timer();
+  }
+
+  /* Planuje wysłanie 'response' po losowym opóźnieniu. */
+  void schedule(MdnsResponse const& response, udp::endpoint const& destination) {
+    std::ostringstream wire;
+    wire << response;
+    time_type send_time = get_time_usec() + 1000L * std::uniform_int_distribution<int>(
+        MDNS_SHARED_DELAY_MIN_MS, MDNS_SHARED_DELAY_MAX_MS)(random_generator);
+    scheduled.insert(std::make_pair(send_time, std::make_pair(destination, wire.str())));
+  }
+
+  /* Wysyła wszystkie zaplanowane odpowiedzi, których czas już nadszedł. */
+  void send_scheduled() {
+    time_type now = get_time_usec();
+    timer_active = false;
+    while (!scheduled.empty() && scheduled.begin()->first <= now) {
+      std::shared_ptr<std::string> packet(new std::string(scheduled.begin()->second.second));
+      socket.async_send_to(boost::asio::buffer(*packet), scheduled.begin()->second.first,
+          boost::bind(&SimMdnsResponder::handle_send, this, packet));
+      scheduled.erase(scheduled.begin());
+    }
+    if (!scheduled.empty())
+      reset_timer();
+  }
+
+  void handle_send(std::shared_ptr<std::string> /* packet */) {}
+
+  void reset_timer() {
+    timer_active = true;
+    send_timer.expires_from_now(boost::posix_time::milliseconds(1));
+    send_timer.async_wait(boost::bind(&SimMdnsResponder::send_scheduled, this));
+  }
+
+
+  std::vector<std::unique_ptr<SimPeer> > const& peers;
+  std::mt19937& random_generator;
+
+  boost::asio::streambuf recv_buffer;
+  std::istream recv_stream;
+  udp::endpoint multicast_endpoint;
+  udp::endpoint remote_endpoint;
+  udp::socket socket;
+
+  boost::asio::deadline_timer send_timer;
+  bool timer_active;
+  std::multimap<time_type, std::pair<udp::endpoint, std::string> > scheduled;  // czas -> (adresat, pakiet)
+
+  const MdnsDomainName opoznienia_service;
+  const MdnsDomainName ssh_service;
+  std::map<MdnsDomainName, int> peer_names;   // nazwa komputera -> indeks
+};
+
+
+/* Cała symulowana flota. Komputery dodawane są w wątku io_service. */
+class Fleet {
+public:
+  Fleet(boost::asio::io_service& io_service, SimConfig const& config) :
+      io_service(io_service),
+      config(config),
+      random_generator(std::random_device()()),
+      probes(0),
+      responder(io_service, peers, random_generator) {}
+
+  void add_peers(int count) {
+    for (int i = 0; i < count && peers.size() < SIM_MAX_PEERS; i++) {
+      peers.emplace_back(new SimPeer(io_service, config, peers.size(), random_generator, probes));
+      responder.peer_added(peers.size() - 1);
+    }
+  }
+
+  /* Wprowadzone opóźnienie komputera o adresie 'ip' (lub 0, jeśli to nie nasz adres). */
+  time_type delay_of(uint32_t ip) const {
+    uint32_t index = ip - SIM_BASE_ADDRESS;
+    return ip >= SIM_BASE_ADDRESS && index < peers.size() ? peers[index]->get_delay_usec() : 0;
+  }
+
+  /* Liczba pomiarów UDP odebranych dotąd przez wszystkie komputery. */
+  unsigned long probes_received() const { return probes; }
+
+private:
+  boost::asio::io_service& io_service;
+  SimConfig const& config;
+  std::mt19937 random_generator;
+  std::vector<std::unique_ptr<SimPeer> > peers;
+  std::atomic<unsigned long> probes;
+  SimMdnsResponder responder;
+};
+
+
+/* Wynik jednego kroku pomiarowego. */
+struct StepReport {
+  int peers;
+  int discovered;         // komputery z pomiarami UDP w pliku stanu programu
+  float mean_error_ms;    // średni błąd |zmierzone - wprowadzone|
+  float max_error_ms;
+  float cpu_percent;      // zużycie CPU przez program w czasie kroku
+  long rss_kb;            // pamięć rezydentna programu
+  float probe_rate;       // pomiary UDP na sekundę odebrane przez flotę
+};
+
+/* Czas CPU procesu 'pid' (user + system) w sekundach. */
+double process_cpu_seconds(pid_t pid) {
+  std::ifstream stat("/proc/" + std::to_string(pid) + "/stat");
+  std::string line;
+  std::getline(stat, line);
+  std::istringstream fields(line.substr(line.rfind(')') + 2));   // pola od 3. (stan)
+  std::string field;
+  unsigned long utime = 0, stime = 0;
+  for (int i = 3; i <= 15 && fields >> field; i++) {
+    if (i == 14) utime = std::stoul(field);
+    if (i == 15) stime = std::stoul(field);
+  }
+  return (double) (utime + stime) / sysconf(_SC_CLK_TCK);
+}
+
+/* Pamięć rezydentna procesu 'pid' w kB. */
+long process_rss_kb(pid_t pid) {
+  std::ifstream status("/proc/" + std::to_string(pid) + "/status");
+  std::string key;
+  long value;
+  while (status >> key) {
+    if (key == "VmRSS:" && status >> value)
+      return value;
+    status.ignore(1024, '\n');
+  }
+  return 0;
+}
+
+/* Wczytuje plik stanu programu (format ServersSnapshot) i porównuje średnie
+ * opóźnienia UDP z opóźnieniami wprowadzonymi przez symulator. */
+void read_snapshot(Fleet const& fleet, StepReport& report) {
+  std::ifstream file(SIM_SNAPSHOT_PATH, std::ios::binary);
+  uint32_t magic, saved_at, count;
+  uint16_t version;
+  read_be(file, magic);
+  read_be(file, version);
+  read_be(file, saved_at);
+  read_be(file, count);
+
+  double error_sum = 0;
+  report.discovered = 0;
+  report.max_error_ms = 0;
+  for (uint32_t i = 0; i < count && file; i++) {
+    uint32_t ip, udp_ttl, tcp_ttl;
+    read_be(file, ip);
+    read_be(file, udp_ttl);
+    read_be(file, tcp_ttl);
+    for (int proto = 0; proto < PROTOCOL_COUNT; proto++) {
+      uint8_t n;
+      uint64_t sum = 0;
+      read_be(file, n);
+      for (int k = 0; k < n; k++) {
+        uint32_t delay;
+        read_be(file, delay);
+        sum += delay;
+      }
+      time_type injected = fleet.delay_of(ip);
+      if (proto == PROTOCOL::UDP && n > 0 && injected > 0) {
+        float error_ms = std::abs((double) sum / n - (double) injected) / 1000;
+        error_sum += error_ms;
+        report.max_error_ms = std::max(report.max_error_ms, error_ms);
+        report.discovered++;
+      }
+    }
+  }
+  report.mean_error_ms = report.discovered ? error_sum / report.discovered : 0;
+}
+
+/* Uruchamia program `opoznienia` zapisujący stan do SIM_SNAPSHOT_PATH. */
+pid_t start_daemon(SimConfig const& config) {
+  std::remove(SIM_SNAPSHOT_PATH.c_str());
+  std::vector<std::string> args = {config.daemon_path, "-u", std::to_string(SIM_DAEMON_UDP_PORT),
+      "-U", std::to_string(config.ui_port), "-S", SIM_SNAPSHOT_PATH};
+  std::istringstream options(config.daemon_options);
+  std::string option;
+  while (options >> option)
+    args.push_back(option);
+
+  pid_t pid = fork();
+  if (pid == 0) {
+    std::vector<char*> argv;
+    for (auto it = args.begin(); it != args.end(); ++it)
+      argv.push_back(const_cast<char*>(it->c_str()));
+    argv.push_back(NULL);
+    execv(config.daemon_path.c_str(), argv.data());
+    std::cerr << "Failed to start " << config.daemon_path << "\n";
+    _exit(1);
+  }
+  return pid;
+}
+
+void parse_arguments(int argc, char const *argv[], SimConfig& config) {
+  for (int arg = 1; arg < argc; ++arg) {
+    if (strcmp(argv[arg], "-s") == 0) {
+      config.ssh = true;
+    } else if (strcmp(argv[arg], "-H") == 0) {
+      LatencyHistory::enabled() = true;
+    } else if (arg == argc - 1) {
+      throw std::invalid_argument("parsing error");
+    } else {
+      std::string value(argv[arg + 1]);
+      if (strcmp(argv[arg], "-p") == 0)      config.daemon_path = value;
+      else if (strcmp(argv[arg], "-n") == 0) config.start_peers = std::stoi(value);
+      else if (strcmp(argv[arg], "-N") == 0) config.max_peers = std::stoi(value);
+      else if (strcmp(argv[arg], "-k") == 0) config.step = std::stoi(value);
+      else if (strcmp(argv[arg], "-d") == 0) config.delay_ms = std::stoi(value);
+      else if (strcmp(argv[arg], "-j") == 0) config.spread_ms = std::stoi(value);
+      else if (strcmp(argv[arg], "-l") == 0) config.loss = std::stof(value) / 100;
+      else if (strcmp(argv[arg], "-w") == 0) config.step_seconds = std::stoi(value);
+      else if (strcmp(argv[arg], "-e") == 0) config.max_error_ms = std::stof(value);
+      else if (strcmp(argv[arg], "-U") == 0) config.ui_port = std::stoi(value);
+      else if (strcmp(argv[arg], "-m") == 0) config.memory_hosts = std::stoi(value);
+      else if (strcmp(argv[arg], "-a") == 0) config.alloc_seconds = std::stoi(value);
+      else if (strcmp(argv[arg], "-x") == 0) config.unstable_peers = std::stoi(value);
+      else if (strcmp(argv[arg], "-o") == 0) config.daemon_options = value;
+      else throw std::invalid_argument("unkown argument type");
+      arg++;
+    }
+  }
+  if (config.step <= 0 || config.start_peers <= 0)
+    throw std::invalid_argument("non-positive peer count");
+  /* raport gniazd (co ICMP_REPORT_INTERVAL sekund) wypisuje tekst, czyli alokuje: */
+  if (config.alloc_seconds < 0 || ALLOC_TEST_WARMUP_SEC + config.alloc_seconds >= ICMP_REPORT_INTERVAL)
+    throw std::invalid_argument("allocation test longer than report interval");
+}
+
+/* Tryb -m: tworzy 'hosts' serwerów o adresach 127.3.x.y z aktywnymi pomiarami
+ * UDP i ICMP, wysyła do nich MEMORY_TEST_ROUNDS rund pomiarów (odpowiedzi nie
+ * są odbierane, więc tablice oczekujących pomiarów się zapełniają) i wypisuje
+ * przyrost pamięci rezydentnej na jeden serwer. Zwraca kod wyjścia programu. */
+int measure_host_memory(int hosts) {
+  boost::asio::io_service io_service;
+  std::shared_ptr<udp::socket> udp_socket(new udp::socket(io_service, udp::v4()));
+  std::shared_ptr<icmp::socket> icmp_socket(new icmp::socket(io_service, icmp::v4()));
+  ProbeScheduleConfig schedule_config = {MEASUREMENT_INTERVAL_DEFAULT, false, std::vector<ProbeClass>()};
+  ProbeContext context(io_service, udp_socket, icmp_socket, schedule_config);
+  servers_map servers;
+
+  long rss_before = process_rss_kb(getpid());
+  for (int i = 0; i < hosts; i++) {
+    address_v4 ip(MEMORY_TEST_BASE_ADDRESS + i);
+    servers.emplace(address(ip), Server(ip, context)).first->second.enable_udp(TTL_DEFAULT);
+  }
+  for (int round = 0; round < MEMORY_TEST_ROUNDS; round++) {
+    for (auto it = servers.begin(); it != servers.end(); ++it)
+      it->second.send_queries();
+    io_service.poll();
+  }
+  long rss_after = process_rss_kb(getpid());
+
+  std::cout << "hosts " << hosts << "\n"
+      << "sizeof(Server) " << sizeof(Server) << " B\n";
+  if (LatencyHistory::enabled())
+    std::cout << "sizeof(LatencyHistory) " << sizeof(LatencyHistory) << " B\n";
+  long per_host = (rss_after - rss_before) * 1024 / hosts;
+  std::cout << "rss_per_host " << per_host << " B\n"
+      << "failed_sends " << context.get_failed_sends() << std::endl;
+
+  long budget = MEMORY_TEST_BUDGET + (LatencyHistory::enabled() ? sizeof(LatencyHistory) : 0);
+  if (hosts >= MEMORY_TEST_MIN_HOSTS && per_host > budget) {
+    std::cerr << "Memory per host over budget of " << budget << " B\n";
+    return 1;
+  }
+  return 0;
+}
+
+/* Licznik wywołań operator new (tryb -a). */
+std::atomic<unsigned long> allocations(0);
+
+void* operator new(std::size_t size) {
+  allocations++;
+  void* pointer = std::malloc(size ? size : 1);
+  if (!pointer)
+    throw std::bad_alloc();
+  return pointer;
+}
+
+void operator delete(void* pointer) noexcept {
+  std::free(pointer);
+}
+
+/* Tryb -a: przyjmuje i od razu zamyka połączenia pomiarów TCP (jak sshd),
+ * używając cyklicznie jednego gniazda i pamięci handlera. */
+class LoopbackAcceptor {
+public:
+  explicit LoopbackAcceptor(boost::asio::io_service& io_service) :
+      acceptor(io_service, tcp::endpoint(address_v4::loopback(), 0)),
+      peer(io_service) {
+    start_accept();
+  }
+
+  uint16_t port() const { return acceptor.local_endpoint().port(); }
+
+private:
+  void start_accept() {
+    acceptor.async_accept(peer, make_custom_alloc_handler(memory,
+        boost::bind(&LoopbackAcceptor::handle_accept, this, boost::asio::placeholders::error)));
+  }
+
+  void handle_accept(boost::system::error_code const& error) {
+    boost::system::error_code ignored;
+    peer.close(ignored);
+    if (!error)
+      start_accept();
+  }
+
+  HandlerMemory memory;
+  tcp::acceptor acceptor;
+  tcp::socket peer;
+};
+
+/* Tryb -a: mierzy 127.0.0.1 (UDP przez MeasurementServer w tym samym wątku,
+ * TCP przez LoopbackAcceptor i ICMP) klasą MeasurementClient i sprawdza, czy
+ * w ciągu 'seconds' sekund po rozgrzewce nie było alokacji. Pozostałe
+ * liczniki programu (mDNS, publikacja statystyk) mają okres dłuższy od
+ * testu. Zwraca kod wyjścia. */
+int count_steady_allocations(int seconds) {
+  boost::asio::io_service io_service;
+  MeasurementServer measurement_server(io_service, UDP_PORT_DEFAULT);
+  ProbeScheduleConfig schedule_config = {MEASUREMENT_INTERVAL_DEFAULT, false, std::vector<ProbeClass>()};
+  CalibrationConfig calibration_config = {0, 0, false};
+  ReceiveThreadConfig receive_thread_config = {false, RECEIVE_THREAD_CPU_DEFAULT, false, 0};
+  MatrixExchangeConfig matrix_config = {false, MATRIX_PORT_DEFAULT, MATRIX_EXPORT_PATH_DEFAULT};
+  CoordinateConfig coordinate_config = {0, VIVALDI_PORT_DEFAULT};
+  int idle_interval = ALLOC_TEST_WARMUP_SEC + seconds + 1;
+  MeasurementClient client(io_service, UDP_PORT_DEFAULT, SIM_UI_PORT_DEFAULT, schedule_config,
+      idle_interval, idle_interval, SNAPSHOT_PATH_DEFAULT, calibration_config,
+      receive_thread_config, PROBE_BUDGET_DEFAULT, matrix_config, coordinate_config);
+
+  LoopbackAcceptor ssh_server(io_service);
+  address_v4 localhost(address_v4::loopback());
+  servers_map& servers = *client.get_servers();
+  Server& server = servers.emplace(address(localhost),
+      Server(localhost, client.get_probe_context(), ssh_server.port())).first->second;
+  server.enable_udp(idle_interval + TTL_DEFAULT);     // nie wygasa w czasie testu
+  server.enable_tcp(idle_interval + TTL_DEFAULT);
+
+  /* liczniki testu mają własną pamięć handlerów, żeby nie zajmować pamięci
+   * podręcznej asio używanej przez liczniki programu: */
+  unsigned long start_allocations = 0, end_allocations = 0;
+  clock_timer start_timer(io_service), end_timer(io_service);
+  HandlerMemory start_memory, end_memory;
+  start_timer.expires_from_now(boost::posix_time::seconds(ALLOC_TEST_WARMUP_SEC));
+  start_timer.async_wait(make_custom_alloc_handler(start_memory,
+      [&start_allocations](boost::system::error_code const&) {
+        start_allocations = allocations;
+      }));
+  end_timer.expires_from_now(boost::posix_time::seconds(ALLOC_TEST_WARMUP_SEC + seconds));
+  end_timer.async_wait(make_custom_alloc_handler(end_memory,
+      [&](boost::system::error_code const&) {
+        end_allocations = allocations;
+        io_service.stop();
+      }));
+  io_service.run();
+
+  HostStats host = servers.begin()->second.host_stats();
+  std::cout << "allocations " << end_allocations - start_allocations << " in " << seconds
+      << " s of probing 127.0.0.1, delays [s]:";
+  for (int proto = 0; proto < PROTOCOL_COUNT; proto++)
+    std::cout << ' ' << EnabledProbes::name(proto) << ' ' << host.delay_sec[proto];
+  std::cout << std::endl;
+
+  if ((PROTOCOL::UDP >= 0 && host.delay_sec[PROTOCOL::UDP] < 0)
+      || (PROTOCOL::TCP >= 0 && host.delay_sec[PROTOCOL::TCP] < 0)) {
+    std::cerr << "No UDP or TCP replies - allocation test inconclusive\n";
+    return 1;
+  }
+  return end_allocations == start_allocations ? 0 : 1;
+}
+
+int main(int argc, char const *argv[]) {
+  SimConfig config;
+  try {
+    parse_arguments(argc, argv, config);
+  } catch (std::logic_error const& e) {
+    std::cerr << "Error parsing arguments: " << e.what() << "\n";
+    return 1;
+  }
+
+  if (config.memory_hosts > 0)
+    return measure_host_memory(config.memory_hosts);
+  if (config.alloc_seconds > 0)
+    return count_steady_allocations(config.alloc_seconds);
+
+  /* po 1-2 deskryptory na komputer w symulatorze i do 10 gniazd TCP na komputer
+   * w programie - podnosimy limit (dziedziczony przez program): */
+  struct rlimit limit;
+  getrlimit(RLIMIT_NOFILE, &limit);
+  limit.rlim_cur = limit.rlim_max;
+  setrlimit(RLIMIT_NOFILE, &limit);
+
+  boost::asio::io_service io_service;
+  boost::asio::io_service::work work(io_service);
+  Fleet fleet(io_service, config);
+  std::thread sim_thread(boost::bind(&boost::asio::io_service::run, &io_service));
+
+  pid_t daemon_pid = start_daemon(config);
+  int sustained = 0;
+
+  std::cout << "peers discovered mean_err_ms max_err_ms cpu_% rss_kb probes_per_s\n";
+  for (int peers = config.start_peers; peers <= config.max_peers; peers += config.step) {
+    int to_add = peers == config.start_peers ? peers : config.step;
+    io_service.post(boost::bind(&Fleet::add_peers, &fleet, to_add));
+
+    double cpu_start = process_cpu_seconds(daemon_pid);
+    unsigned long probes_start = fleet.probes_received();
+    std::this_thread::sleep_for(std::chrono::seconds(config.step_seconds));
+    double cpu_end = process_cpu_seconds(daemon_pid);
+    unsigned long probes_end = fleet.probes_received();
+
+    int status;
+    if (waitpid(daemon_pid, &status, WNOHANG) != 0) {
+      std::cout << "daemon exited at " << peers << " peers\n";
+      break;
+    }
+
+    StepReport report;
+    report.peers = peers;
+    report.cpu_percent = 100 * (cpu_end - cpu_start) / config.step_seconds;
+    report.rss_kb = process_rss_kb(daemon_pid);
+    report.probe_rate = (float) (probes_end - probes_start) / config.step_seconds;
+    read_snapshot(fleet, report);
+
+    std::cout << report.peers << ' ' << report.discovered << ' ' << report.mean_error_ms << ' '
+        << report.max_error_ms << ' ' << report.cpu_percent << ' ' << report.rss_kb << ' '
+        << report.probe_rate << std::endl;
+
+    /* krok zaliczony: wykryto >= 95% komputerów, błąd w normie, CPU < 1 rdzeń */
+    if (report.discovered * 100 >= peers * 95 && report.mean_error_ms <= config.max_error_ms
+        && report.cpu_percent < 100)
+      sustained = peers;
+    else
+      break;
+  }
+
+  std::cout << "max sustained peers: " << sustained << std::endl;
+
+  kill(daemon_pid, SIGTERM);
+  waitpid(daemon_pid, NULL, 0);
+  io_service.stop();
+  sim_thread.join();
+  return 0;
+}
@@ -1,7 +1,15 @@
 #ifndef GET_TIME_USEC_H
 #define GET_TIME_USEC_H
 
+/* Czas wirtualny w us (symulacja, odtwarzanie nagrań); 0 - zegar systemowy. */
+inline uint64_t& virtual_time_usec() {
+    static uint64_t time = 0;
+    return time;
+}
+
 inline uint64_t get_time_usec() {
+    if (virtual_time_usec())
+        return virtual_time_usec();
     struct timeval timer;
     gettimeofday(&timer, NULL);
     return timer.tv_sec * 1000000ULL + timer.tv_usec;
@@ -0,0 +1,115 @@
+#ifndef HANDLER_ALLOCATOR_H
+#define HANDLER_ALLOCATOR_H
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include "common.h"
+
+const std::size_t HANDLER_MEMORY_SIZE = 256; // pamięć na handler jednej operacji asio
+
+/* na podstawie przykładów allocation ze stron
+ * http://www.boost.org/doc/libs/1_58_0/doc/html/boost_asio/examples/cpp11_examples.html
+ * http://www.boost.org/doc/libs/1_74_0/doc/html/boost_asio/examples/cpp11_examples.html */
+
+/* Pamięć na obiekt jednej oczekującej operacji asynchronicznej. Każda
+ * cyklicznie ponawiana operacja (odbiór, wysłanie) ma własny HandlerMemory,
+ * więc jej handler w stanie ustalonym nie wymaga alokacji na stercie.
+ * Gdy blok jest zajęty albo za mały, używana jest zwykła alokacja. */
+class HandlerMemory {
+public:
+  HandlerMemory() : in_use(false) {}
+
+  HandlerMemory(HandlerMemory const&) = delete;
+  HandlerMemory& operator=(HandlerMemory const&) = delete;
+
+  void* allocate(std::size_t size) {
+    if (!in_use && size <= sizeof(storage)) {
+      in_use = true;
+      return &storage;
+    }
+    return ::operator new(size);
+  }
+
+  void deallocate(void* pointer) {
+    if (pointer == &storage)
+      in_use = false;
+    else
+      ::operator delete(pointer);
+  }
+
+private:
+  std::aligned_storage<HANDLER_MEMORY_SIZE>::type storage;
+  bool in_use;
+};
+
+/* Alokator zgodny z wymaganiami asio, korzystający z HandlerMemory. */
+template <typename T>
+class HandlerAllocator {
+public:
+  typedef T value_type;
+
+  explicit HandlerAllocator(HandlerMemory& memory) : memory(memory) {}
+
+  template <typename U>
+  HandlerAllocator(HandlerAllocator<U> const& other) : memory(other.memory) {}
+
+  bool operator==(HandlerAllocator const& other) const { return &memory == &other.memory; }
+  bool operator!=(HandlerAllocator const& other) const { return &memory != &other.memory; }
+
+  T* allocate(std::size_t n) const {
+    return static_cast<T*>(memory.allocate(sizeof(T) * n));
+  }
+
+  void deallocate(T* pointer, std::size_t) const {
+    memory.deallocate(pointer);
+  }
+
+private:
+  template <typename> friend class HandlerAllocator;
+
+  HandlerMemory& memory;
+};
+
+/* Opakowanie handlera, które wskazuje asio pamięć 'memory': przez alokator
+ * (get_allocator, Boost >= 1.66) i przez funkcje asio_handler_allocate
+ * i asio_handler_deallocate (jedyne uwzględniane przez starsze Boost). */
+template <typename Handler>
+class CustomAllocHandler {
+public:
+  typedef HandlerAllocator<Handler> allocator_type;
+
+  CustomAllocHandler(HandlerMemory& memory, Handler handler) :
+      memory(memory), handler(handler) {}
+
+  allocator_type get_allocator() const {
+    return allocator_type(memory);
+  }
+
+  template <typename ...Args>
+  void operator()(Args&&... args) {
+    handler(std::forward<Args>(args)...);
+  }
+
+  friend void* asio_handler_allocate(std::size_t size, CustomAllocHandler<Handler>* this_handler) {
+    return this_handler->memory.allocate(size);
+  }
+
+  friend void asio_handler_deallocate(void* pointer, std::size_t /* size */,
+      CustomAllocHandler<Handler>* this_handler) {
+    this_handler->memory.deallocate(pointer);
+  }
+
+private:
+  HandlerMemory& memory;
+  Handler handler;
+};
+
+/* Tworzy handler 'handler' alokowany w 'memory'. */
+template <typename Handler>
+inline CustomAllocHandler<Handler> make_custom_alloc_handler(HandlerMemory& memory, Handler handler) {
+  return CustomAllocHandler<Handler>(memory, handler);
+}
+
+#endif  // HANDLER_ALLOCATOR_H
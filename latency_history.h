@@ -0,0 +1,252 @@
+#ifndef LATENCY_HISTORY_H
+#define LATENCY_HISTORY_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include "common.h"
+#include "probe_policy.h"
+
+const int ROLLUP_SECONDS = 60;             // historia opóźnień: okresy 1 s (ostatnia minuta),
+const int ROLLUP_MINUTES = 60;             //   okresy 1 min (ostatnia godzina)
+const int ROLLUP_HOURS = 24;               //   i okresy 1 h (ostatnia doba) - ok. 34 KB na serwer
+const int ROLLUP_SKETCH_BINS = 28;         // przedziały szkicu kwantyli
+const float ROLLUP_SKETCH_MIN_USEC = 8;    //   od 8 us,
+const int ROLLUP_SKETCH_BINS_PER_OCTAVE = 2;  //   dwa na każde podwojenie opóźnienia
+
+/* Szkic kwantyli: histogram opóźnień w skali logarytmicznej. Przedział 0 to
+ * opóźnienia krótsze niż ROLLUP_SKETCH_MIN_USEC, kolejne mają szerokość
+ * 2^(1/ROLLUP_SKETCH_BINS_PER_OCTAVE), a ostatni zbiera wszystkie dłuższe.
+ * Kwantyl wyznaczany jest z dokładnością do szerokości przedziału. */
+template <typename Count>
+struct QuantileSketch {
+  Count bins[ROLLUP_SKETCH_BINS];
+
+  void clear() { std::fill(bins, bins + ROLLUP_SKETCH_BINS, 0); }
+
+  void add(float usec) {
+    Count& bin = bins[bin_of(usec)];
+    if (bin < std::numeric_limits<Count>::max())
+      bin++;
+  }
+
+  template <typename OtherCount>
+  void merge(QuantileSketch<OtherCount> const& other) {
+    for (int i = 0; i < ROLLUP_SKETCH_BINS; i++) {
+      bins[i] = std::min<uint64_t>(std::numeric_limits<Count>::max(),
+          (uint64_t) bins[i] + other.bins[i]);
+    }
+  }
+
+  /* Kwantyl 'q' (0..1) w us, interpolowany geometrycznie wewnątrz
+   * przedziału (-1, jeśli szkic jest pusty). */
+  float quantile(float q) const {
+    uint64_t total = 0;
+    for (int i = 0; i < ROLLUP_SKETCH_BINS; i++)
+      total += bins[i];
+    if (!total)
+      return -1;
+
+    float rank = std::max(1.0f, std::ceil(q * total));
+    uint64_t before = 0;
+    int bin = 0;
+    while (before + bins[bin] < rank)
+      before += bins[bin++];
+    float position = (rank - before - 0.5f) / bins[bin];    // miejsce wewnątrz przedziału
+    if (bin == 0)
+      return position * ROLLUP_SKETCH_MIN_USEC;
+    if (bin == ROLLUP_SKETCH_BINS - 1)
+      return lower_bound(bin);                              // przedział bez górnej granicy
+    return lower_bound(bin) * std::exp2(position / ROLLUP_SKETCH_BINS_PER_OCTAVE);
+  }
+
+  static int bin_of(float usec) {
+    if (usec < ROLLUP_SKETCH_MIN_USEC)
+      return 0;
+    int bin = 1 + (int) (std::log2(usec / ROLLUP_SKETCH_MIN_USEC) * ROLLUP_SKETCH_BINS_PER_OCTAVE);
+    return std::min(bin, ROLLUP_SKETCH_BINS - 1);
+  }
+
+  /* Dolna granica przedziału 'bin' (1..ROLLUP_SKETCH_BINS-1) w us. */
+  static float lower_bound(int bin) {
+    return ROLLUP_SKETCH_MIN_USEC * std::exp2((float) (bin - 1) / ROLLUP_SKETCH_BINS_PER_OCTAVE);
+  }
+};
+
+/* Podsumowanie pomiarów jednego okresu. */
+struct RollupBucket {
+  uint32_t period;            // numer okresu (czas w s / długość okresu), EMPTY - wolne miejsce
+  uint16_t count;             // ukończone pomiary
+  uint16_t lost;              // zgubione pomiary
+  float min_usec;
+  float max_usec;
+  float sum_usec;
+  QuantileSketch<uint16_t> sketch;
+
+  static const uint32_t EMPTY = std::numeric_limits<uint32_t>::max();
+
+  void reset(uint32_t new_period) {
+    period = new_period;
+    count = lost = 0;
+    min_usec = max_usec = sum_usec = 0;
+    sketch.clear();
+  }
+
+  void add(float usec) {
+    min_usec = count ? std::min(min_usec, usec) : usec;
+    max_usec = count ? std::max(max_usec, usec) : usec;
+    if (count < std::numeric_limits<uint16_t>::max()) {
+      count++;
+      sum_usec += usec;
+    }
+    sketch.add(usec);
+  }
+
+  void add_loss() {
+    if (lost < std::numeric_limits<uint16_t>::max())
+      lost++;
+  }
+};
+
+/* Wynik zapytania o historię: pomiary z okresów przecinających zadany
+ * przedział czasu. Bez ukończonych pomiarów opóźnienia są ujemne. */
+struct RollupSummary {
+  uint32_t count;
+  uint32_t lost;
+  float min_usec;
+  float max_usec;
+  float mean_usec;
+  int resolution_sec;         // długość okresów, z których pochodzi wynik
+  QuantileSketch<uint32_t> sketch;
+
+  /* Kwantyl 'q' (0..1) opóźnienia w us. */
+  float quantile_usec(float q) const {
+    if (!count)
+      return -1;
+    return std::max(min_usec, std::min(max_usec, sketch.quantile(q)));
+  }
+
+  /* Pusty wynik w rozdzielczości 'resolution' s. */
+  void clear(int resolution) {
+    count = lost = 0;
+    min_usec = max_usec = mean_usec = -1;
+    resolution_sec = resolution;
+    sketch.clear();
+  }
+
+  void merge(RollupBucket const& bucket, bool quantiles) {
+    if (bucket.count) {
+      min_usec = count ? std::min(min_usec, bucket.min_usec) : bucket.min_usec;
+      max_usec = count ? std::max(max_usec, bucket.max_usec) : bucket.max_usec;
+      mean_usec = (mean_usec * count + bucket.sum_usec) / (count + bucket.count);
+      count += bucket.count;
+    }
+    lost += bucket.lost;
+    if (quantiles)
+      sketch.merge(bucket.sketch);
+  }
+};
+
+/* Historia opóźnień jednego serwera: dla każdego typu pomiaru podsumowania
+ * (liczba, min, max, średnia, szkic kwantyli, zgubione) w rozdzielczości
+ * 1 s, 1 min i 1 h. Każda rozdzielczość to bufor cykliczny ostatnich
+ * ROLLUP_SECONDS / ROLLUP_MINUTES / ROLLUP_HOURS pełnych okresów i bieżącego,
+ * więc pamięć serwera jest stała (sizeof(LatencyHistory)), a pomiar
+ * aktualizuje po jednym podsumowaniu każdej rozdzielczości. Czas to zegar
+ * pomiarów.
+ *
+ * Historia kosztuje ok. 34 KB na serwer (kilkadziesiąt razy więcej niż reszta
+ * serwera), więc jest włączana opcją -H; bez niej serwery jej nie tworzą. */
+class LatencyHistory {
+public:
+  static const int LEVELS = 3;
+
+  /* Czy serwery mają historię - ustawiane przed utworzeniem serwerów. */
+  static bool& enabled() {
+    static bool value = LATENCY_HISTORY_DEFAULT;
+    return value;
+  }
+
+  LatencyHistory() {
+    for (int proto = 0; proto < PROTOCOL_COUNT; proto++) {
+      for (int i = 0; i < ROLLUP_BUCKETS; i++)
+        buckets[proto][i].period = RollupBucket::EMPTY;
+    }
+  }
+
+  /* Dodaje pomiar 'delay' (ns) typu 'protocol' ukończony w chwili 'now'. */
+  void add_sample(int protocol, time_type now, time_type delay) {
+    float usec = (float) delay / USEC_TO_NSEC;
+    for (int level = 0; level < LEVELS; level++)
+      bucket(protocol, level, now).add(usec);
+  }
+
+  /* Dodaje zgubiony pomiar typu 'protocol' stwierdzony w chwili 'now'. */
+  void add_loss(int protocol, time_type now) {
+    for (int level = 0; level < LEVELS; level++)
+      bucket(protocol, level, now).add_loss();
+  }
+
+  /* Podsumowuje pomiary typu 'protocol' z przedziału [from, to] w najlepszej
+   * rozdzielczości, której bufor sięga jeszcze chwili 'from' (względem 'now');
+   * starsze okresy, niż pamięta najgrubsza rozdzielczość, są pomijane.
+   * Bez 'quantiles' szkic wyniku zostaje pusty (tańsze zapytanie o średnią). */
+  RollupSummary query(int protocol, time_type from, time_type to, time_type now,
+      bool quantiles = true) const {
+    uint64_t from_sec = from / SEC_TO_NSEC;
+    uint64_t to_sec = std::min(to, now) / SEC_TO_NSEC;
+    uint64_t now_sec = now / SEC_TO_NSEC;
+    int level = 0;
+    while (level < LEVELS - 1 && from_sec / resolution(level) + size(level) <= now_sec / resolution(level))
+      level++;
+
+    RollupSummary summary;
+    summary.clear(resolution(level));
+
+    uint64_t now_period = now_sec / resolution(level);
+    uint64_t oldest = now_period + 1 >= size(level) ? now_period + 1 - size(level) : 0;
+    uint64_t first = std::max(from_sec / resolution(level), oldest);
+    uint64_t last = to_sec / resolution(level);
+    for (uint64_t period = first; period <= last && from_sec <= to_sec; period++) {
+      RollupBucket const& slot = buckets[protocol][offset(level) + period % size(level)];
+      if (slot.period == (uint32_t) period)
+        summary.merge(slot, quantiles);
+    }
+    return summary;
+  }
+
+private:
+  static int resolution(int level) {
+    static const int table[LEVELS] = {1, 60, 3600};
+    return table[level];
+  }
+
+  /* Liczba miejsc bufora: pełne okresy i bieżący. */
+  static int size(int level) {
+    static const int table[LEVELS] = {ROLLUP_SECONDS + 1, ROLLUP_MINUTES + 1, ROLLUP_HOURS + 1};
+    return table[level];
+  }
+
+  static int offset(int level) {
+    static const int table[LEVELS] = {0, size(0), size(0) + size(1)};
+    return table[level];
+  }
+
+  /* Podsumowanie okresu rozdzielczości 'level' zawierającego chwilę 'now'
+   * (miejsce po najstarszym okresie jest czyszczone). */
+  RollupBucket& bucket(int protocol, int level, time_type now) {
+    uint32_t period = now / SEC_TO_NSEC / resolution(level);
+    RollupBucket& slot = buckets[protocol][offset(level) + period % size(level)];
+    if (slot.period != period)
+      slot.reset(period);
+    return slot;
+  }
+
+
+  static const int ROLLUP_BUCKETS = ROLLUP_SECONDS + ROLLUP_MINUTES + ROLLUP_HOURS + LEVELS;
+
+  RollupBucket buckets[PROTOCOL_COUNT][ROLLUP_BUCKETS];
+};
+
+#endif  // LATENCY_HISTORY_H
@@ -0,0 +1,569 @@
+#ifndef MATRIX_EXCHANGE_H
+#define MATRIX_EXCHANGE_H
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
+#include <boost/array.hpp>
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include "common.h"
+#include "clock_timer.h"
+#include "get_time_usec.h"
+#include "server.h"
+#include "mdns_message.h"
+
+using boost::asio::ip::udp;
+using boost::asio::ip::address;
+using boost::asio::ip::address_v4;
+
+const int MATRIX_EXCHANGE_INTERVAL = 1;    // co ile sekund runda wymiany macierzy
+const int MATRIX_PACKET_SIZE = 1200;       // maks. rozmiar pakietu wymiany (poniżej MTU)
+const int MATRIX_MAX_REPLIES = 4;          // maks. odpowiedzi DELTA na rundę
+const std::size_t MATRIX_INITIAL_STRIDE = 64;  // początkowa liczba kolumn macierzy
+const std::size_t MATRIX_MAX_NODES = 2048;     // maks. liczba węzłów macierzy (32 MB komórek)
+const uint32_t MATRIX_MIN_CHANGE_USEC = 100;   // istotna zmiana opóźnienia w macierzy:
+const int MATRIX_CHANGE_PERCENT = 10;          //   o więcej niż tyle us i tyle procent
+const int MATRIX_EXPORT_INTERVAL = 10;     // co ile sekund zapisywać macierz (opcja -M)
+const int MATRIX_REPORT_INTERVAL = 60;     // co ile sekund wypisywać statystyki wymiany
+
+/* Komórka macierzy opóźnień. */
+struct MatrixCell {
+  uint32_t delay_usec;        // MATRIX_NO_DELAY - brak pomiaru
+  uint32_t version;           // wersja wiersza, w której komórka się zmieniła (0 - nigdy)
+};
+
+/* Podsumowanie wiersza macierzy (dla UI). */
+struct MatrixRowStats {
+  uint32_t origin;            // węzeł mierzący
+  uint32_t measured;          // liczba znanych opóźnień w wierszu
+  float mean_delay_sec;
+  float max_delay_sec;
+};
+
+const uint32_t MATRIX_NO_DELAY = 0xFFFFFFFF;
+
+/* Gęsta macierz opóźnień floty: wiersz - węzeł mierzący, kolumna - węzeł
+ * mierzony. Komórki leżą w jednym wektorze wierszami po 'stride' komórek,
+ * a 'stride' podwaja się, gdy brakuje miejsca na nowy węzeł (najwyżej do
+ * MATRIX_MAX_NODES węzłów). Węzły mają stałe numery w kolejności dodania. */
+class LatencyMatrix {
+public:
+  LatencyMatrix() : stride(0) {}
+
+  std::size_t size() const { return nodes.size(); }
+
+  uint32_t node(int index) const { return nodes[index]; }
+
+  /* Zwraca numer węzła 'ip' (lub -1, jeśli go nie ma). */
+  int find(uint32_t ip) const {
+    auto it = indices.find(ip);
+    return it == indices.end() ? -1 : it->second;
+  }
+
+  /* Zwraca numer węzła 'ip', dodając go, jeśli go nie ma (-1, jeśli
+   * macierz jest pełna). */
+  int add(uint32_t ip) {
+    int index = find(ip);
+    if (index >= 0)
+      return index;
+    if (nodes.size() >= MATRIX_MAX_NODES)
+      return -1;
+    if (nodes.size() == stride)
+      grow();
+    index = nodes.size();
+    nodes.push_back(ip);
+    indices[ip] = index;
+    row_versions.push_back(0);
+    return index;
+  }
+
+  MatrixCell const& cell(int row, int column) const {
+    return cells[row * stride + column];
+  }
+
+  /* Najnowsza wersja komórek wiersza znana lokalnie. */
+  uint32_t row_version(int row) const { return row_versions[row]; }
+
+  /* Ustawia komórkę, jeśli 'version' jest nowsza od zapisanej. */
+  bool update(int row, int column, uint32_t delay_usec, uint32_t version) {
+    MatrixCell& target = cells[row * stride + column];
+    if (version <= target.version)
+      return false;
+    target.delay_usec = delay_usec;
+    target.version = version;
+    row_versions[row] = std::max(row_versions[row], version);
+    return true;
+  }
+
+  MatrixRowStats row_stats(int row) const {
+    MatrixRowStats stats = {nodes[row], 0, 0, 0};
+    MatrixCell const* row_cells = &cells[row * stride];
+    for (int column = 0; column < nodes.size(); column++) {
+      if (row_cells[column].delay_usec == MATRIX_NO_DELAY)
+        continue;
+      float delay = (float) row_cells[column].delay_usec / SEC_TO_USEC;
+      stats.measured++;
+      stats.mean_delay_sec += delay;
+      stats.max_delay_sec = std::max(stats.max_delay_sec, delay);
+    }
+    if (stats.measured)
+      stats.mean_delay_sec /= stats.measured;
+    return stats;
+  }
+
+private:
+  void grow() {
+    std::size_t new_stride = stride ? std::min(stride * 2, MATRIX_MAX_NODES) : MATRIX_INITIAL_STRIDE;
+    std::vector<MatrixCell> new_cells(new_stride * new_stride, MatrixCell{MATRIX_NO_DELAY, 0});
+    for (int row = 0; row < nodes.size(); row++) {
+      std::copy(cells.begin() + row * stride, cells.begin() + row * stride + nodes.size(),
+          new_cells.begin() + row * new_stride);
+    }
+    cells.swap(new_cells);
+    stride = new_stride;
+  }
+
+
+  std::vector<uint32_t> nodes;              // adresy węzłów według numerów
+  std::unordered_map<uint32_t, int> indices;
+  std::vector<MatrixCell> cells;            // wiersze po 'stride' komórek
+  std::vector<uint32_t> row_versions;
+  std::size_t stride;
+};
+
+/* Parametry wymiany macierzy (opcje -X, -M). */
+struct MatrixExchangeConfig {
+  bool enabled;
+  int port;
+  std::string export_path;      // pusta - bez eksportu
+};
+
+/* Zapisuje 'val' w kodowaniu LEB128 (7 bitów na bajt, najmłodsze najpierw). */
+inline std::ostream& write_varint(std::ostream& os, uint32_t val) {
+  while (val >= 0x80) {
+    os.put(static_cast<char>((val & 0x7F) | 0x80));
+    val >>= 7;
+  }
+  return os.put(static_cast<char>(val));
+}
+
+inline std::istream& read_varint(std::istream& is, uint32_t& val) {
+  val = 0;
+  for (int shift = 0; shift < 35; shift += 7) {
+    int c = is.get();
+    if (c == EOF)
+      break;
+    val |= static_cast<uint32_t>(c & 0x7F) << shift;
+    if (!(c & 0x80))
+      return is;
+  }
+  is.setstate(std::ios::failbit);
+  return is;
+}
+
+/* Wymiana macierzy opóźnień między węzłami floty (opcja -X).
+ *
+ * Każdy węzeł mierzy tylko swój wiersz. Raz na MATRIX_EXCHANGE_INTERVAL
+ * sekund odświeża go z mapy serwerów (komórka dostaje nową wersję tylko
+ * przy istotnej zmianie) i wymienia się z kolejnym węzłem opoznienia
+ * (po kolei z mapy serwerów) w stylu scuttlebutt:
+ *  - DIGEST: wersje wierszy znane pytającemu dla węzłów z okna adresów
+ *    [lo, hi], które przesuwa się w kolejnych rundach po całej flocie,
+ *  - DELTA: odpowiedź z komórkami okna nowszymi niż wersje z DIGEST
+ *    (także wierszy, których pytający nie zna). Komórki wiersza kodowane
+ *    są jako różnice kolejnych adresów, opóźnienie i różnica wersji (varint).
+ *
+ * Oba pakiety mieszczą się w MATRIX_PACKET_SIZE bajtach, a węzeł wysyła
+ * na rundę jeden DIGEST i najwyżej MATRIX_MAX_REPLIES odpowiedzi, więc ruch
+ * węzła nie zależy od wielkości floty; rośnie tylko czas pełnego obiegu.
+ * Z DELTA przyjmowane są tylko wiersze i komórki węzłów znanych z macierzy
+ * albo z mapy serwerów, więc obcy węzeł nie rozdmucha macierzy. Pakiety
+ * wysyłane są bez czekania (gniazdo nieblokujące) - gdy bufor gniazda jest
+ * pełny, pakiet przepada, a wymiana nadrobi go w kolejnych rundach. */
+class MatrixExchange {
+public:
+  MatrixExchange(boost::asio::io_service& io_service, servers_ptr servers,
+      int port, std::string const& export_path) :
+          timer(io_service),
+          socket(io_service, udp::endpoint(udp::v4(), port)),
+          route_socket(io_service, udp::v4()),
+          servers(servers),
+          port(port),
+          export_path(export_path),
+          own_ip(0),
+          own_index(-1),
+          last_peer(0),
+          digest_cursor(0),
+          last_encoded_version(0),
+          replies(0),
+          rounds(0),
+          sent_bytes(0) {
+    socket.non_blocking(true);    // wysyłanie nie wstrzymuje wątku pomiarów
+    start_receive();
+    exchange();
+  }
+
+  LatencyMatrix const& get_matrix() const { return matrix; }
+
+private:
+  enum MESSAGE : uint8_t { DIGEST = 1, DELTA = 2 };
+
+  /* Runda wymiany. */
+  void exchange() {
+    refresh_own_row();
+    replies = 0;
+
+    auto peer = next_peer();
+    if (peer != servers->end())
+      send_digest(peer->first.to_v4().to_ulong());
+
+    rounds++;
+    if (!export_path.empty() && rounds % (MATRIX_EXPORT_INTERVAL / MATRIX_EXCHANGE_INTERVAL) == 0)
+      export_matrix();
+    if (rounds % (MATRIX_REPORT_INTERVAL / MATRIX_EXCHANGE_INTERVAL) == 0) {
+      std::cout << "Matrix exchange: " << matrix.size() << " nodes, "
+          << sent_bytes / MATRIX_REPORT_INTERVAL << " B/s sent" << std::endl;
+      sent_bytes = 0;
+    }
+
+    timer.expires_from_now(boost::posix_time::seconds(MATRIX_EXCHANGE_INTERVAL));
+    timer.async_wait(boost::bind(&MatrixExchange::exchange, this));
+  }
+
+  /* Przepisuje aktualne opóźnienia z mapy serwerów do własnego wiersza. */
+  void refresh_own_row() {
+    uint32_t ip = get_own_address();
+    if (ip == 0)
+      return;             // brak trasy - nie wiemy, jakim węzłem jesteśmy
+    own_ip = ip;
+    own_index = matrix.add(own_ip);
+    if (own_index < 0)
+      return;             // macierz pełna
+
+    uint32_t version = std::max(matrix.row_version(own_index) + 1,
+        static_cast<uint32_t>(get_time_usec() / SEC_TO_USEC));
+    for (auto it = servers->begin(); it != servers->end(); ++it)
+      matrix.add(it->first.to_v4().to_ulong());
+
+    for (int column = 0; column < matrix.size(); column++) {
+      auto it = servers->find(address(address_v4(matrix.node(column))));
+      uint32_t delay = it == servers->end() ? MATRIX_NO_DELAY : mean_delay_usec(it->second.host_stats());
+      uint32_t old_delay = matrix.cell(own_index, column).delay_usec;
+      if (significant_change(old_delay, delay))
+        matrix.update(own_index, column, delay, version);
+    }
+  }
+
+  /* Średnie opóźnienie protokołów z pomiarami (lub MATRIX_NO_DELAY). */
+  static uint32_t mean_delay_usec(HostStats const& stats) {
+    float sum = 0;
+    int count = 0;
+    for (int proto = 0; proto < PROTOCOL_COUNT; proto++) {
+      if (stats.delay_sec[proto] >= 0) {
+        sum += stats.delay_sec[proto];
+        count++;
+      }
+    }
+    return count ? static_cast<uint32_t>(sum / count * SEC_TO_USEC) : MATRIX_NO_DELAY;
+  }
+
+  static bool significant_change(uint32_t old_delay, uint32_t new_delay) {
+    if (old_delay == MATRIX_NO_DELAY || new_delay == MATRIX_NO_DELAY)
+      return old_delay != new_delay;
+    uint32_t difference = old_delay > new_delay ? old_delay - new_delay : new_delay - old_delay;
+    return difference > MATRIX_MIN_CHANGE_USEC
+        && difference * 100ULL > (uint64_t) old_delay * MATRIX_CHANGE_PERCENT;
+  }
+
+  /* Zwraca adres, z którego wysyłamy pakiety do sieci lokalnej (jak
+   * MdnsServer w rekordzie A), a więc ten, pod którym znają nas inne węzły. */
+  uint32_t get_own_address() {
+    boost::system::error_code error;
+    route_socket.connect(udp::endpoint(address::from_string(MDNS_ADDRESS), MDNS_PORT), error);
+    udp::endpoint local_endpoint = route_socket.local_endpoint(error);
+    return error ? own_ip : local_endpoint.address().to_v4().to_ulong();
+  }
+
+  /* Kolejny (po 'last_peer') serwer mierzony przez UDP, czyli węzeł opoznienia. */
+  servers_map::iterator next_peer() {
+    auto start = servers->upper_bound(address(address_v4(last_peer)));
+    for (int pass = 0; pass < 2; pass++) {
+      for (auto it = pass ? servers->begin() : start; it != servers->end(); ++it) {
+        uint32_t ip = it->first.to_v4().to_ulong();
+        if (it->second.measures(PROTOCOL::UDP) && ip != own_ip) {
+          last_peer = ip;
+          return it;
+        }
+      }
+    }
+    return servers->end();
+  }
+
+  /* DIGEST: magic | typ | lo | hi | liczba | (węzeł, wersja wiersza)... */
+  void send_digest(uint32_t peer) {
+    std::vector<uint32_t> origins(sorted_nodes(digest_cursor, 0xFFFFFFFF));
+    std::size_t max_count = (MATRIX_PACKET_SIZE - 15) / 8;
+    uint32_t hi = 0xFFFFFFFF;
+    if (origins.size() > max_count) {
+      origins.resize(max_count);
+      hi = origins.back();
+    }
+
+    std::ostringstream packet;
+    write_be(packet, MATRIX_MAGIC);
+    write_be(packet, static_cast<uint8_t>(DIGEST));
+    write_be(packet, digest_cursor);
+    write_be(packet, hi);
+    write_be(packet, static_cast<uint16_t>(origins.size()));
+    for (auto it = origins.begin(); it != origins.end(); ++it) {
+      write_be(packet, *it);
+      write_be(packet, matrix.row_version(matrix.find(*it)));
+    }
+    digest_cursor = hi == 0xFFFFFFFF ? 0 : hi + 1;    // okno następnej rundy
+    send(packet.str(), udp::endpoint(address_v4(peer), port));
+  }
+
+  /* DELTA: magic | typ | adres wznowienia | liczba wierszy | wiersze...
+   * wiersz: węzeł | wersja | liczba komórek (varint) | komórki...
+   * komórka: różnica adresu | opóźnienie + 1 (0 - brak) | wersja wiersza - wersja komórki
+   * Adres wznowienia (0 - okno kompletne) to pierwszy węzeł, który się nie zmieścił. */
+  void send_delta(uint32_t lo, uint32_t hi,
+      std::unordered_map<uint32_t, uint32_t> const& known, udp::endpoint const& endpoint) {
+    std::ostringstream rows;
+    uint16_t rows_count = 0;
+    uint32_t resume = 0;
+    std::size_t space = MATRIX_PACKET_SIZE - 11;    // bez nagłówka
+    std::vector<uint32_t> origins(sorted_nodes(lo, hi));
+
+    for (auto it = origins.begin(); it != origins.end() && resume == 0; ++it) {
+      int row = matrix.find(*it);
+      auto their = known.find(*it);
+      uint32_t their_version = their == known.end() ? 0 : their->second;
+      if (matrix.row_version(row) <= their_version)
+        continue;
+
+      std::string encoded(encode_row(row, their_version, space));
+      if (encoded.empty()) {
+        resume = *it;       // reszta w następnej rundzie pytającego
+      } else {
+        rows << encoded;
+        space -= encoded.size();
+        rows_count++;
+        if (matrix.row_version(row) > last_encoded_version)
+          resume = *it;     // wiersz obcięty
+      }
+    }
+    if (rows_count == 0 && resume == 0)
+      return;             // pytający wie wszystko
+
+    std::ostringstream packet;
+    write_be(packet, MATRIX_MAGIC);
+    write_be(packet, static_cast<uint8_t>(DELTA));
+    write_be(packet, resume);
+    write_be(packet, rows_count);
+    packet << rows.str();
+    send(packet.str(), endpoint);
+  }
+
+  /* Koduje komórki wiersza 'row' nowsze niż 'since' w co najwyżej 'space'
+   * bajtach. Gdy się nie mieszczą, wybierane są te o najstarszych wersjach,
+   * żeby wersja wiersza u odbiorcy (najnowsza odebrana) była spójna.
+   * Zapisuje wysłaną wersję w 'last_encoded_version'. */
+  std::string encode_row(int row, uint32_t since, std::size_t space) {
+    std::vector<int> columns;
+    for (int column = 0; column < matrix.size(); column++) {
+      if (matrix.cell(row, column).version > since)
+        columns.push_back(column);
+    }
+    std::sort(columns.begin(), columns.end(), [this, row](int a, int b) {
+      return matrix.cell(row, a).version < matrix.cell(row, b).version;
+    });
+
+    std::size_t count = columns.size();
+    while (count > 0) {
+      std::vector<int> chosen(columns.begin(), columns.begin() + count);
+      /* nie rozdzielamy komórek o tej samej wersji: */
+      uint32_t version = matrix.cell(row, chosen.back()).version;
+      if (count < columns.size() && matrix.cell(row, columns[count]).version == version) {
+        while (count > 0 && matrix.cell(row, columns[count - 1]).version == version)
+          count--;
+        continue;
+      }
+      std::sort(chosen.begin(), chosen.end(), [this](int a, int b) {
+        return matrix.node(a) < matrix.node(b);
+      });
+
+      std::ostringstream os;
+      write_be(os, matrix.node(row));
+      write_be(os, version);
+      write_varint(os, count);
+      uint32_t previous = 0;
+      for (auto it = chosen.begin(); it != chosen.end(); ++it) {
+        MatrixCell const& cell = matrix.cell(row, *it);
+        write_varint(os, matrix.node(*it) - previous);
+        write_varint(os, cell.delay_usec + 1);      // MATRIX_NO_DELAY -> 0
+        write_varint(os, version - cell.version);
+        previous = matrix.node(*it);
+      }
+      std::string encoded(os.str());
+      if (encoded.size() <= space) {
+        last_encoded_version = version;
+        return encoded;
+      }
+      count = std::min(count - 1, count * space / encoded.size());
+    }
+    return std::string();
+  }
+
+  /* Posortowane adresy znanych węzłów z przedziału [lo, hi]. */
+  std::vector<uint32_t> sorted_nodes(uint32_t lo, uint32_t hi) const {
+    std::vector<uint32_t> result;
+    for (int i = 0; i < matrix.size(); i++) {
+      if (matrix.node(i) >= lo && matrix.node(i) <= hi)
+        result.push_back(matrix.node(i));
+    }
+    std::sort(result.begin(), result.end());
+    return result;
+  }
+
+  void send(std::string const& packet, udp::endpoint const& endpoint) {
+    boost::system::error_code error;
+    socket.send_to(boost::asio::buffer(packet), endpoint, 0, error);
+    if (!error)
+      sent_bytes += packet.size();
+  }
+
+  void start_receive() {
+    socket.async_receive_from(boost::asio::buffer(receive_buffer), remote_endpoint,
+        boost::bind(&MatrixExchange::handle_receive, this,
+          boost::asio::placeholders::error,
+          boost::asio::placeholders::bytes_transferred));
+  }
+
+  void handle_receive(boost::system::error_code const& error, std::size_t bytes_transferred) {
+    /* przyjmujemy pakiety tylko od znanych węzłów: */
+    if (!error && servers->count(remote_endpoint.address())) {
+      std::istringstream is(std::string(receive_buffer.data(), bytes_transferred));
+      uint32_t magic = 0;
+      uint8_t type = 0;
+      read_be(is, magic);
+      read_be(is, type);
+      if (is && magic == MATRIX_MAGIC) {
+        if (type == DIGEST)
+          handle_digest(is);
+        else if (type == DELTA)
+          handle_delta(is);
+      }
+    }
+
+    start_receive();
+  }
+
+  void handle_digest(std::istream& is) {
+    if (replies >= MATRIX_MAX_REPLIES)
+      return;             // limit odpowiedzi w tej rundzie
+    uint32_t lo = 0, hi = 0;
+    uint16_t count = 0;
+    read_be(is, lo);
+    read_be(is, hi);
+    read_be(is, count);
+    std::unordered_map<uint32_t, uint32_t> known;
+    for (int i = 0; i < count && is; i++) {
+      uint32_t origin = 0, version = 0;
+      read_be(is, origin);
+      read_be(is, version);
+      known[origin] = version;
+    }
+    if (!is || lo > hi)
+      return;
+    replies++;
+    send_delta(lo, hi, known, remote_endpoint);
+  }
+
+  void handle_delta(std::istream& is) {
+    uint32_t resume = 0;
+    uint16_t rows_count = 0;
+    read_be(is, resume);
+    read_be(is, rows_count);
+    for (int i = 0; i < rows_count && is; i++) {
+      uint32_t origin = 0, version = 0, count = 0;
+      read_be(is, origin);
+      read_be(is, version);
+      read_varint(is, count);
+      int row = origin == own_ip ? -1 : add_known(origin);   // własny wiersz tylko z pomiarów
+      uint32_t target = 0;
+      for (uint32_t j = 0; j < count && is; j++) {
+        uint32_t gap = 0, delay = 0, age = 0;
+        read_varint(is, gap);
+        read_varint(is, delay);
+        read_varint(is, age);
+        target += gap;
+        if (!is || row < 0 || age > version)
+          continue;
+        int column = add_known(target);
+        if (column >= 0)
+          matrix.update(row, column, delay - 1, version - age);
+      }
+    }
+    if (is && resume != 0)
+      digest_cursor = resume;   // dokończymy niezmieszczone wiersze
+  }
+
+  /* Zwraca numer węzła 'ip' z macierzy, dodając go tylko wtedy, gdy jest
+   * na mapie serwerów (-1 - węzeł nieznany albo macierz pełna). */
+  int add_known(uint32_t ip) {
+    int index = matrix.find(ip);
+    if (index < 0 && servers->count(address(address_v4(ip))))
+      index = matrix.add(ip);
+    return index;
+  }
+
+  /* Zapisuje znane opóźnienia jako CSV "origin,target,delay_usec" (przez plik
+   * tymczasowy, jak ServersSnapshot). */
+  void export_matrix() {
+    std::string tmp_path = export_path + ".tmp";
+    std::ofstream file(tmp_path, std::ios::trunc);
+    file << "origin,target,delay_usec\n";
+    for (int row = 0; row < matrix.size(); row++) {
+      std::string origin(address_v4(matrix.node(row)).to_string());
+      for (int column = 0; column < matrix.size(); column++) {
+        uint32_t delay = matrix.cell(row, column).delay_usec;
+        if (delay != MATRIX_NO_DELAY)
+          file << origin << ',' << address_v4(matrix.node(column)).to_string() << ',' << delay << '\n';
+      }
+    }
+    file.close();
+    if (!file || std::rename(tmp_path.c_str(), export_path.c_str()) != 0)
+      std::cerr << "Cannot write matrix export " << export_path << "\n";
+  }
+
+
+  static const uint32_t MATRIX_MAGIC = 0x4f505a4d;  // "OPZM"
+
+  clock_timer timer;
+  udp::socket socket;           // gniazdo wymiany
+  udp::socket route_socket;     // do ustalania własnego adresu
+  udp::endpoint remote_endpoint;
+  boost::array<char, BUFFER_SIZE * 4> receive_buffer;
+
+  servers_ptr servers;
+  int port;
+  std::string export_path;      // plik CSV z macierzą (opcja -M, pusta - bez eksportu)
+
+  LatencyMatrix matrix;
+  uint32_t own_ip;
+  int own_index;                // numer własnego wiersza (-1 - jeszcze nieznany)
+  uint32_t last_peer;           // ostatni węzeł, do którego wysłano DIGEST
+  uint32_t digest_cursor;       // początek okna następnego DIGEST
+  uint32_t last_encoded_version;
+  int replies;                  // odpowiedzi wysłane w bieżącej rundzie
+  unsigned long rounds;
+  unsigned long sent_bytes;     // od ostatniego raportu
+};
+
+#endif  // MATRIX_EXCHANGE_H
@@ -5,137 +5,154 @@
 #include <boost/asio.hpp>
 #include <boost/bind.hpp>
 #include "common.h"
+#include "clock_timer.h"
 #include "server.h"
 #include "mdns_message.h"
+#include "mdns_transport.h"
 
 using boost::asio::ip::udp;
 using boost::asio::ip::address;
 using boost::asio::ip::address_v4;
 
+const int MDNS_QUESTION_DELAY_MS = 20;  // czas zbierania pytań do jednego pakietu (ms)
+
 class MdnsClient {
 public:
-  MdnsClient(boost::asio::io_service& io_service, servers_ptr servers,
-      std::shared_ptr<udp::socket> udp_socket, std::shared_ptr<icmp::socket> icmp_socket,
-      int mdns_interval) :
+  /* Pakiety odbiera i wysyła 'transport' (działający w wątku 'io_service'). */
+  MdnsClient(boost::asio::io_service& io_service, MdnsTransport& transport, servers_ptr servers,
+      ProbeContext& context, int mdns_interval) :
+          transport(transport),
           timer(io_service, boost::posix_time::seconds(0)),
+          flush_timer(io_service),
           io_service(io_service),
-          udp_socket(udp_socket),
-          icmp_socket(icmp_socket),
-          recv_buffer(),
-          send_buffer(),
-          recv_stream(&recv_buffer),
-          send_stream(&send_buffer),
-          multicast_endpoint(address::from_string(MDNS_ADDRESS), MDNS_PORT),
-          send_socket(io_service, multicast_endpoint.protocol()),
-          recv_socket(io_service),
+          context(context),
           servers(servers),
           known_udp_server_names(),
           known_tcp_server_names(),
           opoznienia_service(OPOZNIENIA_SERVICE),
           ssh_service(SSH_SERVICE),
+          send_stream(&send_buffer),
+          first_query(true),
           mdns_interval(mdns_interval) {
-    try {
-      /* dołączamy do grupy adresu 224.0.0.251, odbieramy na porcie 5353: */
-      recv_socket.open(udp::v4());
-      recv_socket.set_option(udp::socket::reuse_address(true));
-      recv_socket.bind(udp::endpoint(udp::v4(), MDNS_PORT));    // port 5353
-      recv_socket.set_option(boost::asio::ip::multicast::join_group(
-          address::from_string(MDNS_ADDRESS)));     // adres 224.0.0.251
-
-      start_mdns_receiving();
-      start_mdns_ptr_query();
-
-    } catch (boost::system::error_code ec) {
-      std::cerr << "Failed to start mDNS Client!\n";
-    }
+    transport.set_browser([this](MdnsResponse const& response, udp::endpoint const&) {
+      handle_response(response);
+    });
+    start_mdns_ptr_query();
   }
 
 
 private:
   /* Inicjuje zapytanie mdns typu PTR o usługę _opozenienia._udp.local,
-   * które jest wysyłane w zadanych odstępach czasowych. */
+   * które jest wysyłane w zadanych odstępach czasowych. Pierwsze zapytanie
+   * (po uruchomieniu) prosi o odpowiedzi unicastowe. */
   void start_mdns_ptr_query() {
+    uint16_t qclass = first_query ? INTERNET_CLASS | UNICAST_RESPONSE_BIT : INTERNET_CLASS;
+    first_query = false;
+
     /* Zapytanie PTR _opoznienia._udp.local. oraz PTR _ssh._tcp.local */
-    MdnsQuery query;
-    query.add_question(opoznienia_service, QTYPE::PTR);
-    query.add_question(ssh_service, QTYPE::PTR);
-    send_mdns_query(query);
+    queue_question(MdnsQuestion(opoznienia_service, static_cast<uint16_t>(QTYPE::PTR), qclass));
+    queue_question(MdnsQuestion(ssh_service, static_cast<uint16_t>(QTYPE::PTR), qclass));
 
     reset_timer(mdns_interval);   // ustawienie licznika
   }
 
-  /* Inicjuje jednorazowe zapytanie mdns typu A o ip servera o nazwie 'server_name'. */
+  /* Inicjuje jednorazowe zapytanie mdns typu A o ip servera o nazwie 'server_name'.
+   * Odpowiedź interesuje tylko nas, więc prosimy o odpowiedź unicastową. */
   void start_mdns_a_query(MdnsDomainName server_name) {
-    /* Zapytanie A _opoznienia._udp.local. */
-    MdnsQuery query;
-    query.add_question(server_name, QTYPE::A);
-    send_mdns_query(query);
+    queue_question(MdnsQuestion(server_name, static_cast<uint16_t>(QTYPE::A),
+        INTERNET_CLASS | UNICAST_RESPONSE_BIT));
   }
 
-  /* Wysyła zapytanie 'query': */
-  void send_mdns_query(MdnsQuery const& query) {
-    send_buffer.consume(send_buffer.size());  // wyczyść bufor
-    send_stream << query;
-
-    send_socket.async_send_to(send_buffer.data(), multicast_endpoint,
-        boost::bind(&MdnsClient::handle_mdns_send, this));
+  /* Dodaje pytanie do kolejki pytań oczekujących na wysłanie. Pytania są
+   * zbierane przez MDNS_QUESTION_DELAY_MS milisekund, a następnie wysyłane
+   * w możliwie małej liczbie pakietów. Powtórzone pytania są pomijane. */
+  void queue_question(MdnsQuestion const& question) {
+    auto key = std::make_pair(question.get_name(), question.get_qtype());
+    if (!queued_questions.insert(key).second)
+      return;                                 // to pytanie już czeka w kolejce
+
+    pending_questions.push_back(question);
+    if (pending_questions.size() == 1) {      // pierwsze pytanie - uruchamiamy licznik
+      flush_timer.expires_from_now(boost::posix_time::milliseconds(MDNS_QUESTION_DELAY_MS));
+      flush_timer.async_wait(boost::bind(&MdnsClient::flush_questions, this));
+    }
   }
 
-  void handle_mdns_send() {}
+  /* Wysyła wszystkie oczekujące pytania, pakując do każdego pakietu tyle
+   * pytań, ile zmieści się w MDNS_MAX_PACKET_SIZE bajtach. */
+  void flush_questions() {
+    MdnsQuery query;
+    for (int i = 0; i < pending_questions.size(); i++) {
+      if (!query.get_questions().empty()
+          && query.size() + pending_questions[i].size() > MDNS_MAX_PACKET_SIZE) {
+        send_mdns_query(query);               // pakiet pełny - wysyłamy
+        query = MdnsQuery();
+      }
+      query.add_question(pending_questions[i]);
+    }
+    if (!query.get_questions().empty())
+      send_mdns_query(query);
 
+    pending_questions.clear();
+    queued_questions.clear();
+  }
 
-  /* Zlecenie odbioru pakietów multicastowych. */
-  void start_mdns_receiving() {
-    recv_buffer.consume(recv_buffer.size());  // wyczyść bufor
+  /* Wysyła zapytanie 'query'. Transport wysyła bez blokowania, więc bufor
+   * jest wspólny dla wszystkich pakietów. */
+  void send_mdns_query(MdnsQuery const& query) {
+    send_buffer.consume(send_buffer.size());    // wyczyść bufor
+    send_stream << query;
 
-    recv_socket.async_receive_from(
-        recv_buffer.prepare(BUFFER_SIZE), remote_endpoint,
-        boost::bind(&MdnsClient::handle_mdns_receive, this,
-          boost::asio::placeholders::error,
-          boost::asio::placeholders::bytes_transferred));
+    transport.send(send_buffer.data(), transport.get_multicast_endpoint());
   }
 
-  /* Próbujemy przeczytać pakiet mDNS typu 'Response'. Zapytanie typu 'Query'
-   * jest ignorowane, zaś niepoprawne zapytanie typu 'Response' powoduje
-   * rzucenie (i złapanie) wyjątku.
+  /* Obsługuje pakiet mDNS typu 'Response' wczytany przez transport.
    *
    * Jeśli pakiet jest odpowiedzią typu:
    * PTR - dopisuje nazwę nowego serwera do zbioru znanych nazw
    * A - odświeża TTL serwera lub tworzy instancję klasy Server reprezentującą
    *     go, jeśli jeszcze nie istnieje (lub dodaje nowy rodzaj protokołu).
+   * Rekordy z sekcji Additional obsługiwane są po odpowiedziach, dzięki czemu
+   * rekord A dołączony do odpowiedzi PTR od razu aktywuje pomiary serwera.
    */
-  void handle_mdns_receive(boost::system::error_code const& error,
-      std::size_t bytes_transferred) {
-    if (!error) {
-      MdnsResponse response;
-      recv_buffer.commit(bytes_transferred);   // przygotowanie bufora
-
-      try {
-        if (response.try_read(recv_stream)) {       // ignorujemy pakiety mDNS typu 'Query'
-          const std::vector<MdnsAnswer>& answers(response.get_answers());
-          for (int i = 0; i < answers.size(); i++)
-            handle_answer(answers[i]);
-        }
-      } catch (InvalidMdnsMessageException e) {}    // ignorujemy niepoprawne pakiety
-    }
-
-    start_mdns_receiving();
+  void handle_response(MdnsResponse const& response) {
+    const std::vector<MdnsAnswer>& answers(response.get_answers());
+    const std::vector<MdnsAnswer>& additionals(response.get_additionals());
+    for (int i = 0; i < answers.size(); i++)
+      handle_answer(answers[i], additionals);
+    for (int i = 0; i < additionals.size(); i++)
+      handle_answer(additionals[i], std::vector<MdnsAnswer>());
   }
 
 
-  /* Obsługuje jedną odpowiedź otrzymaną w pakiecie mDNS aktualizując bazę serwerów. */
-  void handle_answer(MdnsAnswer const& answer) {
+  /* Sprawdza, czy wśród rekordów 'additionals' jest rekord A nazwy 'name'. */
+  bool has_address_record(MdnsDomainName const& name, std::vector<MdnsAnswer> const& additionals) {
+    for (int i = 0; i < additionals.size(); i++) {
+      if (additionals[i].get_type() == static_cast<uint16_t>(QTYPE::A)
+          && additionals[i].get_name() == name)
+        return true;
+    }
+    return false;
+  }
+
+  /* Obsługuje jedną odpowiedź otrzymaną w pakiecie mDNS aktualizując bazę serwerów.
+   * Dla odpowiedzi PTR zapytanie typu A wysyłane jest tylko wtedy, gdy adresu
+   * serwera nie ma w sekcji Additional ('additionals') tego samego pakietu. */
+  void handle_answer(MdnsAnswer const& answer, std::vector<MdnsAnswer> const& additionals) {
     uint16_t type = answer.get_type();
     MdnsDomainName name(answer.get_name());
     if (type == static_cast<uint16_t>(QTYPE::PTR)) {  // w odpowiedzi jest nazwa serwera
-    
+      MdnsDomainName server_name(answer.get_server_name());
+
       if (name == opoznienia_service) {     // serwer udostępnia _opoznienia._udp.local
-        auto iter = known_udp_server_names.insert(answer.get_server_name());
-        start_mdns_a_query(*iter.first);    // odpowiadamy zapytaniem typu A o adres serwera
+        known_udp_server_names.insert(server_name);
       } else if (name == ssh_service) {     // serwer udostępnia _ssh.local
-        auto iter = known_tcp_server_names.insert(answer.get_server_name());
-        start_mdns_a_query(*iter.first);    // odpowiadamy zapytaniem typu A o adres serwera
-      } // else nieznana usługa 
+        known_tcp_server_names.insert(server_name);
+      } else {
+        return;                             // nieznana usługa
+      }
+      if (!has_address_record(server_name, additionals))
+        start_mdns_a_query(server_name);    // odpowiadamy zapytaniem typu A o adres serwera
 
     } else if (type == static_cast<uint16_t>(QTYPE::A)) {
       /* sprawdzamy czy serwer udostępnia znane nam usługi: */
@@ -143,12 +160,12 @@ private:
       bool is_tcp_server = known_tcp_server_names.find(name) != known_tcp_server_names.end();
 
       if (is_udp_server || is_tcp_server) {
-        std::shared_ptr<address> server_address(new address(address_v4(answer.get_server_address())));
+        address_v4 server_address(answer.get_server_address());
         /* jeśli jeszcze nie ma go w mapie, dodajemy go: */
-        auto iter = servers->find(*server_address);
+        auto iter = servers->find(address(server_address));
         if (iter == servers->end()) {
-          auto tmp_it = servers->emplace(*server_address,
-              Server(server_address, io_service, udp_socket, icmp_socket));
+          auto tmp_it = servers->emplace(address(server_address),
+              Server(server_address, context));
           iter = tmp_it.first;
         }
 
@@ -168,21 +185,12 @@ private:
   }
 
 
-  boost::asio::deadline_timer timer;
+  MdnsTransport& transport;   // wspólne gniazda mDNS
+  clock_timer timer;
+  clock_timer flush_timer;  // licznik wysyłania zebranych pytań
   boost::asio::io_service& io_service;
 
-  std::shared_ptr<udp::socket>  udp_socket;  // gniazdo używane do wszstkich pakietów UDP
-  std::shared_ptr<icmp::socket> icmp_socket; // gniazdo używane do wszstkich pakietów ICMP
-
-  boost::asio::streambuf recv_buffer; // bufor do odbierania
-  boost::asio::streambuf send_buffer; // bufor do wysyłania
-  std::istream recv_stream;           // strumień do odbierania
-  std::ostream send_stream;           // strumień do wysyłania
-
-  udp::endpoint multicast_endpoint;   // odbieranie na porcie 5353 z adresu 224.0.0.251
-  udp::endpoint remote_endpoint;      // endpoint nadawcy odbieranego pakietu
-  udp::socket send_socket;            // wysyłanie pakietów na multicast
-  udp::socket recv_socket;            // odbieranie z multicastowych
+  ProbeContext& context;      // gniazda wspólne dla dodawanych serwerów
 
   servers_ptr servers;
   std::set<MdnsDomainName> known_udp_server_names;  // zbiór znanych nazw serwerów udostępniających _opoznienia._udp
@@ -190,6 +198,12 @@ private:
   const MdnsDomainName opoznienia_service;
   const MdnsDomainName ssh_service;
 
+  std::vector<MdnsQuestion> pending_questions;  // pytania oczekujące na wysłanie
+  std::set<std::pair<MdnsDomainName, uint16_t> > queued_questions;  // (nazwa, typ) pytań w kolejce
+  boost::asio::streambuf send_buffer;   // bufor do wysyłania zapytań
+  std::ostream send_stream;             // strumień do wysyłania zapytań
+
+  bool first_query;                   // czy następne zapytanie PTR jest pierwszym
   int mdns_interval;
 };
 
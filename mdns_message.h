@@ -12,8 +12,11 @@ enum class QTYPE : uint16_t {
 };
 
 const uint16_t INTERNET_CLASS = 0x0001;
+const uint16_t UNICAST_RESPONSE_BIT = 0x8000;   // bit QU w klasie pytania (RFC 6762 §5.4)
 const int MAX_DOMAINS_DEPTH = 10;    // maksymalna dpouszczalna głębokość drzewa domenowego
 const int MAX_DOMAIN_LENGTH = 255;   // maksymalna długość nazwy domeny w bajtach
+const int MDNS_SHARED_DELAY_MIN_MS = 20;    // opóźnienie odpowiedzi dla rekordów
+const int MDNS_SHARED_DELAY_MAX_MS = 120;   //   współdzielonych (RFC 6762 §6)
 
 /* Wypisuje 'val' na strumień 'os' w formacie big endian. */
 template <typename uintX_t>
@@ -82,6 +85,11 @@ public:
   void auth_count(uint16_t val)  { data[8] = val >> CHAR_BIT; data[9] = val & 0x00FF; }
   void add_count(uint16_t val)   { data[10] = val >> CHAR_BIT; data[11] = val & 0x00FF; }
 
+  /* Długość nagłówka w bajtach. */
+  static std::streamsize size() { return header_length; }
+  /* Surowe bajty nagłówka w formacie sieciowym. */
+  const unsigned char* bytes() const { return data; }
+
   friend std::istream& operator>>(std::istream& is, MdnsHeader& header) {
     return is.read(reinterpret_cast<char*>(header.data), MdnsHeader::header_length);
   }
@@ -109,6 +117,11 @@ public:
   }
   MdnsDomainName(MdnsDomainName const& name) : data(name.data) {}
 
+  /* Zwraca 'index'-tą część nazwy (od lewej) lub pusty napis. */
+  std::string label(int index) const {
+    return index < data.size() ? data[index] : std::string();
+  }
+
   uint16_t size() const {
     uint16_t result = 1;              // ostatni zerowy bajt
     for (int i = 0; i < data.size(); i++) {
@@ -183,6 +196,11 @@ public:
 
   MdnsDomainName get_name() const { return name; }
   uint16_t get_qtype() const { return qtype; }
+  /* Czy pytający prosi o odpowiedź unicastową (bit QU). */
+  bool unicast_response() const { return qclass & UNICAST_RESPONSE_BIT; }
+
+  /* Rozmiar pytania w formacie sieciowym (w bajtach). */
+  uint16_t size() const { return name.size() + sizeof(qtype) + sizeof(qclass); }
 
 
   friend std::istream& operator>>(std::istream& is, MdnsQuestion& question) {
@@ -211,9 +229,24 @@ class MdnsQuery {
 public:
   /* konstruktor tworzy nagłówek mDNS i ustawia jego flagi na 0x0000. */
   MdnsQuery() : header() {}
+  /* konstruktor dla pakietu, którego nagłówek został już wczytany. */
+  explicit MdnsQuery(MdnsHeader const& header) : header(header) {}
 
   const std::vector<MdnsQuestion>& get_questions() const { return questions; }
 
+  /* Rozmiar całego pakietu w formacie sieciowym (w bajtach). */
+  std::size_t size() const {
+    std::size_t result = MdnsHeader::size();
+    for (int i = 0; i < questions.size(); i++)
+      result += questions[i].size();
+    return result;
+  }
+
+  void add_question(MdnsQuestion const& question) {
+    header.q_count(header.q_count() + 1);   // zwiększa licznik pytań w nagłówku
+    questions.push_back(question);
+  }
+
   void add_question(MdnsDomainName const& domain_name, QTYPE type) {
     header.q_count(header.q_count() + 1);   // zwiększa licznik pytań w nagłówku
     questions.push_back(MdnsQuestion(domain_name, static_cast<uint16_t>(type)));
@@ -235,15 +268,7 @@ public:
     return is;
   }
 
-  friend std::ostream& operator<<(std::ostream& os, MdnsQuery const& query) {
-    os << query.header;
-    for (int i = 0; i < query.questions.size(); i++) {
-      os << query.questions[i];
-    }
-    return os;
-  }
-
-private:
+  /* Wczytuje pytania pakietu, którego nagłówek został już wczytany. */
   void read_questions(std::istream& is) {
     if (!header.valid_query_header())
       throw InvalidMdnsMessageException("Invalid mDNS query header");
@@ -254,6 +279,15 @@ private:
     }
   }
 
+  friend std::ostream& operator<<(std::ostream& os, MdnsQuery const& query) {
+    os << query.header;
+    for (int i = 0; i < query.questions.size(); i++) {
+      os << query.questions[i];
+    }
+    return os;
+  }
+
+private:
   MdnsHeader header;
   std::vector<MdnsQuestion> questions;
 };  // class MdnsQuery
@@ -294,7 +328,7 @@ public:
     switch (rr.type) {
       case static_cast<uint16_t>(QTYPE::PTR): is >> rr.server_name; break;
       case static_cast<uint16_t>(QTYPE::A): read_be(is, rr.server_address); break;
-      default: throw InvalidMdnsMessageException("Unrecognized RR type");
+      default: is.ignore(rr.rr_len); break;   // nieznany typ - pomijamy dane rekordu
     }
     return is;
   }
@@ -360,8 +394,17 @@ public:
     header.set_qr();
     header.set_aa();
   }
+  /* konstruktor dla pakietu, którego nagłówek został już wczytany. */
+  explicit MdnsResponse(MdnsHeader const& header) : header(header) {}
 
   const std::vector<MdnsAnswer>& get_answers() const { return answers; }
+  const std::vector<MdnsAnswer>& get_additionals() const { return additionals; }
+
+  /* dodanie rekordu do sekcji Additional. */
+  void add_additional(MdnsAnswer const& additional) {
+    header.add_count(header.add_count() + 1);   // zwiększa licznik rekordów dodatkowych
+    additionals.push_back(additional);
+  }
 
   /* dodanie gotowej odpowiedzi klasy Answer. */
   void add_answer(MdnsAnswer const& answer) {
@@ -404,15 +447,8 @@ public:
     return is;
   }
 
-  friend std::ostream& operator<<(std::ostream& os, MdnsResponse const& response) {
-    os << response.header;
-    for (int i = 0; i < response.answers.size(); i++) {
-      os << response.answers[i];
-    }
-    return os;
-  }
-
-private:
+  /* Wczytuje odpowiedzi (oraz rekordy sekcji Additional) pakietu,
+   * którego nagłówek został już wczytany. Rekordy sekcji Authority są pomijane. */
   void read_answers(std::istream& is) {
     if (!header.valid_response_header())
       throw InvalidMdnsMessageException("Invalid mDNS response header");
@@ -421,10 +457,32 @@ private:
       is >> answer;
       answers.push_back(std::move(answer));
     }
+    for (int i = 0; i < header.auth_count(); i++) {
+      MdnsAnswer authority;
+      is >> authority;
+    }
+    for (int i = 0; i < header.add_count(); i++) {
+      MdnsAnswer additional;
+      is >> additional;
+      additionals.push_back(std::move(additional));
+    }
   }
 
+  friend std::ostream& operator<<(std::ostream& os, MdnsResponse const& response) {
+    os << response.header;
+    for (int i = 0; i < response.answers.size(); i++) {
+      os << response.answers[i];
+    }
+    for (int i = 0; i < response.additionals.size(); i++) {
+      os << response.additionals[i];
+    }
+    return os;
+  }
+
+private:
   MdnsHeader header;
   std::vector<MdnsAnswer> answers;
+  std::vector<MdnsAnswer> additionals;    // rekordy sekcji Additional
 };  // class MdnsResponse
 
 
@@ -1,158 +1,340 @@
 #ifndef MDNS_SERVER_H
 #define MDNS_SERVER_H
 
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <random>
+#include <sstream>
 #include <boost/asio.hpp>
 #include <boost/bind.hpp>
 #include <boost/array.hpp>
 #include "common.h"
+#include "clock_timer.h"
+#include "clock_source.h"
 #include "mdns_message.h"
+#include "mdns_transport.h"
 
 using boost::asio::ip::udp;
 using boost::asio::ip::address;
+using boost::asio::ip::address_v4;
+
+const int MDNS_RECORDS_REFRESH_INTERVAL = 10; // co ile sekund sprawdzać zmianę nazwy/adresu
+const long MDNS_RECORD_MIN_INTERVAL_NSEC = SEC_TO_NSEC; // min. odstęp rozgłaszania rekordu (RFC 6762 §6)
+const long MDNS_UNICAST_WINDOW_NSEC = TTL_DEFAULT * SEC_TO_NSEC / 4; // odpowiedź QU unicastem,
+                                            // jeśli rekord rozgłoszono w ciągu 1/4 TTL
+
+/* Rekord, na który odpowiada serwer, wraz z gotową odpowiedzią
+ * w formacie sieciowym (nazwa + Resource Record). */
+struct PrecomputedRecord {
+  MdnsAnswer answer;      // odpowiedź (do porównań z cudzymi odpowiedziami)
+  std::string wire;       // odpowiedź w formacie sieciowym
+  bool shared;            // czy rekord jest współdzielony (PTR) czy unikalny (A)
+  time_type last_multicast;   // czas ostatniego rozgłoszenia przez nas (ns, zegar pomiarów)
+  time_type last_seen;        // czas ostatniego zobaczenia tej odpowiedzi od innego serwera
+  bool delayed;               // czy rekord czeka na opóźnioną odpowiedź
+  int additional;             // indeks rekordu A dołączanego w sekcji Additional (lub -1)
+
+  /* Sprawdza, czy 'other' jest tą samą odpowiedzią (nazwa, typ i dane). */
+  bool same_answer(MdnsAnswer const& other) const {
+    if (other.get_type() != answer.get_type() || !(other.get_name() == answer.get_name()))
+      return false;
+    if (answer.get_type() == static_cast<uint16_t>(QTYPE::PTR))
+      return other.get_server_name() == answer.get_server_name();
+    else
+      return other.get_server_address() == answer.get_server_address();
+  }
+};
+
+/* Liczniki serwera mDNS (odczytywane także z innych wątków). */
+struct MdnsServerStats {
+  std::atomic<unsigned long> answers_sent;          // wysłane odpowiedzi (rekordy)
+  std::atomic<unsigned long> unicast_answers;       // w tym wysłane unicastem (QU)
+  std::atomic<unsigned long> rate_limited;          // pominięte - rekord rozgłoszony < 1 s temu
+  std::atomic<unsigned long> duplicates_suppressed; // pominięte - inny serwer właśnie odpowiedział
+};
 
 class MdnsServer {
 public:
-  MdnsServer(boost::asio::io_service& io_service, bool broadcast_ssh) :
-      recv_buffer(),
-      send_buffer(),
-      recv_stream(&recv_buffer),
-      send_stream(&send_buffer),
-      multicast_endpoint(address::from_string(MDNS_ADDRESS), MDNS_PORT),
-      send_socket(io_service, multicast_endpoint.protocol()),
-      recv_socket(io_service),
-      local_opoznienia_name(get_local_opoznienia_name()),
-      local_ssh_name(get_local_ssh_name()),
+  /* Pakiety odbiera i wysyła 'transport' (działający w wątku 'io_service').
+   * Z transportem w trybie 'offline' nazwę i adres ustala set_identity
+   * (odtwarzanie nagrań). */
+  MdnsServer(boost::asio::io_service& io_service, MdnsTransport& transport, bool broadcast_ssh) :
+      transport(transport),
+      refresh_timer(io_service),
+      delay_timer(io_service),
+      delay_pending(false),
+      random_generator(std::random_device()()),
+      delay_distribution(MDNS_SHARED_DELAY_MIN_MS, MDNS_SHARED_DELAY_MAX_MS),
+      local_server_address(0),
       opoznienia_service(OPOZNIENIA_SERVICE),
       ssh_service(SSH_SERVICE),
-      broadcast_ssh(broadcast_ssh) {
-    try {
-      /* dołączamy do grupy adresu 224.0.0.251, odbieramy na porcie 5353: */
-      recv_socket.open(udp::v4());
-      recv_socket.set_option(udp::socket::reuse_address(true));
-      recv_socket.bind(udp::endpoint(udp::v4(), MDNS_PORT));    // port 5353
-      recv_socket.set_option(boost::asio::ip::multicast::join_group(
-          address::from_string(MDNS_ADDRESS)));     // adres 224.0.0.251
-
-      /* łączymy się z adresem multicastowym do wysyłania: */
-      send_socket.connect(multicast_endpoint);
-      local_server_address = get_local_server_address();
-
-      start_receive();
-
-    } catch (boost::system::error_code ec) {
-      std::cerr << "Failed to start mDNS Server!\n";
+      broadcast_ssh(broadcast_ssh),
+      offline(transport.is_offline()),
+      stats() {
+    transport.set_responder(
+        [this](MdnsQuery const& query, udp::endpoint const& sender) {
+          send_response_to(query, sender);
+        },
+        [this](MdnsResponse const& response, udp::endpoint const& sender) {
+          if (!is_own_packet(sender))
+            note_foreign_answers(response);
+        });
+    if (!offline)
+      refresh_records();
+  }
+
+  MdnsServerStats const& get_stats() const { return stats; }
+
+  /* Ustawia nazwę hosta i adres IP używane w rekordach (przelicza gotowe
+   * odpowiedzi, jeśli się zmieniły). */
+  void set_identity(std::string const& host_name, uint32_t server_address) {
+    if (host_name != local_host_name || server_address != local_server_address) {
+      local_host_name = host_name;
+      local_server_address = server_address;
+      build_records();
     }
   }
 
 private:
-  /* Zwraca nową nazwę serwera usługi opóźnień w sieci lokalnej. */
+  /* Zwraca nazwę serwera usługi opóźnień w sieci lokalnej. */
   std::string get_local_opoznienia_name() {
-    return boost::asio::ip::host_name() + '.' + OPOZNIENIA_SERVICE;
+    return local_host_name + '.' + OPOZNIENIA_SERVICE;
   }
-  /* Zwraca nową nazwę serwera usługi ssh w sieci lokalnej. */
+  /* Zwraca nazwę serwera usługi ssh w sieci lokalnej. */
   std::string get_local_ssh_name() {
-    return boost::asio::ip::host_name() + '.' + SSH_SERVICE;
+    return local_host_name + '.' + SSH_SERVICE;
   }
-  /* Zwraca adres IP serwera w sieci lokalnej. */
+  /* Zwraca adres IP serwera w sieci lokalnej (lub poprzedni, jeśli
+   * nie udało się go ustalić). */
   uint32_t get_local_server_address() {
-    return send_socket.local_endpoint().address().to_v4().to_ulong();
+    boost::system::error_code error;
+    address_v4 source = transport.source_address(error);
+    return error ? local_server_address : source.to_ulong();
   }
 
-  /* zlecenie asynchronicznego odbioru pakietów multicastowych */
-  void start_receive() {
-    recv_buffer.consume(recv_buffer.size());  // wyczyść bufor
+  /* Sprawdza, czy zmieniła się nazwa hosta lub adres IP, i jeśli tak,
+   * przelicza gotowe odpowiedzi. Wywoływana co MDNS_RECORDS_REFRESH_INTERVAL sekund. */
+  void refresh_records() {
+    set_identity(boost::asio::ip::host_name(), get_local_server_address());
 
-    recv_socket.async_receive_from(
-        recv_buffer.prepare(BUFFER_SIZE), remote_endpoint,
-        boost::bind(&MdnsServer::handle_receive, this,
-          boost::asio::placeholders::error,
-          boost::asio::placeholders::bytes_transferred));
+    refresh_timer.expires_from_now(boost::posix_time::seconds(MDNS_RECORDS_REFRESH_INTERVAL));
+    refresh_timer.async_wait(boost::bind(&MdnsServer::refresh_records, this));
   }
 
-  /* Próbujemy przeczytać pakiet mDNS typu 'Query'. Zapytanie typu 'Response'
-   * jest ignorowane, zaś niepoprawne zapytanie typu 'Query' powoduje rzucenie
-   * (i złapanie) wyjątku.
-   * Następnie serwer odpowiada pakietem mDNS typu 'Response'. */
-  void handle_receive(boost::system::error_code const& error,
-      std::size_t bytes_transferred) {
-    if (!error) {
-      MdnsQuery query;
-      recv_buffer.commit(bytes_transferred);   // przygotowanie bufora
+  /* Buduje tablicę rekordów, na które odpowiada serwer, wraz z ich
+   * postacią w formacie sieciowym. */
+  void build_records() {
+    MdnsDomainName local_opoznienia_name(get_local_opoznienia_name());
+    MdnsDomainName local_ssh_name(get_local_ssh_name());
+    uint16_t ptr = static_cast<uint16_t>(QTYPE::PTR);
+    uint16_t a = static_cast<uint16_t>(QTYPE::A);
 
-      try {
-        if (query.try_read(recv_stream))          // ignorujemy pakiety mDNS typu 'Response'
-          send_response_to(query);
+    /* do odpowiedzi PTR dołączamy rekord A nazwy serwera (kolejny w tablicy): */
+    records.clear();
+    add_record(MdnsAnswer(opoznienia_service, ptr, INTERNET_CLASS, TTL_DEFAULT, local_opoznienia_name),
+        records.size() + 1);
+    add_record(MdnsAnswer(local_opoznienia_name, a, INTERNET_CLASS, TTL_DEFAULT, local_server_address));
+    if (broadcast_ssh) {    // tylko jeśli rozgłaszamy ssh
+      add_record(MdnsAnswer(ssh_service, ptr, INTERNET_CLASS, TTL_DEFAULT, local_ssh_name),
+          records.size() + 1);
+      add_record(MdnsAnswer(local_ssh_name, a, INTERNET_CLASS, TTL_DEFAULT, local_server_address));
+    }
+  }
 
-      } catch (InvalidMdnsMessageException e) {
-        std::cout << "mDNS SERVER: Ignoring packet... reason: " << e.what() << std::endl;
-      }
+  void add_record(MdnsAnswer const& answer, int additional = -1) {
+    std::ostringstream wire;
+    wire << answer;
+    bool shared = answer.get_type() == static_cast<uint16_t>(QTYPE::PTR);
+    records.push_back(PrecomputedRecord{answer, wire.str(), shared, 0, 0, false, additional});
+  }
+
+  /* Zwraca gotowy rekord odpowiadający na pytanie 'question'
+   * lub nullptr, jeśli pytanie nas nie dotyczy. */
+  PrecomputedRecord* find_record(MdnsQuestion const& question) {
+    for (int i = 0; i < records.size(); i++) {
+      if (records[i].answer.get_type() == question.get_qtype()
+          && records[i].answer.get_name() == question.get_name())
+        return &records[i];
+    }
+    return nullptr;
+  }
+
+  /* Sprawdza, czy rekord może być teraz rozgłoszony: nie rozgłaszaliśmy go
+   * w ciągu ostatniej sekundy i nikt inny właśnie go nie rozgłosił.
+   * W przeciwnym razie zwiększa odpowiedni licznik. */
+  bool may_multicast(PrecomputedRecord const& record, time_type now) {
+    if (now - record.last_multicast < MDNS_RECORD_MIN_INTERVAL_NSEC) {
+      stats.rate_limited++;
+      return false;
     }
+    if (now - record.last_seen < MDNS_RECORD_MIN_INTERVAL_NSEC) {
+      stats.duplicates_suppressed++;
+      return false;
+    }
+    return true;
+  }
 
-    start_receive();
+  /* Sprawdza, czy pakiet od 'sender' został wysłany przez nas samych
+   * (pakiety multicastowe wracają do nadawcy). Bez gniazda porównujemy
+   * tylko adres nadawcy. */
+  bool is_own_packet(udp::endpoint const& sender) {
+    if (sender.address() != address_v4(local_server_address))
+      return false;
+    return offline || sender.port() == transport.local_port();
   }
 
-  /* Tworzy i wysyła odpowiedź na zapytanie 'query' */
-  void send_response_to(MdnsQuery const& query) {
-    MdnsResponse response;
-    std::vector<MdnsQuestion> questions = query.get_questions();
+  /* Zapamiętuje czas zobaczenia odpowiedzi identycznych z naszymi rekordami.
+   * Zgodnie z RFC 6762 §7.4 uwzględniamy tylko odpowiedzi z TTL co najmniej
+   * połowy naszego. */
+  void note_foreign_answers(MdnsResponse const& response) {
+    std::vector<MdnsAnswer> const& answers = response.get_answers();
+    time_type now = get_time_nsec();
+    for (int i = 0; i < answers.size(); i++) {
+      for (int r = 0; r < records.size(); r++) {
+        if (records[r].same_answer(answers[i]) && answers[i].get_ttl() >= TTL_DEFAULT / 2)
+          records[r].last_seen = now;
+      }
+    }
+  }
+
+  /* Odpowiada na zapytanie 'query' od 'sender'. Na pytania z bitem QU o rekordy
+   * rozgłoszone w ciągu ostatniej 1/4 TTL odpowiadamy od razu unicastem do pytającego.
+   * Pozostałe rekordy unikalne rozgłaszane są od razu, współdzielone - po
+   * losowym opóźnieniu z przedziału [MDNS_SHARED_DELAY_MIN_MS, MDNS_SHARED_DELAY_MAX_MS],
+   * zbiorczo. */
+  void send_response_to(MdnsQuery const& query, udp::endpoint const& sender) {
+    std::vector<MdnsQuestion> const& questions = query.get_questions();
+    std::vector<PrecomputedRecord*> immediate;
+    std::vector<PrecomputedRecord*> unicast;
+    time_type now = get_time_nsec();
+    bool new_delayed = false;
+
     for (int i = 0; i < questions.size(); i++) {
-      try {
-        response.add_answer(answer_to(questions[i]));
+      PrecomputedRecord* record = find_record(questions[i]);
+      if (!record)
+        continue;           // ignorujemy nieznane pytania
+      if (questions[i].unicast_response() && now - record->last_multicast < MDNS_UNICAST_WINDOW_NSEC) {
+        unicast.push_back(record);
+        continue;
+      }
+      if (record->delayed)
+        continue;           // rekord już czeka na opóźnioną odpowiedź
+      if (!may_multicast(*record, now))
+        continue;
+      if (record->shared) {
+        record->delayed = true;
+        new_delayed = true;
+      } else {
+        immediate.push_back(record);
       }
-      catch (InvalidMdnsMessageException e) {}    // ignorujemy nieznane pytania
     }
 
-    /* jeśli znamy jakąś odpowiedź, odpowiadamy: */
-    if (!response.get_answers().empty()) {
-      send_buffer.consume(send_buffer.size());
-      send_stream << response;
+    if (!unicast.empty())
+      send_records(unicast, sender);
+    if (!immediate.empty())
+      send_records(immediate, transport.get_multicast_endpoint());
 
-      send_socket.async_send_to(send_buffer.data(), multicast_endpoint,
-          boost::bind(&MdnsServer::handle_send, this));
+    /* jeśli licznik nie czeka już na wysłanie innych rekordów, uruchamiamy go: */
+    if (new_delayed && !delay_pending) {
+      delay_pending = true;
+      delay_timer.expires_from_now(
+          boost::posix_time::milliseconds(delay_distribution(random_generator)));
+      delay_timer.async_wait(boost::bind(&MdnsServer::send_delayed, this));
     }
   }
 
-  /* Zwraca odpowiedź na pojedyncze pytanie mDNS. */
-  MdnsAnswer answer_to(MdnsQuestion const& question) {
-    MdnsDomainName name = question.get_name();
-    uint16_t type = question.get_qtype();
-    uint16_t _class = INTERNET_CLASS;
-    uint32_t ttl = TTL_DEFAULT;
-    if (type == static_cast<uint16_t>(QTYPE::PTR)) {
-      if (name == opoznienia_service)
-        return MdnsAnswer(name, type, _class, ttl, local_opoznienia_name);
-      if (name == ssh_service && broadcast_ssh)   // tylko jeśli rozgłaszamy ssh
-        return MdnsAnswer(name, type, _class, ttl, local_ssh_name);
-
-    } else if (type == static_cast<uint16_t>(QTYPE::A)) {
-      if (name == local_opoznienia_name || (name == local_ssh_name && broadcast_ssh))
-        return MdnsAnswer(name, type, _class, ttl, local_server_address);
+  /* Wysyła rekordy czekające na opóźnioną odpowiedź, o ile w międzyczasie
+   * nie odpowiedział na nie inny serwer. */
+  void send_delayed() {
+    std::vector<PrecomputedRecord*> to_send;
+    time_type now = get_time_nsec();
+    delay_pending = false;
+
+    for (int i = 0; i < records.size(); i++) {
+      if (records[i].delayed) {
+        records[i].delayed = false;
+        if (may_multicast(records[i], now))
+          to_send.push_back(&records[i]);
+      }
     }
 
-    throw InvalidMdnsMessageException("Unknown question type");
+    if (!to_send.empty())
+      send_records(to_send, transport.get_multicast_endpoint());
   }
 
-  void handle_send() {}
+  /* Składa pakiet odpowiedzi z gotowych rekordów w buforze 'send_data'
+   * i wysyła go na adres 'destination'. Do odpowiedzi PTR dołączane są
+   * rekordy A w sekcji Additional, o ile nie ma ich już wśród odpowiedzi.
+   * Transport wysyła bez blokowania i nie trzyma bufora po powrocie, więc
+   * jeden bufor wystarcza także przy wielu zapytaniach naraz. */
+  void send_records(std::vector<PrecomputedRecord*> const& to_send,
+      udp::endpoint const& destination) {
+    std::vector<PrecomputedRecord*> additionals;
+    std::size_t length = MdnsHeader::size();
+    uint16_t ans_count = 0;
+    uint16_t add_count = 0;
+    bool multicast = destination == transport.get_multicast_endpoint();
+    time_type now = multicast ? get_time_nsec() : 0;  // unicast nie zmienia czasu rozgłoszenia
+
+    for (int i = 0; i < to_send.size(); i++) {
+      if (append_record(*to_send[i], send_data, length, now)) {
+        ans_count++;
+        if (to_send[i]->additional >= 0)
+          additionals.push_back(&records[to_send[i]->additional]);
+      }
+    }
+    for (int i = 0; i < additionals.size(); i++) {
+      if (std::find(to_send.begin(), to_send.end(), additionals[i]) == to_send.end()
+          && append_record(*additionals[i], send_data, length, now))
+        add_count++;
+    }
 
+    MdnsHeader header;
+    header.set_qr();
+    header.set_aa();
+    header.ans_count(ans_count);
+    header.add_count(add_count);
+    std::memcpy(send_data.data(), header.bytes(), MdnsHeader::size());
+    stats.answers_sent += ans_count;
+    if (!multicast)
+      stats.unicast_answers += ans_count;
+
+    transport.send(boost::asio::buffer(send_data, length), destination);
+  }
+
+  /* Dopisuje rekord na pozycji 'length' bufora 'data', jeśli się mieści.
+   * Niezerowe 'multicast_time' oznacza rozgłoszenie rekordu w tym czasie. */
+  bool append_record(PrecomputedRecord& record, boost::array<char, MDNS_MAX_PACKET_SIZE>& data,
+      std::size_t& length, time_type multicast_time) {
+    if (length + record.wire.size() > data.size())
+      return false;
+    std::memcpy(data.data() + length, record.wire.data(), record.wire.size());
+    length += record.wire.size();
+    if (multicast_time)
+      record.last_multicast = multicast_time;
+    return true;
+  }
 
 
-  boost::asio::streambuf recv_buffer; // bufor do odbierania
-  boost::asio::streambuf send_buffer; // bufor do wysyłania
-  std::istream recv_stream;           // strumień do odbierania
-  std::ostream send_stream;           // strumień do wysyłania
+  MdnsTransport& transport;   // wspólne gniazda mDNS
+  clock_timer refresh_timer;  // licznik sprawdzania zmian nazwy/adresu
+  clock_timer delay_timer;    // licznik opóźnionych odpowiedzi
+  bool delay_pending;                         // czy licznik opóźnionych odpowiedzi działa
+  std::mt19937 random_generator;
+  std::uniform_int_distribution<int> delay_distribution;  // opóźnienie w ms
 
-  udp::endpoint multicast_endpoint;   // odbieranie na porcie 5353 z adresu 224.0.0.251
-  udp::endpoint remote_endpoint;      // endpoint nadawcy odbieranego pakietu
-  udp::socket send_socket;            // wysyłanie pakietów na multicast
-  udp::socket recv_socket;            // odbieranie z multicastowych
+  boost::array<char, MDNS_MAX_PACKET_SIZE> send_data;   // bufor do wysyłania
 
-  uint32_t local_server_address;              // rozgłaszane IP serwera
-  const MdnsDomainName local_opoznienia_name; // rozgłaszana nazwa serwera usługi opoznienia
-  const MdnsDomainName local_ssh_name;        // rozgłaszana nazwa serwera usługi ssh
+  std::string local_host_name;        // nazwa hosta użyta w rekordach
+  uint32_t local_server_address;      // rozgłaszane IP serwera
   const MdnsDomainName opoznienia_service;
   const MdnsDomainName ssh_service;
+  std::vector<PrecomputedRecord> records;   // rekordy, na które odpowiadamy
 
   bool broadcast_ssh;
+  bool offline;                       // czy transport działa bez gniazd
+  MdnsServerStats stats;
 };
 
-#endif  // MDNS_SERVER_H
\ No newline at end of file
+#endif  // MDNS_SERVER_H
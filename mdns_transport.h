@@ -0,0 +1,223 @@
+#ifndef MDNS_TRANSPORT_H
+#define MDNS_TRANSPORT_H
+
+#include <functional>
+#include <iostream>
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include "common.h"
+#include "mdns_message.h"
+#include "handler_allocator.h"
+#include "probe_context.h"
+
+using boost::asio::ip::udp;
+using boost::asio::ip::address;
+using boost::asio::ip::address_v4;
+
+const int MDNS_MAX_PACKET_SIZE = BUFFER_SIZE;   // maks. rozmiar wysyłanego pakietu mDNS
+
+/* Wspólne gniazda mDNS serwera (MdnsServer) i klienta (MdnsClient): jedno
+ * gniazdo na porcie 5353 w grupie 224.0.0.251 i jedno do wysyłania, na które
+ * przychodzą też odpowiedzi unicastowe (QU). Każdy odebrany pakiet jest
+ * wczytywany raz - zapytania trafiają do serwera, odpowiedzi do klienta
+ * i serwera (tłumienie powtórzonych odpowiedzi). Wszystkie trzy klasy działają
+ * w wątku jednego io_service.
+ *
+ * Z 'offline' transport nie otwiera gniazd - pakiety przekazywane są przez
+ * receive_packet (odtwarzanie nagrań, symulacja), a wysyłane trafiają do
+ * transportu ustawionego przez set_packet_sink (lub nigdzie). */
+class MdnsTransport {
+public:
+  typedef std::function<void(MdnsQuery const&, udp::endpoint const&)> query_handler;
+  typedef std::function<void(MdnsResponse const&, udp::endpoint const&)> response_handler;
+
+  MdnsTransport(boost::asio::io_service& io_service, bool offline = false) :
+      io_service(io_service),
+      recv_buffer(),
+      unicast_recv_buffer(),
+      recv_stream(&recv_buffer),
+      unicast_recv_stream(&unicast_recv_buffer),
+      multicast_endpoint(address::from_string(MDNS_ADDRESS), MDNS_PORT),
+      send_socket(io_service),
+      recv_socket(io_service) {
+    if (offline)
+      return;
+    try {
+      /* dołączamy do grupy adresu 224.0.0.251, odbieramy na porcie 5353: */
+      recv_socket.open(udp::v4());
+      recv_socket.set_option(udp::socket::reuse_address(true));
+      recv_socket.bind(udp::endpoint(udp::v4(), MDNS_PORT));    // port 5353
+      recv_socket.set_option(boost::asio::ip::multicast::join_group(
+          address::from_string(MDNS_ADDRESS)));     // adres 224.0.0.251
+      /* odpowiedzi unicastowe (QU) przychodzą na port, z którego wysyłamy: */
+      send_socket.open(multicast_endpoint.protocol());
+      send_socket.bind(udp::endpoint(udp::v4(), 0));
+      send_socket.non_blocking(true);     // wysyłanie bez czekania (send)
+
+      start_receiving();
+      start_unicast_receiving();
+
+    } catch (boost::system::system_error const& e) {
+      std::cerr << "Failed to start mDNS: " << e.what() << "\n";
+    }
+  }
+
+  /* Kieruje wysyłane pakiety do 'sink' zamiast do gniazda (tryb 'offline'). */
+  void set_packet_sink(packet_sink const& new_sink) { sink = new_sink; }
+
+  /* Ustawia odbiorców zapytań i odpowiedzi po stronie serwera. */
+  void set_responder(query_handler const& on_query, response_handler const& on_response) {
+    responder_query = on_query;
+    responder_response = on_response;
+  }
+
+  /* Ustawia odbiorcę odpowiedzi po stronie klienta. */
+  void set_browser(response_handler const& on_response) { browser_response = on_response; }
+
+  bool is_offline() const { return !send_socket.is_open(); }
+
+  udp::endpoint const& get_multicast_endpoint() const { return multicast_endpoint; }
+
+  /* Port, z którego wysyłamy (0 w trybie 'offline'). */
+  unsigned short local_port() const {
+    boost::system::error_code error;
+    udp::endpoint local_endpoint = send_socket.local_endpoint(error);
+    return error ? 0 : local_endpoint.port();
+  }
+
+  /* Adres źródłowy, który zgodnie z aktualnym routingiem mają pakiety
+   * wysyłane na multicast (ustalany osobnym gniazdem - połączone gniazdo
+   * wysyłania przestałoby odbierać odpowiedzi unicastowe). */
+  address_v4 source_address(boost::system::error_code& error) {
+    udp::socket probe(io_service);
+    probe.open(udp::v4(), error);
+    if (!error)
+      probe.connect(multicast_endpoint, error);
+    udp::endpoint local_endpoint;
+    if (!error)
+      local_endpoint = probe.local_endpoint(error);
+    return error ? address_v4() : local_endpoint.address().to_v4();
+  }
+
+  /* Wysyła pakiet 'data' na adres 'destination' wspólnym gniazdem bez
+   * blokowania, tak jak pakiety pomiarowe (ProbeContext) - po powrocie bufor
+   * można od razu użyć ponownie. W trybie 'offline' pakiet trafia do
+   * transportu w pamięci. Zwraca false, jeśli pakietu nie udało się wysłać
+   * (np. bufor gniazda jest pełny - zapytanie lub odpowiedź zostanie
+   * powtórzona w kolejnym cyklu). */
+  bool send(boost::asio::const_buffer const& data, udp::endpoint const& destination) {
+    if (sink) {
+      return sink(IPPROTO_UDP, destination.address().to_v4(), destination.port(),
+          boost::asio::buffer_cast<unsigned char const*>(data), boost::asio::buffer_size(data));
+    }
+    if (!send_socket.is_open())
+      return false;
+    boost::system::error_code error;
+    send_socket.send_to(boost::asio::buffer(data), destination, 0, error);
+    return !error;
+  }
+
+  /* Obsługuje pakiet mDNS 'data' długości 'length' od nadawcy 'sender' tak
+   * jak odebrany z gniazda (tylko w trybie 'offline'). */
+  void receive_packet(char const* data, std::size_t length, udp::endpoint const& sender) {
+    recv_buffer.consume(recv_buffer.size());
+    recv_buffer.commit(boost::asio::buffer_copy(recv_buffer.prepare(length),
+        boost::asio::buffer(data, length)));
+    handle_packet(recv_stream, sender);
+  }
+
+private:
+  /* Zlecenie odbioru pakietów multicastowych. */
+  void start_receiving() {
+    recv_buffer.consume(recv_buffer.size());  // wyczyść bufor
+
+    recv_socket.async_receive_from(
+        recv_buffer.prepare(BUFFER_SIZE), remote_endpoint,
+        make_custom_alloc_handler(receive_memory,
+          boost::bind(&MdnsTransport::handle_receive, this,
+            boost::asio::placeholders::error,
+            boost::asio::placeholders::bytes_transferred)));
+  }
+
+  /* Zlecenie odbioru odpowiedzi unicastowych na gnieździe, z którego wysyłamy. */
+  void start_unicast_receiving() {
+    unicast_recv_buffer.consume(unicast_recv_buffer.size());  // wyczyść bufor
+
+    send_socket.async_receive_from(
+        unicast_recv_buffer.prepare(BUFFER_SIZE), unicast_remote_endpoint,
+        make_custom_alloc_handler(unicast_receive_memory,
+          boost::bind(&MdnsTransport::handle_unicast_receive, this,
+            boost::asio::placeholders::error,
+            boost::asio::placeholders::bytes_transferred)));
+  }
+
+  void handle_receive(boost::system::error_code const& error,
+      std::size_t bytes_transferred) {
+    if (!error) {
+      recv_buffer.commit(bytes_transferred);   // przygotowanie bufora
+      handle_packet(recv_stream, remote_endpoint);
+    }
+
+    start_receiving();
+  }
+
+  void handle_unicast_receive(boost::system::error_code const& error,
+      std::size_t bytes_transferred) {
+    if (!error) {
+      unicast_recv_buffer.commit(bytes_transferred);   // przygotowanie bufora
+      handle_packet(unicast_recv_stream, unicast_remote_endpoint);
+    }
+
+    start_unicast_receiving();
+  }
+
+  /* Wczytuje pakiet mDNS ze strumienia 'is' nadany przez 'sender' i przekazuje
+   * go odbiorcom. Zapytania wczytujemy tylko, jeśli jest serwer. Niepoprawny
+   * pakiet powoduje rzucenie (i złapanie) wyjątku. */
+  void handle_packet(std::istream& is, udp::endpoint const& sender) {
+    MdnsHeader header;
+    try {
+      is >> header;
+      if (!header.qr()) {
+        if (!responder_query)
+          return;
+        MdnsQuery query(header);
+        query.read_questions(is);
+        responder_query(query, sender);
+      } else {
+        MdnsResponse response(header);
+        response.read_answers(is);
+        if (browser_response)
+          browser_response(response, sender);
+        if (responder_response)
+          responder_response(response, sender);
+      }
+
+    } catch (InvalidMdnsMessageException const& e) {
+      std::cout << "mDNS: Ignoring packet... reason: " << e.what() << std::endl;
+    }
+  }
+
+
+  boost::asio::io_service& io_service;
+
+  boost::asio::streambuf recv_buffer; // bufor do odbierania
+  boost::asio::streambuf unicast_recv_buffer; // bufor do odbierania odpowiedzi unicastowych
+  std::istream recv_stream;           // strumień do odbierania
+  std::istream unicast_recv_stream;   // strumień do odbierania odpowiedzi unicastowych
+  HandlerMemory receive_memory;       // pamięć handlerów odbioru
+  HandlerMemory unicast_receive_memory;
+
+  udp::endpoint multicast_endpoint;   // adres 224.0.0.251, port 5353
+  udp::endpoint remote_endpoint;      // endpoint nadawcy odbieranego pakietu
+  udp::endpoint unicast_remote_endpoint;  // endpoint nadawcy odpowiedzi unicastowej
+  udp::socket send_socket;            // wysyłanie (multicast i unicast) i odbiór odpowiedzi QU
+  udp::socket recv_socket;            // odbieranie z multicastowych
+
+  query_handler responder_query;      // zapytania - do serwera
+  response_handler responder_response;  // odpowiedzi - do serwera (tłumienie)
+  response_handler browser_response;  // odpowiedzi - do klienta
+  packet_sink sink;                   // transport w pamięci (tryb 'offline')
+};
+
+#endif  // MDNS_TRANSPORT_H
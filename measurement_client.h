@@ -5,71 +5,181 @@
 #include <boost/bind.hpp>
 #include <endian.h>
 #include "common.h"
-#include "get_time_usec.h"
+#include "clock_timer.h"
+#include "clock_source.h"
 #include "mdns_client.h"
-#include "telnet_server.h"
+#include "mdns_transport.h"
+#include "calibration.h"
+#include "receive_thread.h"
+#include "servers_snapshot.h"
+#include "stats_publisher.h"
+#include "matrix_exchange.h"
+#include "coordinates.h"
 #include "server.h"
 #include "mdns_message.h"
-
-/* ze strony http://www.boost.org/doc/libs/1_58_0/doc/html/boost_asio/examples/cpp03_examples.html */
-#include "ipv4_header.hpp"
-#include "icmp_header.hpp"
+#include "probe_context.h"
+#include "probe_budget.h"
+#include "handler_allocator.h"
 
 
 using boost::asio::ip::udp;
 using boost::asio::ip::tcp;
 using boost::asio::ip::icmp;
 
-/* Centralna klasa pomiarów opóźnień. Zawiera klienta mDNS i serwer telnetu.
+const int ICMP_REPORT_INTERVAL = 60;       // co ile sekund wypisywać statystyki gniazda ICMP i odbioru
+
+/* Centralna klasa pomiarów opóźnień. Zawiera klienta mDNS i publikuje statystyki
+ * dla serwera telnetu.
  * Jest odowiedzialna za odbieranie pakietów UDP i ICMP oraz delegowanie
- * ich do odpowiednich instancji klasy Server w mapie 'servers'.  */
+ * ich do odpowiednich instancji klasy Server w mapie 'servers'.
+ *
+ * Z niepustym 'sink' klient nie otwiera gniazd: pomiary i zapytania mDNS
+ * trafiają do transportu w pamięci, który sam przekazuje odpowiedzi
+ * (dispatch_*_reply, get_mdns_transport) - tak działa symulacja (virtual_sim.cpp).
+ * Wymiana macierzy i współrzędnych wymaga gniazd, więc jest wtedy wyłączona. */
 class MeasurementClient {
 public:
   MeasurementClient(boost::asio::io_service& io_service, int udp_port, int ui_port,
-      int measurement_interval, int mdns_interval, float ui_refresh_interval) :
+      ProbeScheduleConfig const& schedule_config, int mdns_interval, float ui_refresh_interval,
+      std::string const& snapshot_path, CalibrationConfig const& calibration_config,
+      ReceiveThreadConfig const& receive_thread_config, float probe_budget,
+      MatrixExchangeConfig const& matrix_config, CoordinateConfig const& coordinate_config,
+      packet_sink const& sink = packet_sink()) :
           timer(io_service, boost::posix_time::seconds(0)),
-          recv_buffer(),
-          recv_stream(&recv_buffer),
-          udp_socket(new udp::socket(io_service, udp::v4())),
-          icmp_socket(new icmp::socket(io_service, icmp::v4())),
+          budget_timer(io_service),
+          icmp_report_timer(io_service),
+          budget(probe_budget),
+          budget_reports(0),
+          udp_socket(sink ? new udp::socket(io_service) : new udp::socket(io_service, udp::v4())),
+          icmp_socket(sink ? new icmp::socket(io_service) : new icmp::socket(io_service, icmp::v4())),
+          probe_context(io_service, udp_socket, icmp_socket, schedule_config),
           servers(new servers_map),
-          mdns_client(io_service, servers, udp_socket, icmp_socket, mdns_interval),
-          telnet_server(io_service, servers, ui_port, ui_refresh_interval) {
+          snapshot(io_service, servers, probe_context, snapshot_path),
+          calibrator(io_service, servers, probe_context, ui_port, calibration_config),
+          mdns_transport(io_service, static_cast<bool>(sink)),
+          mdns_client(io_service, mdns_transport, servers, probe_context, mdns_interval),
+          stats_publisher(io_service, servers, ui_refresh_interval) {
 
-    start_udp_receiving();
-    start_icmp_receiving();
+    if (sink) {                             // transport w pamięci
+      probe_context.set_packet_sink(sink);
+      mdns_transport.set_packet_sink(sink);
+    } else if (receive_thread_config.enabled) {    // odbiór w osobnym wątku
+      receive_thread.reset(new ReceiveThread(io_service, servers, probe_context, udp_socket,
+          icmp_socket, receive_thread_config));
+    } else {
+      start_udp_receiving();
+      start_icmp_receiving();
+    }
+
+    if (matrix_config.enabled && !sink) {
+      matrix_exchange.reset(new MatrixExchange(io_service, servers, matrix_config.port,
+          matrix_config.export_path));
+      stats_publisher.set_matrix(&matrix_exchange->get_matrix());
+    }
+    if (coordinate_config.neighbors > 0 && !sink) {
+      coordinates.reset(new CoordinateExchange(io_service, servers, coordinate_config));
+      stats_publisher.set_coordinates(coordinates.get());
+    }
 
     init_measurements();
+    if (budget.enabled())
+      send_budgeted();
+    if (!sink && (PROTOCOL::ICMP >= 0 || receive_thread))
+      reset_icmp_report_timer();
   }
 
+  StatsPublisher& get_stats_publisher() {
+    return stats_publisher;
+  }
+
+  AlertQueue const& get_alerts() const { return probe_context.get_detector().get_alerts(); }
+
+  servers_ptr get_servers() const { return servers; }
+  /* Gniazda mDNS, które klient dzieli z serwerem mDNS (MdnsServer). */
+  MdnsTransport& get_mdns_transport() { return mdns_transport; }
+  ProbeContext const& get_probe_context() const { return probe_context; }
+  ProbeContext& get_probe_context() { return probe_context; }
+
+  /* Przekazuje odpowiedź UDP z czasem wysłania 'id' od 'sender', odebraną
+   * w chwili 'end_time', serwerowi z mapy 'servers' (typ pomiaru rozpoznajemy
+   * po porcie nadawcy). Zwraca false, jeśli pakiet został zignorowany. */
+  static bool dispatch_udp_reply(servers_map& servers, udp::endpoint const& sender,
+      time_type id, time_type end_time) {
+    int protocol = EnabledProbes::find(ProbeTransport::UDP, sender.port());
+    auto it = servers.find(sender.address());
+    if (it == servers.end() || protocol < 0)
+      return false;
+    it->second.receive_reply(protocol, id, end_time);
+    return true;
+  }
+
+  /* Przekazuje pakiet IP 'packet' długości 'length' z gniazda ICMP, odebrany
+   * w chwili 'end_time', serwerowi z mapy 'servers', jeśli jest odpowiedzią
+   * na nasz pomiar. Zwraca false, jeśli pakiet został zignorowany. */
+  static bool dispatch_icmp_reply(servers_map& servers, unsigned char const* packet,
+      std::size_t length, time_type end_time) {
+    uint32_t source;
+    uint16_t seq_num;     // numer sekwencyjny jako id pakietu
+    if (PROTOCOL::ICMP < 0 || !ProbeContext::parse_echo_reply(packet, length, source, seq_num))
+      return false;
+    auto it = servers.find(address_v4(source));
+    if (it == servers.end())
+      return false;
+    it->second.receive_reply(PROTOCOL::ICMP, seq_num, end_time);
+    return true;
+  }
 
 private:
-  /* Inicjuje wysłanie pakietów rozpoczynających pomiar do wszystkich serwerów. */
+  /* Inicjuje wysłanie pakietów rozpoczynających pomiar do serwerów,
+   * dla których według harmonogramu nadszedł czas pomiaru (w trybie
+   * współrzędnych tylko do sąsiadów). */
   void init_measurements() {
+    time_type now = get_time_nsec();
     for (auto it = servers->begin(); it != servers->end(); ++it) {
-      it->second.send_queries();
+      if (!it->second.probe_due(now))
+        continue;
+      if (coordinates && !coordinates->probes(it->first, it->second)) {
+        it->second.expire(now);     // nie mierzymy, ale TTL wciąż obowiązuje
+        continue;
+      }
+      if (budget.enabled())
+        budget.enqueue(it->second, it->second.start_round());   // wyśle send_budgeted
+      else
+        it->second.send_queries();
     }
 
-    reset_timer(MEASUREMENT_INTERVAL_DEFAULT);
+    reset_timer(probe_context.get_schedule().tick_usec());
+  }
+
+  /* Wysyła zakolejkowane pomiary w ramach budżetu (co pół pojemności wiadra)
+   * i co PROBE_BUDGET_REPORT_INTERVAL sekund wypisuje statystyki budżetu. */
+  void send_budgeted() {
+    budget.send();
+
+    long period_usec = PROBE_BUDGET_BURST_SEC / 2 * SEC_TO_USEC;
+    if (++budget_reports * period_usec >= PROBE_BUDGET_REPORT_INTERVAL * SEC_TO_USEC) {
+      budget.report(std::cout);
+      budget_reports = 0;
+    }
+
+    budget_timer.expires_from_now(boost::posix_time::microseconds(period_usec));
+    budget_timer.async_wait(boost::bind(&MeasurementClient::send_budgeted, this));
   }
 
   /* słuchanie na wspólnym porcie UDP. */
   void start_udp_receiving() {
     udp_socket->async_receive_from(boost::asio::buffer(time_buffer), remote_udp_endpoint,
-        boost::bind(&MeasurementClient::handle_udp_receive, this,
-          boost::asio::placeholders::error,
-          boost::asio::placeholders::bytes_transferred));
+        make_custom_alloc_handler(udp_receive_memory,
+          boost::bind(&MeasurementClient::handle_udp_receive, this,
+            boost::asio::placeholders::error,
+            boost::asio::placeholders::bytes_transferred)));
   }
 
   void handle_udp_receive(boost::system::error_code const& error,
       std::size_t bytes_transferred) {
     if (!error && bytes_transferred >= sizeof(uint64_t)) {
-      time_type end_time = get_time_usec();
-
-      auto it = servers->find(remote_udp_endpoint.address());
-      if (it != servers->end()) { // else ignoruj pakiet
-        it->second.receive_udp_query(be64toh(time_buffer[0]), end_time);
-      }
+      time_type end_time = get_time_nsec();
+      dispatch_udp_reply(*servers, remote_udp_endpoint, be64toh(time_buffer[0]), end_time);
     }
 
     start_udp_receiving();
@@ -77,61 +187,75 @@ private:
 
   /* słuchanie na wspólnym porcie ICMP. */
   void start_icmp_receiving() {
-    recv_buffer.consume(recv_buffer.size());
-
-    icmp_socket->async_receive(recv_buffer.prepare(BUFFER_SIZE),
-        boost::bind(&MeasurementClient::handle_icmp_receive, this,
-          boost::asio::placeholders::error,
-          boost::asio::placeholders::bytes_transferred));
+    icmp_socket->async_receive(boost::asio::buffer(icmp_buffer),
+        make_custom_alloc_handler(icmp_receive_memory,
+          boost::bind(&MeasurementClient::handle_icmp_receive, this,
+            boost::asio::placeholders::error,
+            boost::asio::placeholders::bytes_transferred)));
   }
 
   void handle_icmp_receive(boost::system::error_code const& error,
       std::size_t bytes_transferred) {
     if (!error) {
-      time_type end_time = get_time_usec();
-      recv_buffer.commit(bytes_transferred);
-
-      ipv4_header ipv4_hdr;
-      icmp_header icmp_hdr;
-      recv_stream >> ipv4_hdr >> icmp_hdr;
-
-      if (recv_stream && icmp_hdr.type() == icmp_header::echo_reply
-            && icmp_hdr.identifier() == 0) {
-        int seq_num = icmp_hdr.sequence_number();    // numer sekwencyjny jako id pakietu
-
-        auto it = servers->find(ipv4_hdr.source_address());
-        if (it != servers->end()) { // else ignoruj pakiet
-          it->second.receive_icmp_query(seq_num, end_time);
-        }
-      }
+      time_type end_time = get_time_nsec();
+      probe_context.count_icmp(
+          dispatch_icmp_reply(*servers, icmp_buffer.data(), bytes_transferred, end_time));
     }
 
     start_icmp_receiving();
   }
 
-  /* Ustawia timer na czas późiejszy o 'seconds' sekund względem poprzedniego czasu. */
-  void reset_timer(int seconds) {
-    timer.expires_at(timer.expires_at() + boost::posix_time::seconds(seconds));
+  /* Co ICMP_REPORT_INTERVAL sekund wypisuje statystyki gniazda ICMP
+   * i odpowiedzi porzuconych przez wątek odbierający (pełna kolejka). */
+  void report_icmp() {
+    if (PROTOCOL::ICMP >= 0)
+      probe_context.report_icmp(std::cout);
+    if (receive_thread)
+      std::cout << "Receive thread: " << receive_thread->get_dropped()
+          << " replies dropped (queue full)" << std::endl;
+    reset_icmp_report_timer();
+  }
+
+  void reset_icmp_report_timer() {
+    icmp_report_timer.expires_from_now(boost::posix_time::seconds(ICMP_REPORT_INTERVAL));
+    icmp_report_timer.async_wait(boost::bind(&MeasurementClient::report_icmp, this));
+  }
+
+  /* Ustawia timer na czas późiejszy o 'usec' mikrosekund względem poprzedniego czasu. */
+  void reset_timer(long usec) {
+    timer.expires_at(timer.expires_at() + boost::posix_time::microseconds(usec));
     timer.async_wait(boost::bind(&MeasurementClient::init_measurements, this));
   }
 
 
 
-  boost::asio::deadline_timer timer;
+  clock_timer timer;
+  clock_timer budget_timer;   // wysyłanie w ramach budżetu (opcja -b)
+  clock_timer icmp_report_timer;  // statystyki gniazda ICMP
+  ProbeBudget budget;
+  long budget_reports;          // obsłużone okresy od ostatniego raportu budżetu
 
   boost::array<uint64_t, 1> time_buffer;  // bufor do obierania czasu
-  boost::asio::streambuf recv_buffer; // bufor do odbierania
-  std::istream recv_stream;           // strumień do odbierania
+  boost::array<unsigned char, BUFFER_SIZE> icmp_buffer;  // bufor do odbierania ICMP
+  HandlerMemory udp_receive_memory;   // pamięć handlerów odbioru
+  HandlerMemory icmp_receive_memory;
 
   std::shared_ptr<udp::socket>  udp_socket;  // gniazdo używane do wszystkich pakietów UDP
   std::shared_ptr<icmp::socket> icmp_socket; // gniazdo używane do wszystkich pakietów ICMP
   udp::endpoint remote_udp_endpoint;
 
+  ProbeContext probe_context;   // wspólne bufory i szablony pakietów pomiarowych
   servers_ptr servers;
 
+  ServersSnapshot snapshot;     // wczytuje stan przed pierwszymi pomiarami
+  Calibrator calibrator;        // tryb kalibracji (opcja -C)
+  std::unique_ptr<ReceiveThread> receive_thread;  // osobny wątek odbierający (opcja -R)
 
+  MdnsTransport mdns_transport;
   MdnsClient mdns_client;
-  TelnetServer telnet_server;
+  StatsPublisher stats_publisher;   // obrazy statystyk dla wątku UI
+  std::unique_ptr<MatrixExchange> matrix_exchange;  // macierz floty (opcja -X)
+  std::unique_ptr<CoordinateExchange> coordinates;  // współrzędne sieciowe (opcja -V)
 };
 
 #endif  // MEASUREMENT_CLIENT_H
\ No newline at end of file
@@ -7,17 +7,22 @@
 #include <endian.h>
 #include "common.h"
 #include "get_time_usec.h"
+#include "handler_allocator.h"
 
 using boost::asio::ip::udp;
 
 
-/* Serwer do pomiarów opóźnień przez UDP - taki jak 'czekamnaudp' w zadaniu 1. */
+/* Serwer do pomiarów opóźnień przez UDP - taki jak 'czekamnaudp' w zadaniu 1.
+ * Odpowiedzi wysyłane są od razu przez nieblokujące gniazdo, a handler
+ * odbioru korzysta z własnej pamięci - odbijanie pakietów nie alokuje. */
 class MeasurementServer {
 public:
-  MeasurementServer(boost::asio::io_service& io_service) :
+  MeasurementServer(boost::asio::io_service& io_service, int port) :
       socket(io_service, udp::v4()) {
     boost::system::error_code error;
-    socket.bind(udp::endpoint(udp::v4(), UDP_PORT_DEFAULT), error);
+    socket.bind(udp::endpoint(udp::v4(), port), error);
+
+    socket.non_blocking(true, error);
 
     if (error)
       std::cerr << "Failed to start Measurement Server!\n";
@@ -28,9 +33,10 @@ public:
 private:
   void start_receive() {
     socket.async_receive_from(boost::asio::buffer(time_buffer), remote_endpoint,
-        boost::bind(&MeasurementServer::handle_receive, this,
-          boost::asio::placeholders::error,
-          boost::asio::placeholders::bytes_transferred));
+        make_custom_alloc_handler(receive_memory,
+          boost::bind(&MeasurementServer::handle_receive, this,
+            boost::asio::placeholders::error,
+            boost::asio::placeholders::bytes_transferred)));
   }
 
   void handle_receive(const boost::system::error_code& error,
@@ -39,19 +45,18 @@ private:
 
       time_buffer[1] = htobe64(get_time_usec());
 
-      socket.async_send_to(boost::asio::buffer(time_buffer), remote_endpoint,
-          boost::bind(&MeasurementServer::handle_send, this));
+      boost::system::error_code send_error;   // nie da się wysłać - odpowiedź przepada
+      socket.send_to(boost::asio::buffer(time_buffer), remote_endpoint, 0, send_error);
     }
     
     start_receive();
   }
 
-  void handle_send() {}
-
   boost::array<uint64_t, 2> time_buffer;
 
   udp::socket socket;
   udp::endpoint remote_endpoint;
+  HandlerMemory receive_memory;     // pamięć handlera odbioru
 
 };
 
@@ -1,4 +1,5 @@
 #include <iostream>
+#include <memory>
 #include <thread>
 #include <stdexcept>
 #include <boost/array.hpp>
@@ -7,18 +8,37 @@
 #include <boost/thread/thread.hpp>
 
 #include "common.h"
+#include "clock_source.h"
 #include "mdns_server.h"
 #include "measurement_server.h"
 #include "measurement_client.h"
+#include "telnet_server.h"
+#include "alert_sink.h"
 
 
 /* Parsuje argumenty. */
 void parse_arguments(int argc, char const *argv[], int& udp_port,
-    int& ui_port, int& measurement_interval, int& mdns_interval,
-    float&  ui_refresh_interval, bool& broadcast_ssh) {
+    int& ui_port, ProbeScheduleConfig& schedule_config, int& mdns_interval,
+    float&  ui_refresh_interval, bool& broadcast_ssh, std::string& snapshot_path,
+    CalibrationConfig& calibration_config, ReceiveThreadConfig& receive_thread_config,
+    float& probe_budget, MatrixExchangeConfig& matrix_config,
+    CoordinateConfig& coordinate_config, bool& use_tsc, std::string& alert_sink,
+    bool& latency_history) {
   for (int arg = 1; arg < argc; ++arg) {
     if (strcmp(argv[arg], "-s") == 0) {
       broadcast_ssh = true;
+    } else if (strcmp(argv[arg], "-B") == 0) {
+      calibration_config.subtract_baseline = true;
+    } else if (strcmp(argv[arg], "-Y") == 0) {
+      receive_thread_config.spin = true;
+    } else if (strcmp(argv[arg], "-A") == 0) {
+      schedule_config.adaptive = true;
+    } else if (strcmp(argv[arg], "-X") == 0) {
+      matrix_config.enabled = true;
+    } else if (strcmp(argv[arg], "-K") == 0) {
+      use_tsc = false;
+    } else if (strcmp(argv[arg], "-H") == 0) {
+      latency_history = true;
 
     } else if (arg == argc - 1) {
        // inne argumenty wymagają liczby, a to jest ostatni
@@ -27,6 +47,16 @@ void parse_arguments(int argc, char const *argv[], int& udp_port,
     } else {    // mamy przed sobą 2 argumenty
       if (strcmp(argv[arg], "-v") == 0) {    // float
         ui_refresh_interval = std::stof(argv[arg + 1]);
+      } else if (strcmp(argv[arg], "-b") == 0) {    // float
+        probe_budget = std::stof(argv[arg + 1]);
+      } else if (strcmp(argv[arg], "-S") == 0) {    // ścieżka pliku
+        snapshot_path = argv[arg + 1];
+      } else if (strcmp(argv[arg], "-M") == 0) {    // ścieżka pliku
+        matrix_config.export_path = argv[arg + 1];
+      } else if (strcmp(argv[arg], "-E") == 0) {    // ścieżka pliku albo udp:adres:port
+        alert_sink = argv[arg + 1];
+      } else if (strcmp(argv[arg], "-P") == 0) {    // klasa priorytetu
+        schedule_config.classes.push_back(ProbeSchedule::parse_class(argv[arg + 1]));
       } else {          // musimy wczytać wartość typu int
         int value = std::stoi(argv[arg + 1]);
         if (strcmp(argv[arg], "-u") == 0) {
@@ -34,9 +64,20 @@ void parse_arguments(int argc, char const *argv[], int& udp_port,
         } else if (strcmp(argv[arg], "-U") == 0) {
           ui_port = value;
         } else if (strcmp(argv[arg], "-t") == 0) {
-          measurement_interval = value;
+          schedule_config.interval = value;
         } else if (strcmp(argv[arg], "-T") == 0) {
           mdns_interval = value;
+        } else if (strcmp(argv[arg], "-C") == 0) {
+          calibration_config.seconds = value;
+        } else if (strcmp(argv[arg], "-L") == 0) {
+          calibration_config.load_hosts = value;
+        } else if (strcmp(argv[arg], "-R") == 0) {
+          receive_thread_config.enabled = true;
+          receive_thread_config.cpu = value;
+        } else if (strcmp(argv[arg], "-F") == 0) {
+          receive_thread_config.rt_priority = value;
+        } else if (strcmp(argv[arg], "-V") == 0) {
+          coordinate_config.neighbors = value;
         } else {
           throw std::invalid_argument("unkown argument type");
         }
@@ -51,14 +92,30 @@ int main(int argc, char const *argv[]) {
   /* Domyślne wartości parametrów: */
   int udp_port = UDP_PORT_DEFAULT;    // port usługi opóźnień (udostępnianie i łączenie)
   int ui_port = UI_PORT_DEFAULT;      // port do udostępniania interfejsu telnet
-  int measurement_interval = MEASUREMENT_INTERVAL_DEFAULT;
+  float probe_budget = PROBE_BUDGET_DEFAULT;      // limit pakietów pomiarowych na sekundę
+  ProbeScheduleConfig schedule_config = {MEASUREMENT_INTERVAL_DEFAULT,  // harmonogram pomiarów
+      ADAPTIVE_PROBING_DEFAULT, std::vector<ProbeClass>()};
   int mdns_interval = MDNS_INTERVAL_DEFAULT;
   float ui_refresh_interval = UI_REFRESH_INTERVAL_DEFAULT;
   bool broadcast_ssh = BROADCAST_SSH_DEFAULT;     // czy rozgłaszać _ssh._tcp.local
+  std::string snapshot_path = SNAPSHOT_PATH_DEFAULT;  // plik ze stanem serwerów
+  CalibrationConfig calibration_config = {CALIBRATION_SECONDS_DEFAULT,   // kalibracja narzutu
+      CALIBRATION_LOAD_HOSTS_DEFAULT, SUBTRACT_BASELINE_DEFAULT};
+  ReceiveThreadConfig receive_thread_config = {false,     // osobny wątek odbierający
+      RECEIVE_THREAD_CPU_DEFAULT, false, RECEIVE_THREAD_PRIORITY_DEFAULT};
+  MatrixExchangeConfig matrix_config = {MATRIX_EXCHANGE_DEFAULT,  // wymiana macierzy floty
+      MATRIX_PORT_DEFAULT, MATRIX_EXPORT_PATH_DEFAULT};
+  CoordinateConfig coordinate_config = {VIVALDI_NEIGHBORS_DEFAULT,  // współrzędne sieciowe
+      VIVALDI_PORT_DEFAULT};
+  bool use_tsc = CLOCK_USE_TSC_DEFAULT;   // zegar pomiarów z TSC (albo CLOCK_MONOTONIC_RAW)
+  std::string alert_sink = ALERT_SINK_DEFAULT;  // ujście alarmów o zmianach opóźnień
+  bool latency_history = LATENCY_HISTORY_DEFAULT;   // historia opóźnień serwerów (ok. 34 KB na serwer)
 
   try {
-    parse_arguments(argc, argv, udp_port, ui_port, measurement_interval,
-        mdns_interval, ui_refresh_interval, broadcast_ssh);
+    parse_arguments(argc, argv, udp_port, ui_port, schedule_config,
+        mdns_interval, ui_refresh_interval, broadcast_ssh, snapshot_path,
+        calibration_config, receive_thread_config, probe_budget, matrix_config,
+        coordinate_config, use_tsc, alert_sink, latency_history);
   } catch (std::invalid_argument) {
     std::cout << "Error parsing arguments: invalid values types!\n";
     return 1;
@@ -67,21 +124,37 @@ int main(int argc, char const *argv[]) {
     return 1;
   }
 
-  
+  ClockSource::prefer_tsc() = use_tsc;
+  LatencyHistory::enabled() = latency_history;
+  ClockSource::instance();    // kalibracja zegara pomiarów przed startem wątków
 
 
-  /* Tworzymy dwa osobne serwisy: */
-  boost::asio::io_service io_service;         // do pomiarów czasu
-  boost::asio::io_service io_service_servers; // dla serwerów opóźnień i mDNS
+  /* Tworzymy trzy osobne serwisy: */
+  boost::asio::io_service io_service;         // do pomiarów czasu i mDNS
+  boost::asio::io_service io_service_servers; // dla serwera opóźnień
+  boost::asio::io_service io_service_ui;      // dla interfejsu telnet
 
 
-	MdnsServer mdns_server(io_service_servers, broadcast_ssh);
-  MeasurementServer measurement_server(io_service_servers);
+  MeasurementServer measurement_server(io_service_servers, udp_port);
   MeasurementClient measurement_client(io_service, udp_port, ui_port,
-      measurement_interval, mdns_interval, ui_refresh_interval);
+      schedule_config, mdns_interval, ui_refresh_interval, snapshot_path,
+      calibration_config, receive_thread_config, probe_budget, matrix_config,
+        coordinate_config);
+  /* serwer mDNS dzieli gniazda z klientem mDNS, więc działa w jego wątku: */
+  MdnsServer mdns_server(io_service, measurement_client.get_mdns_transport(), broadcast_ssh);
+  TelnetServer telnet_server(io_service_ui, measurement_client.get_stats_publisher(),
+      measurement_client.get_alerts(), ui_port, ui_refresh_interval);
+  std::unique_ptr<AlertSink> sink;    // w wątku UI, żeby zapis nie wstrzymywał pomiarów
+  if (!alert_sink.empty())
+    sink.reset(new AlertSink(io_service_ui, measurement_client.get_alerts(), alert_sink));
 
   std::thread servers_thread(
       boost::bind(&boost::asio::io_service::run, &io_service_servers));
+  std::thread ui_thread(
+      boost::bind(&boost::asio::io_service::run, &io_service_ui));
   io_service.run();
+  io_service_servers.stop();    // io_service kończy działanie tylko po kalibracji
+  io_service_ui.stop();
   servers_thread.join();
+  ui_thread.join();
 }
@@ -0,0 +1,562 @@
+/* Odtwarzanie nagrań: czyta plik pcap z ruchem nagranym na komputerze
+ * z programem `opoznienia` (mDNS, pomiary UDP i ICMP) i przepuszcza pakiety
+ * przez prawdziwe procedury obsługi programu, bez sieci:
+ *  - pakiety mDNS - przez MdnsTransport (w trybie 'offline') do MdnsServer
+ *    i MdnsClient,
+ *  - wysłane pomiary UDP i ICMP Echo Request - zapamiętywane w serwerach
+ *    z mapy 'servers' (Server::probe_started),
+ *  - odpowiedzi UDP i ICMP - przez demultipleksację MeasurementClient.
+ * Zegarem programu (get_time_usec, get_time_nsec i liczniki clock_timer) jest
+ * znacznik czasu bieżącego pakietu; liczniki, których czas minął, obsługiwane
+ * są przed pakietem (z dokładnością do REPLAY_POLL_USEC).
+ *
+ * Pakiety odtwarzane są najszybciej, jak to możliwe, albo (z opcją -r)
+ * w tempie nagrania. Na koniec wypisywana jest przepustowość odtwarzania,
+ * liczniki pakietów, statystyki odpowiedzi mDNS i wynikowa tablica serwerów.
+ *
+ * Adres nagrywającego komputera (-a) domyślnie jest adresem unicastowym
+ * najczęściej występującym w nagraniu, a jego nazwa (-n) - nazwą z rekordu A
+ * tego adresu wysłanego przez niego samego. Opcja -l powtarza nagranie
+ * (przesunięte w czasie) do pomiarów wydajności, -s włącza rekordy _ssh._tcp
+ * w odpowiedziach serwera mDNS.
+ *
+ * Użycie: pcap-replay [-r] [-s] [-a adres] [-n nazwa_hosta] [-l powtórzenia] plik.pcap */
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <map>
+#include <stdexcept>
+#include <cstring>
+#include <sys/time.h>
+#include <boost/asio.hpp>
+
+#include "common.h"
+#include "get_time_usec.h"
+#include "clock_source.h"
+#include "mdns_message.h"
+#include "mdns_client.h"
+#include "mdns_server.h"
+#include "measurement_client.h"
+#include "probe_context.h"
+#include "server.h"
+
+using boost::asio::ip::udp;
+using boost::asio::ip::icmp;
+using boost::asio::ip::address;
+using boost::asio::ip::address_v4;
+
+const uint32_t PCAP_MAGIC_USEC = 0xa1b2c3d4;
+const uint32_t PCAP_MAGIC_NSEC = 0xa1b23c4d;
+const std::size_t PCAP_HEADER_SIZE = 24;
+const std::size_t PCAP_RECORD_HEADER_SIZE = 16;
+
+/* Typy warstwy łącza (LINKTYPE_*) obsługiwane przy odtwarzaniu. */
+const uint32_t LINKTYPE_NULL = 0;
+const uint32_t LINKTYPE_ETHERNET = 1;
+const uint32_t LINKTYPE_RAW = 101;
+const uint32_t LINKTYPE_LINUX_SLL = 113;
+const uint32_t LINKTYPE_IPV4 = 228;
+const uint32_t LINKTYPE_LINUX_SLL2 = 276;
+
+const uint16_t ETHERTYPE_IPV4 = 0x0800;
+const uint16_t ETHERTYPE_VLAN = 0x8100;
+const uint8_t IP_PROTOCOL_ICMP = 1;
+const uint8_t IP_PROTOCOL_UDP = 17;
+
+const long REPLAY_POLL_USEC = 1000;     // co ile us czasu nagrania obsługiwać liczniki czasu
+
+
+/* Parametry odtwarzania. */
+struct ReplayConfig {
+  std::string path;
+  bool recorded_speed = false;  // tempo nagrania zamiast najszybciej, jak się da
+  bool ssh = false;             // czy serwer mDNS odpowiada też rekordami _ssh._tcp
+  std::string local_address;    // adres nagrywającego komputera (pusty - wykryj)
+  std::string host_name;        // nazwa nagrywającego komputera (pusta - wykryj)
+  int loops = 1;                // liczba odtworzeń nagrania
+};
+
+/* Pakiet IPv4 z nagrania. */
+struct CapturedPacket {
+  time_type time;               // znacznik czasu w us
+  unsigned char const* data;    // nagłówek IP
+  std::size_t length;           // długość pakietu IP (zapisana część)
+};
+
+/* Pakiet UDP albo ICMP wyłuskany z pakietu IPv4. */
+struct ParsedPacket {
+  uint8_t protocol;
+  uint32_t source;
+  uint32_t destination;
+  uint16_t source_port;         // tylko UDP
+  uint16_t destination_port;
+  unsigned char const* payload; // dane UDP albo nagłówek ICMP
+  std::size_t payload_length;
+};
+
+inline uint16_t read_be16(unsigned char const* data) {
+  return (data[0] << 8) | data[1];
+}
+
+inline uint32_t read_be32(unsigned char const* data) {
+  return ((uint32_t) data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+}
+
+inline uint64_t read_be64(unsigned char const* data) {
+  return ((uint64_t) read_be32(data) << 32) | read_be32(data + 4);
+}
+
+
+/* Plik pcap wczytany w całości do pamięci; next() zwraca kolejne pakiety
+ * IPv4 (pozostałe są pomijane). */
+class PcapFile {
+public:
+  explicit PcapFile(std::string const& path) : offset(PCAP_HEADER_SIZE), swapped(false), skipped(0) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+      throw std::runtime_error("cannot open " + path);
+    data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    if (data.size() < PCAP_HEADER_SIZE)
+      throw std::runtime_error("truncated pcap header");
+
+    uint32_t magic = read32(0);
+    swapped = magic == __builtin_bswap32(PCAP_MAGIC_USEC) || magic == __builtin_bswap32(PCAP_MAGIC_NSEC);
+    magic = read32(0);
+    if (magic != PCAP_MAGIC_USEC && magic != PCAP_MAGIC_NSEC)
+      throw std::runtime_error("not a pcap file (pcapng is not supported)");
+    nanoseconds = magic == PCAP_MAGIC_NSEC;
+    link_type = read32(20) & 0xFFFF;
+    if (link_type != LINKTYPE_NULL && link_type != LINKTYPE_ETHERNET && link_type != LINKTYPE_RAW
+        && link_type != LINKTYPE_LINUX_SLL && link_type != LINKTYPE_IPV4
+        && link_type != LINKTYPE_LINUX_SLL2)
+      throw std::runtime_error("unsupported link type " + std::to_string(link_type));
+  }
+
+  /* Wraca na początek nagrania. */
+  void rewind() {
+    offset = PCAP_HEADER_SIZE;
+    skipped = 0;
+  }
+
+  /* Liczba pakietów pominiętych od początku nagrania, bo nie były pakietami IPv4. */
+  unsigned long get_skipped() const { return skipped; }
+
+  bool next(CapturedPacket& packet) {
+    while (offset + PCAP_RECORD_HEADER_SIZE <= data.size()) {
+      uint32_t seconds = read32(offset);
+      uint32_t fraction = read32(offset + 4);
+      std::size_t captured = read32(offset + 8);
+      std::size_t start = offset + PCAP_RECORD_HEADER_SIZE;
+      if (start + captured > data.size())
+        break;          // ucięty ostatni pakiet
+      offset = start + captured;
+
+      packet.time = seconds * (time_type) SEC_TO_USEC + (nanoseconds ? fraction / 1000 : fraction);
+      if (strip_link_header(&data[start], captured, packet))
+        return true;
+      skipped++;
+    }
+    return false;
+  }
+
+private:
+  uint32_t read32(std::size_t position) const {
+    uint32_t value;
+    std::memcpy(&value, &data[position], sizeof(value));
+    return swapped ? __builtin_bswap32(value) : value;
+  }
+
+  /* Pomija nagłówek warstwy łącza; zwraca false dla pakietów innych niż IPv4. */
+  bool strip_link_header(unsigned char const* frame, std::size_t length, CapturedPacket& packet) {
+    std::size_t header = 0;
+    uint16_t ethertype = ETHERTYPE_IPV4;
+    switch (link_type) {
+      case LINKTYPE_NULL:       // rodzina adresów w porządku bajtów nagrywającego
+        if (length < 4 || (frame[0] != 2 && frame[3] != 2))
+          return false;
+        header = 4;
+        break;
+      case LINKTYPE_ETHERNET:
+        if (length < 14)
+          return false;
+        header = 14;
+        ethertype = read_be16(frame + 12);
+        if (ethertype == ETHERTYPE_VLAN && length >= 18) {
+          header = 18;
+          ethertype = read_be16(frame + 16);
+        }
+        break;
+      case LINKTYPE_LINUX_SLL:
+        if (length < 16)
+          return false;
+        header = 16;
+        ethertype = read_be16(frame + 14);
+        break;
+      case LINKTYPE_LINUX_SLL2:
+        if (length < 20)
+          return false;
+        header = 20;
+        ethertype = read_be16(frame);
+        break;
+    }
+    if (ethertype != ETHERTYPE_IPV4 || length <= header || (frame[header] >> 4) != 4)
+      return false;
+    packet.data = frame + header;
+    packet.length = length - header;
+    return true;
+  }
+
+
+  std::vector<unsigned char> data;
+  std::size_t offset;           // początek następnego rekordu
+  bool swapped;                 // czy plik zapisano w przeciwnym porządku bajtów
+  bool nanoseconds;             // czy znaczniki czasu mają ns zamiast us
+  uint32_t link_type;
+  unsigned long skipped;
+};
+
+/* Wyłuskuje z pakietu IPv4 dane UDP albo ICMP. Fragmenty są pomijane. */
+bool parse_packet(CapturedPacket const& packet, ParsedPacket& parsed) {
+  unsigned char const* ip = packet.data;
+  if (packet.length < 20)
+    return false;
+  std::size_t header_length = (ip[0] & 0x0F) * 4;
+  std::size_t total_length = std::min<std::size_t>(read_be16(ip + 2), packet.length);
+  if (header_length < 20 || total_length < header_length || (read_be16(ip + 6) & 0x3FFF))
+    return false;       // niepoprawny nagłówek albo fragment
+
+  parsed.protocol = ip[9];
+  parsed.source = read_be32(ip + 12);
+  parsed.destination = read_be32(ip + 16);
+  parsed.payload = ip + header_length;
+  parsed.payload_length = total_length - header_length;
+  parsed.source_port = parsed.destination_port = 0;
+
+  if (parsed.protocol == IP_PROTOCOL_UDP) {
+    if (parsed.payload_length < 8)
+      return false;
+    parsed.source_port = read_be16(parsed.payload);
+    parsed.destination_port = read_be16(parsed.payload + 2);
+    parsed.payload_length = std::min<std::size_t>(read_be16(parsed.payload + 4), parsed.payload_length);
+    parsed.payload_length = parsed.payload_length >= 8 ? parsed.payload_length - 8 : 0;
+    parsed.payload += 8;
+    return true;
+  }
+  return parsed.protocol == IP_PROTOCOL_ICMP;
+}
+
+inline bool is_unicast(uint32_t ip) {
+  return (ip >> 28) != 0xE && ip != 0xFFFFFFFF && ip != 0;
+}
+
+/* Adres unicastowy występujący w największej liczbie pakietów nagrania. */
+uint32_t detect_local_address(PcapFile& file) {
+  std::map<uint32_t, unsigned long> counts;
+  CapturedPacket packet;
+  ParsedPacket parsed;
+  file.rewind();
+  while (file.next(packet)) {
+    if (!parse_packet(packet, parsed))
+      continue;
+    if (is_unicast(parsed.source))
+      counts[parsed.source]++;
+    if (is_unicast(parsed.destination))
+      counts[parsed.destination]++;
+  }
+  uint32_t best = 0;
+  for (auto it = counts.begin(); it != counts.end(); ++it) {
+    if (!best || it->second > counts[best])
+      best = it->first;
+  }
+  return best;
+}
+
+/* Nazwa hosta z rekordu A adresu 'local' rozgłoszonego przez sam ten adres
+ * (pusta, jeśli w nagraniu takiego nie ma). Serwer mDNS wysyła odpowiedzi
+ * z portu efemerycznego, więc liczy się port docelowy. */
+std::string detect_host_name(PcapFile& file, uint32_t local) {
+  CapturedPacket packet;
+  ParsedPacket parsed;
+  file.rewind();
+  while (file.next(packet)) {
+    if (!parse_packet(packet, parsed) || parsed.protocol != IP_PROTOCOL_UDP
+        || parsed.source != local || parsed.destination_port != MDNS_PORT)
+      continue;
+    std::istringstream stream(std::string(reinterpret_cast<char const*>(parsed.payload),
+        parsed.payload_length));
+    MdnsResponse response;
+    try {
+      if (!response.try_read(stream))
+        continue;
+    } catch (InvalidMdnsMessageException const&) {
+      continue;
+    }
+    std::vector<MdnsAnswer> records(response.get_answers());
+    records.insert(records.end(), response.get_additionals().begin(), response.get_additionals().end());
+    for (int i = 0; i < records.size(); i++) {
+      if (records[i].get_type() == static_cast<uint16_t>(QTYPE::A)
+          && records[i].get_server_address() == local)
+        return records[i].get_name().label(0);
+    }
+  }
+  return "";
+}
+
+
+/* Liczniki odtwarzania. */
+struct ReplayStats {
+  unsigned long packets;
+  unsigned long bytes;
+  unsigned long mdns;
+  unsigned long probes_sent[PROTOCOL_COUNT];    // nasze pomiary (do znanych serwerów)
+  unsigned long replies[PROTOCOL_COUNT];        // odpowiedzi do nas
+  unsigned long replies_matched[PROTOCOL_COUNT];  // w tym przekazane serwerom
+  unsigned long other;
+};
+
+/* Program `opoznienia` bez sieci: serwery, klient i serwer mDNS oraz
+ * demultipleksacja odpowiedzi, zasilane pakietami z nagrania. */
+class Replay {
+public:
+  Replay(bool ssh, uint32_t local, std::string const& host_name) :
+      udp_socket(new udp::socket(io_service)),      // nieotwarte - pomiary
+      icmp_socket(new icmp::socket(io_service)),    //   nie są wysyłane
+      context(io_service, udp_socket, icmp_socket,
+          ProbeScheduleConfig{MEASUREMENT_INTERVAL_DEFAULT, false, std::vector<ProbeClass>()}),
+      servers(new servers_map),
+      mdns_transport(io_service, true),
+      mdns_server(io_service, mdns_transport, ssh),
+      mdns_client(io_service, mdns_transport, servers, context, MDNS_INTERVAL_DEFAULT),
+      local(local),
+      client_port(0),
+      last_poll(0),
+      stats() {
+    mdns_server.set_identity(host_name, local);
+  }
+
+  /* Obsługuje pakiet 'packet' w chwili jego znacznika czasu. */
+  void feed(CapturedPacket const& packet) {
+    virtual_time_usec() = packet.time;
+    if (packet.time >= last_poll + REPLAY_POLL_USEC) {
+      io_service.poll();
+      last_poll = packet.time;
+    }
+    stats.packets++;
+    stats.bytes += packet.length;
+
+    ParsedPacket parsed;
+    if (!parse_packet(packet, parsed))
+      stats.other++;
+    else if (parsed.protocol == IP_PROTOCOL_UDP)
+      feed_udp(parsed, get_time_nsec());
+    else
+      feed_icmp(parsed, packet, get_time_nsec());
+  }
+
+  /* Kończy odtwarzanie w chwili 'end_time': wykonuje liczniki czasu, których
+   * czas minął, i wyłącza serwery, których TTL minął. */
+  void finish(time_type end_time) {
+    virtual_time_usec() = end_time;
+    io_service.poll();
+    for (auto it = servers->begin(); it != servers->end(); ++it)
+      it->second.expire(get_time_nsec());
+  }
+
+  void report(std::ostream& os, double seconds) {
+    os << std::fixed << std::setprecision(3);
+    os << "Replayed " << stats.packets << " packets (" << stats.bytes << " B) in " << seconds
+        << " s: " << std::setprecision(0) << stats.packets / seconds << " packets/s, "
+        << std::setprecision(3) << stats.bytes / seconds / 1e6 << " MB/s\n";
+    os << "mDNS packets " << stats.mdns << ", other " << stats.other << "\n";
+    for (int proto = 0; proto < PROTOCOL_COUNT; proto++) {
+      os << EnabledProbes::name(proto) << " probes " << stats.probes_sent[proto] << ", replies "
+          << stats.replies[proto] << " (" << stats.replies_matched[proto] << " matched)\n";
+    }
+    MdnsServerStats const& mdns = mdns_server.get_stats();
+    os << "mDNS responder: answers " << mdns.answers_sent << " (" << mdns.unicast_answers
+        << " unicast), rate limited " << mdns.rate_limited << ", duplicates suppressed "
+        << mdns.duplicates_suppressed << "\n";
+
+    os << "Hosts: " << servers->size() << "\n" << std::left << std::setw(IP_WIDTH + 1) << "address";
+    for (int proto = 0; proto < PROTOCOL_COUNT; proto++)
+      os << std::setw(10) << (std::string(EnabledProbes::name(proto)) + " ms");
+    os << "services\n";
+    for (auto it = servers->begin(); it != servers->end(); ++it) {
+      HostStats host = it->second.host_stats();
+      os << std::setw(IP_WIDTH + 1) << it->first.to_string();
+      for (int proto = 0; proto < PROTOCOL_COUNT; proto++) {
+        std::ostringstream delay;
+        if (host.delay_sec[proto] < 0)
+          delay << "---";
+        else
+          delay << std::fixed << std::setprecision(3) << host.delay_sec[proto] * 1000;
+        os << std::setw(10) << delay.str();
+      }
+      std::string services;
+      for (int proto = 0; proto < PROTOCOL_COUNT; proto++) {
+        if (it->second.measures(proto))
+          services += (services.empty() ? "" : ",") + std::string(EnabledProbes::name(proto));
+      }
+      os << (services.empty() ? "expired" : services) << "\n";
+    }
+    os << std::right;
+  }
+
+private:
+  void feed_udp(ParsedPacket const& parsed, time_type time) {
+    char const* payload = reinterpret_cast<char const*>(parsed.payload);
+    if (parsed.destination_port == MDNS_PORT) {
+      /* multicast (także nasz własny) odbierają serwer i klient mDNS: */
+      stats.mdns++;
+      if (parsed.source == local && parsed.payload_length > 2 && !(parsed.payload[2] & 0x80))
+        client_port = parsed.source_port;     // nasze pytanie (bit QR = 0)
+      mdns_transport.receive_packet(payload, parsed.payload_length,
+          udp::endpoint(address_v4(parsed.source), parsed.source_port));
+    } else if (parsed.destination == local && client_port && parsed.destination_port == client_port) {
+      stats.mdns++;     // odpowiedź unicastowa (QU) na port, z którego pyta klient
+      mdns_transport.receive_packet(payload, parsed.payload_length,
+          udp::endpoint(address_v4(parsed.source), parsed.source_port));
+    } else if (parsed.payload_length < sizeof(uint64_t)) {
+      stats.other++;
+    } else if (parsed.source == local) {
+      int protocol = EnabledProbes::find(ProbeTransport::UDP, parsed.destination_port);
+      if (protocol >= 0)
+        probe_sent(protocol, parsed.destination, read_be64(parsed.payload), time);
+      else
+        stats.other++;
+    } else if (parsed.destination == local
+        && EnabledProbes::find(ProbeTransport::UDP, parsed.source_port) >= 0) {
+      int protocol = EnabledProbes::find(ProbeTransport::UDP, parsed.source_port);
+      stats.replies[protocol]++;
+      udp::endpoint sender(address_v4(parsed.source), parsed.source_port);
+      if (MeasurementClient::dispatch_udp_reply(*servers, sender, read_be64(parsed.payload), time))
+        stats.replies_matched[protocol]++;
+    } else {
+      stats.other++;
+    }
+  }
+
+  void feed_icmp(ParsedPacket const& parsed, CapturedPacket const& packet, time_type time) {
+    unsigned char const* icmp = parsed.payload;
+    if (PROTOCOL::ICMP < 0 || parsed.payload_length < 8) {
+      stats.other++;
+    } else if (parsed.source == local && icmp[0] == icmp_header::echo_request
+        && icmp[4] == 0 && icmp[5] == 0) {     // nasz identyfikator
+      probe_sent(PROTOCOL::ICMP, parsed.destination, read_be16(icmp + 6), time);
+    } else if (parsed.destination == local && icmp[0] == icmp_header::echo_reply) {
+      stats.replies[PROTOCOL::ICMP]++;
+      if (MeasurementClient::dispatch_icmp_reply(*servers, packet.data, packet.length, time))
+        stats.replies_matched[PROTOCOL::ICMP]++;
+    } else {
+      stats.other++;
+    }
+  }
+
+  /* Zapamiętuje nasz pomiar 'id' typu 'protocol' wysłany do 'destination'. */
+  void probe_sent(int protocol, uint32_t destination, time_type id, time_type time) {
+    auto it = servers->find(address_v4(destination));
+    if (it == servers->end())
+      return;           // serwer jeszcze niewykryty w nagraniu
+    it->second.probe_started(protocol, id, time);
+    stats.probes_sent[protocol]++;
+  }
+
+
+  boost::asio::io_service io_service;
+  std::shared_ptr<udp::socket> udp_socket;
+  std::shared_ptr<icmp::socket> icmp_socket;
+  ProbeContext context;
+  servers_ptr servers;
+  MdnsTransport mdns_transport;
+  MdnsServer mdns_server;
+  MdnsClient mdns_client;
+  uint32_t local;               // adres nagrywającego komputera
+  uint16_t client_port;         // port, z którego pyta klient mDNS (z nagrania)
+  time_type last_poll;          // czas ostatniej obsługi liczników
+  ReplayStats stats;
+};
+
+
+void parse_arguments(int argc, char const *argv[], ReplayConfig& config) {
+  for (int arg = 1; arg < argc; ++arg) {
+    if (strcmp(argv[arg], "-r") == 0) {
+      config.recorded_speed = true;
+    } else if (strcmp(argv[arg], "-s") == 0) {
+      config.ssh = true;
+    } else if (arg == argc - 1) {
+      config.path = argv[arg];
+    } else {
+      std::string value(argv[arg + 1]);
+      if (strcmp(argv[arg], "-a") == 0)      config.local_address = value;
+      else if (strcmp(argv[arg], "-n") == 0) config.host_name = value;
+      else if (strcmp(argv[arg], "-l") == 0) config.loops = std::stoi(value);
+      else throw std::invalid_argument("unkown argument type");
+      arg++;
+    }
+  }
+  if (config.path.empty())
+    throw std::invalid_argument("missing pcap file");
+  if (config.loops <= 0)
+    throw std::invalid_argument("non-positive loop count");
+}
+
+int main(int argc, char const *argv[]) {
+  ReplayConfig config;
+  try {
+    parse_arguments(argc, argv, config);
+  } catch (std::logic_error const& e) {
+    std::cerr << "Error parsing arguments: " << e.what() << "\n";
+    return 1;
+  }
+
+  try {
+    PcapFile file(config.path);
+    uint32_t local = config.local_address.empty() ? detect_local_address(file)
+        : address_v4::from_string(config.local_address).to_ulong();
+    std::string host_name = config.host_name.empty() ? detect_host_name(file, local) : config.host_name;
+    if (host_name.empty())
+      std::cerr << "Host name not found in capture, the mDNS responder answers nothing (use -n)\n";
+    std::cout << "Replaying " << config.path << " as " << address_v4(local) << " ("
+        << host_name << ")" << std::endl;
+
+    CapturedPacket packet;
+    file.rewind();
+    if (!file.next(packet)) {
+      std::cerr << "No IPv4 packets in capture\n";
+      return 1;
+    }
+    time_type first_time = packet.time;
+    time_type last_time = first_time;
+    while (file.next(packet))
+      last_time = packet.time;
+    time_type loop_shift = last_time - first_time + SEC_TO_USEC;   // przesunięcie kolejnych powtórzeń
+
+    virtual_time_usec() = first_time;
+    Replay replay(config.ssh, local, host_name);
+    auto start = std::chrono::steady_clock::now();
+    for (int loop = 0; loop < config.loops; loop++) {
+      file.rewind();
+      while (file.next(packet)) {
+        packet.time += loop * loop_shift;
+        if (config.recorded_speed)
+          std::this_thread::sleep_until(start + std::chrono::microseconds(packet.time - first_time));
+        replay.feed(packet);
+      }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    replay.finish(last_time + (config.loops - 1) * loop_shift);
+
+    replay.report(std::cout, seconds);
+    if (file.get_skipped())
+      std::cout << "Skipped " << file.get_skipped() << " non-IPv4 packets per loop\n";
+  } catch (std::exception const& e) {
+    std::cerr << "Replay failed: " << e.what() << "\n";
+    return 1;
+  }
+  return 0;
+}
@@ -4,37 +4,100 @@
 #include <sstream>
 #include "common.h"
 #include "server.h"
+#include "stats_publisher.h"
+
+const int ROLLUP_TREND_PERCENT = 20;       // UI: zmiana średniej względem ostatniej godziny
 
 /* Klasa zawierająca napis, który wyswietlany jest klientowi telnetu. */
 class PrintServer {
 public:
-  PrintServer(Server const& server, float max_delay) :
+  PrintServer(HostStats const& server, float max_delay) :
       average_delay(0), to_print(construct_string(server, max_delay)) {}
 
+  /* Wiersz macierzy floty: liczba zmierzonych węzłów, średnie i maksymalne
+   * opóźnienie, rozmieszczone tak jak opóźnienia serwera. */
+  PrintServer(MatrixRowStats const& row, float max_delay) :
+      average_delay(row.mean_delay_sec) {
+    std::ostringstream numbers_stream;
+    numbers_stream << ' ' << row.measured << ' ' << row.mean_delay_sec << ' ' << row.max_delay_sec;
+    to_print = place_numbers(row.origin, numbers_stream.str(), max_delay);
+  }
+
+  /* Wiersz listy alarmów. */
+  PrintServer(LatencyAlert const& alert) : average_delay(0), to_print(alert.to_text()) {
+    to_print.resize(UI_SCREEN_WIDTH, ' ');
+  }
+
+  /* Zwraca średnie opóźnienie wszystkich protokołów w sekundach
+   * (a bez pomiarów - przewidziane ze współrzędnych). */
+  static float delay_sec(HostStats const& server) {
+    float result = 0;
+    short proto_cnt = 0; // liczba protokołów z pomiarami
+    for (int proto = 0; proto < PROTOCOL_COUNT; proto++) {
+      if (server.delay_sec[proto] >= 0) {
+        result += server.delay_sec[proto];
+        proto_cnt++;
+      }
+    }
+    return proto_cnt ? result / proto_cnt : std::max(server.predicted_sec, 0.0f);
+  }
+
   /* Zwraca napis długości 80 z rozmieszeniem opóźnień (w sekundach!)
    * proporcjonalnym do średniego opóźnienia (względem opóźnienia 'max_delay'). */
-  std::string construct_string(Server const& server, float max_delay) {
+  std::string construct_string(HostStats const& server, float max_delay) {
     std::ostringstream numbers_stream;
     float delay;          // opóźnienie w sekundach
     int proto_cnt = 0;    // liczba protokołów uwzględnianych do średniej
-    int last_char;
 
     /* Konstruujemy liczby oznaczające kolejne opóźnienia: */
-    for (int proto = PROTOCOL::UDP; proto < PROTOCOL_COUNT; proto++) {
-      if (server.finished[proto].empty()) {
+    for (int proto = 0; proto < PROTOCOL_COUNT; proto++) {
+      if (server.delay_sec[proto] < 0) {
         numbers_stream << " ---";
       } else {
-        delay = (float) server.delays_sum[proto] / server.finished[proto].size() / SEC_TO_USEC;
+        delay = server.delay_sec[proto];
         average_delay += delay;
         proto_cnt++;
         numbers_stream << ' ' << delay;
       }
     }
-    average_delay = proto_cnt ? average_delay / proto_cnt : 0;
+    average_delay = proto_cnt ? average_delay / proto_cnt : std::max(server.predicted_sec, 0.0f);
+
+    /* trend: zmiana pierwszego mierzonego opóźnienia względem średniej z ostatniej godziny */
+    std::ostringstream trend_stream;
+    for (int proto = 0; proto < PROTOCOL_COUNT; proto++) {
+      if (server.delay_sec[proto] < 0)
+        continue;
+      if (server.hour_delay_sec[proto] > 0) {
+        int change = std::lround((server.delay_sec[proto] / server.hour_delay_sec[proto] - 1) * 100);
+        if (std::abs(change) >= ROLLUP_TREND_PERCENT)
+          trend_stream << ' ' << std::showpos << change << std::noshowpos << "%/1h";
+      }
+      break;
+    }
 
-    std::string numbers(numbers_stream.str());
-    std::string ip(server.ip->to_v4().to_string());
+    /* przewidywanie ze współrzędnych z błędem, osobno od pomiarów: */
+    std::ostringstream prediction_stream;
+    if (server.predicted_sec >= 0)
+      prediction_stream << " ~" << server.predicted_sec << "+-" << server.predicted_error_sec;
+
+    /* trend pomijamy, jeśli razem z przewidywaniem nie mieści się w wierszu: */
+    std::string numbers = numbers_stream.str();
+    std::string trend = trend_stream.str();
+    std::string prediction = prediction_stream.str();
+    if (IP_WIDTH + numbers.size() + trend.size() + prediction.size() <= UI_SCREEN_WIDTH)
+      numbers += trend;
+    return place_numbers(server.ip, numbers + prediction, max_delay);
+  }
+
+  /* Zwraca napis długości 80: adres 'ip' i liczby 'numbers' przesunięte
+   * proporcjonalnie do 'average_delay' (względem 'max_delay'). Liczby, które
+   * nie mieszczą się w wierszu, są obcinane. */
+  std::string place_numbers(uint32_t ip_value, std::string numbers, float max_delay) {
+    int last_char;
+    std::string ip(boost::asio::ip::address_v4(ip_value).to_string());
     ip = ip + std::string(IP_WIDTH - ip.size(), ' ');   // wyrównanie IP
+    if (numbers.size() > UI_SCREEN_WIDTH - ip.size())
+      numbers.resize(UI_SCREEN_WIDTH - ip.size());
 
     /* zwykłe wypisanie: */
     if (max_delay == 0)
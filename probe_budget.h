@@ -0,0 +1,155 @@
+#ifndef PROBE_BUDGET_H
+#define PROBE_BUDGET_H
+
+#include <algorithm>
+#include <deque>
+#include <iostream>
+#include "common.h"
+#include "clock_source.h"
+#include "server.h"
+
+const float PROBE_BUDGET_BURST_SEC = 0.1;  // pojemność wiadra budżetu (w sekundach budżetu)
+const float PROBE_BUDGET_QUANTUM = 3;      // kwant DRR w pakietach
+const int PROBE_BUDGET_REPORT_INTERVAL = 60;  // co ile sekund wypisywać statystyki budżetu
+
+/* Statystyki budżetu pomiarów. */
+struct ProbeBudgetStats {
+  unsigned long sent;         // wysłane pomiary
+  unsigned long deferred;     // rundy, w których pomiar wciąż czekał w kolejce
+  unsigned long backlog;      // pomiary czekające w kolejce
+  float utilization;          // wykorzystanie budżetu od ostatniego odczytu (0..1)
+};
+
+/* Globalny budżet pakietów pomiarowych na sekundę (opcja -b).
+ *
+ * Pomiary, na które przyszła pora według harmonogramu, trafiają do kolejek
+ * osobnych dla każdego protokołu (każdy serwer co najwyżej raz w kolejce).
+ * Kolejki są obsługiwane algorytmem deficit round robin, gdzie kosztem
+ * pomiaru jest liczba pakietów, jaką wysyła (TCP: SYN, ACK i zamknięcie).
+ * Wysłanie pakietu zużywa żeton z wiadra napełnianego z szybkością budżetu.
+ * Gdy budżetu brakuje, kolejki się wydłużają, a faktyczny odstęp pomiarów
+ * każdego serwera rośnie równo dla wszystkich. */
+class ProbeBudget {
+public:
+  ProbeBudget(float rate) :
+      rate(rate),
+      burst(std::max((float) EnabledProbes::max_packets(), rate * PROBE_BUDGET_BURST_SEC)),
+      tokens(burst),
+      last_refill(get_time_nsec()),
+      current(0),
+      credited(false),
+      sent(0),
+      deferred(0),
+      window_sent(0),
+      window_start(last_refill) {
+    for (int proto = 0; proto < PROTOCOL_COUNT; proto++)
+      deficit[proto] = 0;
+  }
+
+  /* Czy budżet jest ograniczony (0 - bez ograniczeń). */
+  bool enabled() const { return rate > 0; }
+
+  /* Dodaje do kolejki pomiary protokołów z maski 'protocols' serwera 'server'. */
+  void enqueue(Server& server, int protocols) {
+    for (int proto = 0; proto < PROTOCOL_COUNT; proto++) {
+      if (!(protocols & (1 << proto)))
+        continue;
+      if (server.mark_queued(proto))
+        queues[proto].push_back(&server);
+      else
+        deferred++;       // poprzedni pomiar jeszcze nie został wysłany
+    }
+  }
+
+  /* Wysyła z kolejek tyle pomiarów, na ile pozwala budżet. */
+  void send() {
+    refill();
+    while (!queues_empty()) {
+      std::deque<Server*>& queue = queues[current];
+      if (!queue.empty() && !credited) {
+        deficit[current] += PROBE_BUDGET_QUANTUM;
+        credited = true;
+      }
+      while (!queue.empty() && deficit[current] >= cost(current)) {
+        if (tokens < cost(current))
+          return;     // czekamy na żetony - ta kolejka zostaje obsługiwana
+        Server* server = queue.front();
+        queue.pop_front();
+        server->clear_queued(current);
+        if (server->measures(current)) {    // wpis mógł się przedawnić w kolejce
+          server->send_query(current);
+          deficit[current] -= cost(current);
+          tokens -= cost(current);
+          sent++;
+          window_sent += cost(current);
+        }
+      }
+      if (queue.empty())
+        deficit[current] = 0;
+      current = (current + 1) % PROTOCOL_COUNT;
+      credited = false;
+    }
+  }
+
+  /* Wypisuje statystyki budżetu (i rozpoczyna nowe okno, jak get_stats). */
+  void report(std::ostream& os) {
+    ProbeBudgetStats stats = get_stats();
+    os << "Probe budget " << rate << " pkt/s: utilization " << stats.utilization * 100
+        << "%, sent " << stats.sent << ", deferred " << stats.deferred
+        << ", backlog " << stats.backlog << std::endl;
+  }
+
+  /* Zwraca statystyki i rozpoczyna nowe okno liczenia wykorzystania. */
+  ProbeBudgetStats get_stats() {
+    time_type now = get_time_nsec();
+    ProbeBudgetStats stats;
+    stats.sent = sent;
+    stats.deferred = deferred;
+    stats.backlog = 0;
+    for (int proto = 0; proto < PROTOCOL_COUNT; proto++)
+      stats.backlog += queues[proto].size();
+    float window_sec = (float) (now - window_start) / SEC_TO_NSEC;
+    stats.utilization = window_sec > 0 ? window_sent / (rate * window_sec) : 0;
+    window_sent = 0;
+    window_start = now;
+    return stats;
+  }
+
+private:
+  /* Liczba pakietów wysyłanych przez pomiar typu 'protocol'. */
+  static float cost(int protocol) {
+    return EnabledProbes::packets(protocol);
+  }
+
+  bool queues_empty() const {
+    for (int proto = 0; proto < PROTOCOL_COUNT; proto++) {
+      if (!queues[proto].empty())
+        return false;
+    }
+    return true;
+  }
+
+  void refill() {
+    time_type now = get_time_nsec();
+    tokens = std::min(burst, tokens + rate * (now - last_refill) / SEC_TO_NSEC);
+    last_refill = now;
+  }
+
+
+  float rate;                 // budżet w pakietach na sekundę
+  float burst;                // pojemność wiadra
+  float tokens;
+  time_type last_refill;
+
+  std::deque<Server*> queues[PROTOCOL_COUNT];
+  float deficit[PROTOCOL_COUNT];
+  int current;                // obsługiwana kolejka
+  bool credited;              // czy obsługiwana kolejka dostała już kwant w tej wizycie
+
+  unsigned long sent;
+  unsigned long deferred;
+  float window_sent;          // pakiety wysłane w bieżącym oknie
+  time_type window_start;
+};
+
+#endif  // PROBE_BUDGET_H
@@ -0,0 +1,237 @@
+#ifndef PROBE_CONTEXT_H
+#define PROBE_CONTEXT_H
+
+#include <atomic>
+#include <iostream>
+#include <sstream>
+#include <functional>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <linux/filter.h>
+#include <linux/sock_diag.h>
+#include <boost/asio.hpp>
+#include <endian.h>
+#include "common.h"
+#include "probe_schedule.h"
+#include "change_detector.h"
+
+/* ze strony http://www.boost.org/doc/libs/1_58_0/doc/html/boost_asio/examples/cpp03_examples.html */
+#include "icmp_header.hpp"
+
+using boost::asio::ip::udp;
+using boost::asio::ip::icmp;
+
+const uint16_t ICMP_IDENTIFIER = 0;      // identyfikator naszych pakietów ICMP Echo
+
+/* Transport w pamięci zastępujący gniazda (symulacja): dostaje każdy wysyłany
+ * pakiet - protokół IP (IPPROTO_UDP, IPPROTO_ICMP), adres i port docelowy
+ * oraz dane (dla ICMP: nagłówek ICMP i treść). Zwraca false, jeśli pakietu
+ * nie udało się wysłać. */
+typedef std::function<bool(int, boost::asio::ip::address_v4 const&, uint16_t,
+    unsigned char const*, std::size_t)> packet_sink;
+
+/* Stan pomiarów wspólny dla wszystkich serwerów wątku pomiarów: gniazda,
+ * jeden bufor wysyłania, gotowy szablon pakietu ICMP Echo Request,
+ * harmonogram pomiarów i wykrywanie zmian opóźnień (z kolejką alarmów).
+ *
+ * Pakiety pomiarowe wysyłane są synchronicznie przez nieblokujące gniazda
+ * (jądro kopiuje datagram przy wywołaniu), więc bufor może zostać użyty
+ * ponownie od razu i nie musi istnieć osobno dla każdego serwera. Pakiet,
+ * którego nie da się wysłać bez blokowania, jest pomijany.
+ *
+ * Gniazdo ICMP dostaje od jądra kopię każdego pakietu ICMP adresowanego do
+ * komputera, więc ma dołączony filtr BPF, który przepuszcza tylko Echo Reply
+ * z naszym identyfikatorem - pozostałe pakiety nie są kopiowane do programu. */
+class ProbeContext {
+public:
+  ProbeContext(boost::asio::io_service& io_service,
+      std::shared_ptr<udp::socket> udp_socket, std::shared_ptr<icmp::socket> icmp_socket,
+      ProbeScheduleConfig const& schedule_config) :
+          io_service(io_service),
+          udp_socket(udp_socket),
+          icmp_socket(icmp_socket),
+          schedule(schedule_config),
+          icmp_length(build_icmp_template()),
+          failed_sends(0),
+          icmp_filtered(false),
+          icmp_received(0),
+          icmp_rejected(0) {
+    /* przy odtwarzaniu nagrań gniazda nie są otwierane (wysyłanie się nie udaje): */
+    if (udp_socket->is_open())
+      udp_socket->non_blocking(true);
+    if (icmp_socket->is_open()) {
+      icmp_socket->non_blocking(true);
+      attach_icmp_filter();
+    }
+  }
+
+  boost::asio::io_service& get_io_service() { return io_service; }
+
+  ProbeSchedule const& get_schedule() const { return schedule; }
+
+  ChangeDetector& get_detector() { return detector; }
+  ChangeDetector const& get_detector() const { return detector; }
+
+  /* Kieruje pakiety pomiarowe do 'sink' zamiast do gniazd. */
+  void set_packet_sink(packet_sink const& new_sink) { sink = new_sink; }
+
+  /* Liczba pakietów pomiarowych, których nie udało się wysłać. */
+  unsigned long get_failed_sends() const { return failed_sends; }
+
+  /* Zlicza pakiet odebrany z gniazda ICMP ('accepted' - odpowiedź na nasz
+   * pomiar od znanego serwera). Wywoływane także z wątku odbierającego. */
+  void count_icmp(bool accepted) {
+    icmp_received.fetch_add(1, std::memory_order_relaxed);
+    if (!accepted)
+      icmp_rejected.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  /* Wypisuje statystyki gniazda ICMP: odebrane pakiety, odrzucone przez
+   * program i porzucone przez jądro (przepełniona kolejka gniazda). */
+  void report_icmp(std::ostream& os) const {
+    os << "ICMP socket (BPF filter " << (icmp_filtered ? "on" : "off") << "): received "
+        << icmp_received.load() << ", rejected in userspace " << icmp_rejected.load()
+        << ", kernel drops " << icmp_kernel_drops() << "\n" << std::flush;
+  }
+
+  /* Wysyła pakiet UDP z czasem 'send_time' - zgodnie z protokołem serwera
+   * pomiaru czasu są to mikrosekundy zegara ściennego klienta. Zwraca false,
+   * jeśli się nie udało. */
+  bool send_udp_probe(udp::endpoint const& endpoint, time_type send_time) {
+    uint64_t be_start_time = htobe64(send_time);
+    if (sink) {
+      return check_send(sink(IPPROTO_UDP, endpoint.address().to_v4(), endpoint.port(),
+          reinterpret_cast<unsigned char const*>(&be_start_time), sizeof(be_start_time)));
+    }
+    boost::system::error_code error;
+    udp_socket->send_to(boost::asio::buffer(&be_start_time, sizeof(be_start_time)),
+        endpoint, 0, error);
+    return check_send(error);
+  }
+
+  /* Wysyła ICMP Echo Request o numerze sekwencyjnym 'sequence_number'.
+   * W szablonie zmieniają się tylko numer sekwencyjny i suma kontrolna,
+   * poprawiana przyrostowo względem poprzednio wysłanego pakietu. */
+  bool send_icmp_probe(icmp::endpoint const& endpoint, uint16_t sequence_number) {
+    uint16_t old_sequence = (icmp_packet[6] << 8) | icmp_packet[7];
+    uint16_t old_checksum = (icmp_packet[2] << 8) | icmp_packet[3];
+    uint16_t checksum = update_checksum(old_checksum, old_sequence, sequence_number);
+    icmp_packet[2] = checksum >> 8;
+    icmp_packet[3] = checksum & 0xFF;
+    icmp_packet[6] = sequence_number >> 8;
+    icmp_packet[7] = sequence_number & 0xFF;
+
+    if (sink)
+      return check_send(sink(IPPROTO_ICMP, endpoint.address().to_v4(), 0, icmp_packet, icmp_length));
+    boost::system::error_code error;
+    icmp_socket->send_to(boost::asio::buffer(icmp_packet, icmp_length), endpoint, 0, error);
+    return check_send(error);
+  }
+
+  /* Sprawdza, czy pakiet IP 'packet' długości 'length' (odebrany z gniazda ICMP)
+   * jest odpowiedzią Echo Reply na nasz pakiet, i odczytuje z niego adres
+   * nadawcy oraz numer sekwencyjny. */
+  static bool parse_echo_reply(unsigned char const* packet, std::size_t length,
+      uint32_t& source, uint16_t& sequence_number) {
+    if (length < 20)
+      return false;
+    std::size_t ip_header_length = (packet[0] & 0x0F) * 4;
+    unsigned char const* icmp = packet + ip_header_length;
+    if (length < ip_header_length + 8 || icmp[0] != icmp_header::echo_reply
+        || ((icmp[4] << 8) | icmp[5]) != ICMP_IDENTIFIER)     // typ i identyfikator
+      return false;
+    source = (packet[12] << 24) | (packet[13] << 16) | (packet[14] << 8) | packet[15];
+    sequence_number = (icmp[6] << 8) | icmp[7];
+    return true;
+  }
+
+private:
+  /* Dołącza do gniazda ICMP filtr przepuszczający tylko Echo Reply
+   * z identyfikatorem ICMP_IDENTIFIER. Filtr dostaje pakiet od nagłówka IP. */
+  void attach_icmp_filter() {
+    sock_filter code[] = {
+      BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, 0),       // X = długość nagłówka IP
+      BPF_STMT(BPF_LD | BPF_B | BPF_IND, 0),        // typ ICMP
+      BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, icmp_header::echo_reply, 0, 3),
+      BPF_STMT(BPF_LD | BPF_H | BPF_IND, 4),        // identyfikator
+      BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ICMP_IDENTIFIER, 0, 1),
+      BPF_STMT(BPF_RET | BPF_K, 0xFFFFFFFF),        // cały pakiet do gniazda
+      BPF_STMT(BPF_RET | BPF_K, 0),                 // odrzucony
+    };
+    sock_fprog program = {sizeof(code) / sizeof(code[0]), code};
+    icmp_filtered = setsockopt(icmp_socket->native_handle(), SOL_SOCKET, SO_ATTACH_FILTER,
+        &program, sizeof(program)) == 0;
+    if (!icmp_filtered)
+      std::cerr << "Cannot attach BPF filter to ICMP socket, filtering in userspace\n";
+  }
+
+  /* Pakiety porzucone przez jądro w kolejce gniazda ICMP (SO_MEMINFO). */
+  unsigned long icmp_kernel_drops() const {
+    uint32_t meminfo[SK_MEMINFO_VARS];
+    socklen_t length = sizeof(meminfo);
+    if (!icmp_socket->is_open() || getsockopt(icmp_socket->native_handle(), SOL_SOCKET,
+        SO_MEMINFO, meminfo, &length) != 0 || length <= SK_MEMINFO_DROPS * sizeof(uint32_t))
+      return 0;
+    return meminfo[SK_MEMINFO_DROPS];
+  }
+
+  /* Buduje szablon pakietu ICMP (nagłówek z numerem sekwencyjnym 0 i pełną
+   * sumą kontrolną oraz treść) i zwraca jego długość. */
+  std::size_t build_icmp_template() {
+    icmp_header header;
+    header.type(icmp_header::echo_request);
+    header.identifier(ICMP_IDENTIFIER);
+    std::string message(even_decimal_to_bcd(ICMP_MESSAGE));
+    compute_checksum(header, message.begin(), message.end());
+    std::ostringstream packet;
+    packet << header << message;
+    std::string bytes(packet.str());
+    std::copy(bytes.begin(), bytes.end(), icmp_packet);
+    return bytes.size();
+  }
+
+  bool check_send(boost::system::error_code const& error) {
+    return check_send(!error);
+  }
+
+  bool check_send(bool sent) {
+    if (!sent)
+      failed_sends++;
+    return sent;
+  }
+
+  /* Suma kontrolna po zmianie 16-bitowego pola z 'old_field' na 'new_field'
+   * (RFC 1624, równanie 3: HC' = ~(~HC + ~m + m')). */
+  static uint16_t update_checksum(uint16_t checksum, uint16_t old_field, uint16_t new_field) {
+    uint32_t sum = static_cast<uint16_t>(~checksum) + static_cast<uint16_t>(~old_field) + new_field;
+    sum = (sum >> 16) + (sum & 0xFFFF);
+    sum += (sum >> 16);
+    return ~sum;
+  }
+
+  /* Konwertuje liczbę w zapisie 10 o parzystej liczbie cyfr do systemu BCD. */
+  static std::string even_decimal_to_bcd(std::string const& decimal) {
+    std::string result(decimal.size() / 2, '\0');
+    for (int i = 0; i < decimal.size(); i++)
+      result[i / 2] += ((decimal[i] - '0') & 0x0F) << (i % 2 ? 0 : 4);  // shift parzystych
+    return result;
+  }
+
+
+  boost::asio::io_service& io_service;
+  std::shared_ptr<udp::socket>  udp_socket;  // gniazdo używane do wszystkich pakietów UDP
+  std::shared_ptr<icmp::socket> icmp_socket; // gniazdo używane do wszystkich pakietów ICMP
+  ProbeSchedule schedule;
+  ChangeDetector detector;
+  packet_sink sink;                          // transport w pamięci (pusty - gniazda)
+
+  unsigned char icmp_packet[BUFFER_SIZE];    // szablon i zarazem bufor wysyłania ICMP
+  std::size_t icmp_length;
+  unsigned long failed_sends;
+
+  bool icmp_filtered;                         // czy filtr BPF jest dołączony
+  std::atomic<unsigned long> icmp_received;  // pakiety odebrane z gniazda ICMP
+  std::atomic<unsigned long> icmp_rejected;  //   i odrzucone przez program
+};
+
+#endif  // PROBE_CONTEXT_H
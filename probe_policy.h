@@ -0,0 +1,259 @@
+#ifndef PROBE_POLICY_H
+#define PROBE_POLICY_H
+
+#include <algorithm>
+#include <iterator>
+#include <list>
+#include <tuple>
+#include <type_traits>
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include "common.h"
+#include "clock_source.h"
+#include "handler_allocator.h"
+
+using boost::asio::ip::udp;
+using boost::asio::ip::tcp;
+using boost::asio::ip::icmp;
+
+/* Usługa ogłaszana przez mDNS, która włącza pomiary danego typu. */
+enum class ProbeService { OPOZNIENIA, SSH, ANY };
+
+/* Rodzaj odpowiedzi, po którym MeasurementClient rozpoznaje typ pomiaru. */
+enum class ProbeTransport { UDP, TCP, ICMP };
+
+/* Typy pomiarów (polityki). Każdy typ opisuje w czasie kompilacji:
+ *  - transport, port, usługę mDNS, nazwę i liczbę pakietów pomiaru,
+ *  - State - swój stan przechowywany w każdym serwerze,
+ *  - send<Index>(owner, state, start_time) - wysłanie pomiaru; typ zgłasza
+ *    właścicielowi (Server) pomiar wysłany (probe_started), a pomiary
+ *    kończone asynchronicznie - także ukończone i zgubione
+ *    (probe_finished, probe_lost),
+ *  - reset(state) - zwolnienie zasobów, gdy wpis serwera się przedawnia.
+ * Index to numer typu na liście EnabledProbes, pod którym są jego statystyki. */
+
+/* Pomiar UDP: 8 bajtów czasu wysłania odsyłanych z portu 'Port' (przez
+ * MeasurementServer albo usługę echo z RFC 862). Zgodnie z protokołem jest to
+ * czas ścienny w us - służy tylko jako identyfikator pomiaru, a opóźnienie
+ * liczymy od 'start_time' zegara pomiarowego (ns). */
+template <uint16_t Port = UDP_PORT_DEFAULT, ProbeService Service = ProbeService::OPOZNIENIA>
+struct UdpEchoProbe {
+  static const ProbeTransport transport = ProbeTransport::UDP;
+  static const uint16_t port = Port;
+  static const ProbeService service = Service;
+  static const int packets = 1;
+  static char const* name() { return "UDP"; }
+
+  struct State {};
+
+  template <int Index, typename Owner>
+  static void send(Owner& owner, State&, time_type start_time) {
+    time_type send_time = get_time_usec();
+    if (owner.probe_context().send_udp_probe(udp::endpoint(owner.address(), Port), send_time))
+      owner.probe_started(Index, send_time, start_time);
+  }
+
+  static void reset(State&) {}
+};
+
+/* Pomiar ICMP Echo z numerem sekwencyjnym jako identyfikatorem. */
+struct IcmpEchoProbe {
+  static const ProbeTransport transport = ProbeTransport::ICMP;
+  static const uint16_t port = 0;
+  static const ProbeService service = ProbeService::OPOZNIENIA;
+  static const int packets = 1;
+  static char const* name() { return "ICMP"; }
+
+  struct State {
+    State() : sequence(0) {}
+    uint16_t sequence;        // numer sekwencyjny (16 bitów jak w nagłówku)
+  };
+
+  template <int Index, typename Owner>
+  static void send(Owner& owner, State& state, time_type start_time) {
+    ++state.sequence;
+    if (owner.probe_context().send_icmp_probe(icmp::endpoint(owner.address(), 0), state.sequence))
+      owner.probe_started(Index, state.sequence, start_time);
+  }
+
+  static void reset(State&) {}
+};
+
+/* Pomiar czasu nawiązania połączenia TCP na port 'Port' (0 - port podany
+ * serwerowi, domyślnie ssh). Wysyła SYN, ACK i zamknięcie. Gniazda
+ * i pamięć handlerów MAX_DELAYED_QUERIES ostatnich pomiarów tworzone są
+ * raz (przy pierwszych pomiarach serwera) i używane cyklicznie - nowy pomiar
+ * zamyka i otwiera ponownie gniazdo najstarszego, więc w stanie ustalonym
+ * pomiar nie alokuje pamięci. */
+template <uint16_t Port = 0, ProbeService Service = ProbeService::SSH>
+struct TcpConnectProbe {
+  static const ProbeTransport transport = ProbeTransport::TCP;
+  static const uint16_t port = Port;
+  static const ProbeService service = Service;
+  static const int packets = 3;
+  static char const* name() { return "TCP"; }
+
+  /* Gniazdo jednego pomiaru z pamięcią handlera połączenia. */
+  struct Slot {
+    explicit Slot(boost::asio::io_service& io_service) : socket(io_service) {}
+    tcp::socket socket;
+    HandlerMemory memory;
+  };
+
+  struct State {
+    State() : id(0) {}
+    std::list<Slot> slots;      // gniazda ostatnich pomiarów (najnowszy na początku)
+    uint16_t id;
+  };
+
+  template <int Index, typename Owner>
+  static void send(Owner& owner, State& state, time_type start_time) {
+    if (state.slots.size() < MAX_DELAYED_QUERIES)
+      state.slots.emplace_front(owner.probe_context().get_io_service());
+    else    // przerywa najstarszy pomiar, jeśli jeszcze trwa
+      state.slots.splice(state.slots.begin(), state.slots, std::prev(state.slots.end()));
+    Slot& slot = state.slots.front();
+    boost::system::error_code error;
+    slot.socket.close(error);
+    slot.socket.open(tcp::v4(), error);
+    if (error)
+      return;           // brak deskryptorów - pomiar pominięty
+
+    ++state.id;
+    slot.socket.async_connect(
+        tcp::endpoint(owner.address(), Port ? Port : owner.get_tcp_port()),
+        make_custom_alloc_handler(slot.memory,
+          boost::bind(&TcpConnectProbe::connected<Index, Owner>, &owner, state.id,
+            boost::asio::placeholders::error)));
+    owner.probe_started(Index, state.id, start_time);
+  }
+
+  /* Zamyka gniazda. Miejsca zostają - przerwane połączenia zwalniają
+   * jeszcze pamięć swoich handlerów. */
+  static void reset(State& state) {
+    for (auto it = state.slots.begin(); it != state.slots.end(); ++it) {
+      boost::system::error_code error;
+      it->socket.close(error);
+    }
+  }
+
+private:
+  template <int Index, typename Owner>
+  static void connected(Owner* owner, long id, boost::system::error_code const& error) {
+    if (error)
+      owner->probe_lost(Index, id);
+    else
+      owner->probe_finished(Index, id, get_time_nsec());
+  }
+};
+
+
+/* Rozwinięte w czasie kompilacji przejście po typach pomiarów. */
+template <int I, typename ...Policies>
+struct ProbeUnroll {
+  template <typename Visitor> static void dispatch(int, Visitor&) {}
+  template <typename Visitor> static void for_each(Visitor&) {}
+};
+
+template <int I, typename Policy, typename ...Rest>
+struct ProbeUnroll<I, Policy, Rest...> {
+  template <typename Visitor>
+  static void dispatch(int protocol, Visitor& visitor) {
+    if (protocol == I)
+      visitor.template visit<Policy, I>();
+    else
+      ProbeUnroll<I + 1, Rest...>::dispatch(protocol, visitor);
+  }
+
+  template <typename Visitor>
+  static void for_each(Visitor& visitor) {
+    visitor.template visit<Policy, I>();
+    ProbeUnroll<I + 1, Rest...>::for_each(visitor);
+  }
+};
+
+/* Numer typu 'Target' na liście (-1, jeśli go nie ma). */
+template <typename Target, int I, typename ...Policies>
+struct ProbeIndex {
+  static const int value = -1;
+};
+
+template <typename Target, int I, typename Policy, typename ...Rest>
+struct ProbeIndex<Target, I, Policy, Rest...> {
+  static const int value = std::is_same<Target, Policy>::value ? I : ProbeIndex<Target, I + 1, Rest...>::value;
+};
+
+/* Lista typów pomiarów. Wszystkie wywołania są rozwijane w czasie
+ * kompilacji (bez funkcji wirtualnych), a własności typów czytane z tablic
+ * stałych indeksowanych numerem typu. */
+template <typename ...Policies>
+struct ProbeList {
+  static const int size = sizeof...(Policies);
+
+  typedef std::tuple<typename Policies::State...> States;   // stan typów w serwerze
+
+  template <typename Policy>
+  struct index : ProbeIndex<Policy, 0, Policies...> {};
+
+  /* Wywołuje visitor.visit<Typ, numer>() dla typu numer 'protocol'. */
+  template <typename Visitor>
+  static void dispatch(int protocol, Visitor& visitor) {
+    ProbeUnroll<0, Policies...>::dispatch(protocol, visitor);
+  }
+
+  /* Wywołuje visitor.visit<Typ, numer>() dla każdego typu po kolei. */
+  template <typename Visitor>
+  static void for_each(Visitor& visitor) {
+    ProbeUnroll<0, Policies...>::for_each(visitor);
+  }
+
+  static char const* name(int protocol) {
+    static char const* const names[] = {Policies::name()...};
+    return names[protocol];
+  }
+
+  static int packets(int protocol) {
+    static const int table[] = {Policies::packets...};
+    return table[protocol];
+  }
+
+  static int max_packets() {
+    int result = 0;
+    for (int protocol = 0; protocol < size; protocol++)
+      result = std::max(result, packets(protocol));
+    return result;
+  }
+
+  static ProbeService service(int protocol) {
+    static const ProbeService table[] = {Policies::service...};
+    return table[protocol];
+  }
+
+  /* Numer typu, którego odpowiedzi przychodzą transportem 'transport'
+   * z portu 'port' (-1, jeśli takiego nie ma). */
+  static int find(ProbeTransport transport, uint16_t port = 0) {
+    static const ProbeTransport transports[] = {Policies::transport...};
+    static const uint16_t ports[] = {Policies::port...};
+    for (int protocol = 0; protocol < size; protocol++) {
+      if (transports[protocol] == transport && (transport != ProbeTransport::UDP || ports[protocol] == port))
+        return protocol;
+    }
+    return -1;
+  }
+};
+
+/* Włączone typy pomiarów - kolejność wyznacza numery typów i kolumny UI.
+ * Nowy typ wystarczy dopisać tutaj, np. TcpConnectProbe<443, ProbeService::ANY>
+ * (HTTPS każdego znanego serwera) albo UdpEchoProbe<7, ProbeService::ANY>. */
+typedef ProbeList<UdpEchoProbe<>, TcpConnectProbe<>, IcmpEchoProbe> EnabledProbes;
+
+const int PROTOCOL_COUNT = EnabledProbes::size;
+
+/* Numery wbudowanych typów pomiarów (-1, jeśli typ jest wyłączony). */
+namespace PROTOCOL {
+  const int UDP = EnabledProbes::index<UdpEchoProbe<> >::value;
+  const int TCP = EnabledProbes::index<TcpConnectProbe<> >::value;
+  const int ICMP = EnabledProbes::index<IcmpEchoProbe>::value;
+}
+
+#endif  // PROBE_POLICY_H
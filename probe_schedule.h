@@ -0,0 +1,174 @@
+#ifndef PROBE_SCHEDULE_H
+#define PROBE_SCHEDULE_H
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <boost/asio.hpp>
+#include "common.h"
+
+const int ADAPTIVE_INTERVAL_RANGE = 4;     // z -A odstęp pomiarów od -t/4 do -t*4
+const long PROBE_MIN_TICK_USEC = 10000;    // min. okres przeglądania serwerów
+const int ADAPT_WARMUP_SAMPLES = 4;        // pomiary przed oceną stabilności serwera
+const float ADAPT_CHANGE_DEVIATIONS = 4;   // zmiana - pomiar dalej niż tyle odchyleń od średniej
+const float ADAPT_MIN_DEVIATION_USEC = 100;  // min. odchylenie przy wykrywaniu zmian
+const float ADAPT_VARIANCE_RATIO = 0.5;    // zmienny serwer - odchylenie > tyle * średnia
+const int ADAPT_BACKOFF_PERCENT = 25;      // wydłużenie odstępu stabilnego serwera
+const int ADAPT_SPEEDUP_PERCENT = 20;      // skrócenie odstępu zmiennego serwera
+
+/* Klasa priorytetu: serwery z podsieci network/mask mierzone są co
+ * min_interval_usec..max_interval_usec (opcja -P). */
+struct ProbeClass {
+  uint32_t network;
+  uint32_t mask;
+  time_type min_interval_usec;
+  time_type max_interval_usec;
+};
+
+/* Parametry harmonogramu pomiarów (opcje -t, -A, -P). */
+struct ProbeScheduleConfig {
+  int interval;                     // podstawowy odstęp pomiarów w sekundach
+  bool adaptive;                    // czy zmieniać odstęp serwerów spoza klas -P
+  std::vector<ProbeClass> classes;  // klasy priorytetów w kolejności podania
+};
+
+/* Stan harmonogramu jednego serwera. */
+struct ProbeState {
+  time_type next_probe;       // czas następnego pomiaru (zegar pomiarów, ns)
+  time_type interval_usec;    // aktualny odstęp pomiarów
+  float mean_delay;           // wygładzone opóźnienie (us)
+  float mean_deviation;       // wygładzone odchylenie od 'mean_delay' (us)
+  uint8_t class_id;
+  uint8_t samples;            // liczba pomiarów w średniej (do ADAPT_WARMUP_SAMPLES)
+  bool unstable;              // zmiana lub strata od ostatniego pomiaru
+};
+
+/* Adaptacyjny harmonogram pomiarów. Każdy serwer należy do klasy priorytetu
+ * (pierwszej pasującej z -P albo domyślnej) i jest mierzony co 'interval_usec'
+ * z przedziału klasy. Po każdej rundzie pomiarów odstęp jest:
+ *  - zmniejszany o połowę, jeśli od poprzedniej rundy pomiar zgubiono albo
+ *    opóźnienie odbiegło od średniej o więcej niż ADAPT_CHANGE_DEVIATIONS
+ *    odchyleń (średnia i odchylenie liczone jak SRTT/RTTVAR z RFC 6298),
+ *  - skracany o ADAPT_SPEEDUP_PERCENT procent, jeśli opóźnienie jest zmienne
+ *    (odchylenie większe niż ADAPT_VARIANCE_RATIO średniej),
+ *  - w przeciwnym razie wydłużany o ADAPT_BACKOFF_PERCENT procent.
+ * Domyślna klasa ma stały odstęp -t, a z opcją -A przedział -t/4 .. -t*4.
+ * Serwery przeglądane są co tick_usec(), więc runda wypada w przeglądzie
+ * najbliższym wyznaczonemu czasowi (a nie w następnym po nim). */
+class ProbeSchedule {
+public:
+  ProbeSchedule(ProbeScheduleConfig const& config) : classes(config.classes) {
+    time_type interval_usec = config.interval * (time_type) SEC_TO_USEC;
+    ProbeClass default_class = {0, 0, interval_usec, interval_usec};
+    if (config.adaptive) {
+      default_class.min_interval_usec = interval_usec / ADAPTIVE_INTERVAL_RANGE;
+      default_class.max_interval_usec = interval_usec * ADAPTIVE_INTERVAL_RANGE;
+    }
+    classes.push_back(default_class);   // pasuje do każdego adresu
+    default_interval = interval_usec;
+
+    tick = default_class.min_interval_usec;
+    for (auto it = classes.begin(); it != classes.end(); ++it)
+      tick = std::min(tick, it->min_interval_usec);
+    tick = std::max(tick, (time_type) PROBE_MIN_TICK_USEC);
+  }
+
+  /* Okres przeglądania serwerów - najkrótszy odstęp wszystkich klas. */
+  time_type tick_usec() const { return tick; }
+
+  /* Ustawia stan nowego serwera o adresie 'ip'. */
+  void init(ProbeState& state, uint32_t ip, time_type now) const {
+    state.class_id = 0;
+    while ((ip & classes[state.class_id].mask) != classes[state.class_id].network)
+      state.class_id++;
+    ProbeClass const& probe_class = classes[state.class_id];
+    state.interval_usec = std::max(probe_class.min_interval_usec,
+        std::min(probe_class.max_interval_usec, default_interval));
+    state.next_probe = now;
+    state.mean_delay = state.mean_deviation = 0;
+    state.samples = 0;
+    state.unstable = false;
+  }
+
+  /* Uwzględnia ukończony pomiar opóźnienia 'delay_nsec'. */
+  void add_sample(ProbeState& state, time_type delay_nsec) const {
+    float delay = (float) delay_nsec / USEC_TO_NSEC;
+    float error = delay - state.mean_delay;
+    if (state.samples == 0) {
+      state.mean_delay = delay;
+      state.mean_deviation = delay / 2.0;
+    } else {
+      float deviation = std::max(state.mean_deviation, (float) ADAPT_MIN_DEVIATION_USEC);
+      if (state.samples >= ADAPT_WARMUP_SAMPLES && std::abs(error) > ADAPT_CHANGE_DEVIATIONS * deviation)
+        state.unstable = true;
+      state.mean_deviation += (std::abs(error) - state.mean_deviation) / 4;   // beta = 1/4
+      state.mean_delay += error / 8;                                         // alpha = 1/8
+    }
+    if (state.samples < ADAPT_WARMUP_SAMPLES)
+      state.samples++;
+  }
+
+  /* Uwzględnia zgubiony pomiar. */
+  void add_loss(ProbeState& state) const {
+    state.unstable = true;
+  }
+
+  /* Wyznacza odstęp i czas następnej rundy pomiarów po rundzie w chwili 'now'. */
+  void schedule_next(ProbeState& state, time_type now) const {
+    ProbeClass const& probe_class = classes[state.class_id];
+    if (state.unstable) {
+      state.interval_usec /= 2;
+    } else if (state.samples >= ADAPT_WARMUP_SAMPLES) {
+      if (state.mean_deviation > ADAPT_VARIANCE_RATIO * state.mean_delay)
+        state.interval_usec -= state.interval_usec * ADAPT_SPEEDUP_PERCENT / 100;
+      else
+        state.interval_usec += state.interval_usec * ADAPT_BACKOFF_PERCENT / 100;
+    }
+    state.interval_usec = std::max(probe_class.min_interval_usec,
+        std::min(probe_class.max_interval_usec, state.interval_usec));
+    state.unstable = false;
+    /* bez połowy okresu przeglądania opóźnienie obsługi timera w tej rundzie
+     * przesuwałoby kolejną o cały okres: */
+    state.next_probe = now + (std::max(state.interval_usec, tick) - tick / 2) * USEC_TO_NSEC;
+  }
+
+  /* Wczytuje klasę z napisu "adres/prefiks:min_s:max_s" (np. 10.1.0.0/16:0.25:2). */
+  static ProbeClass parse_class(std::string const& spec) {
+    std::size_t slash = spec.find('/');
+    std::size_t colon = spec.find(':');
+    std::size_t second_colon = spec.find(':', colon + 1);
+    if (slash == std::string::npos || colon == std::string::npos
+        || second_colon == std::string::npos || slash > colon)
+      throw std::invalid_argument("invalid probe class");
+
+    int prefix = std::stoi(spec.substr(slash + 1, colon - slash - 1));
+    float min_interval = std::stof(spec.substr(colon + 1, second_colon - colon - 1));
+    float max_interval = std::stof(spec.substr(second_colon + 1));
+    if (prefix < 0 || prefix > 32 || min_interval <= 0 || max_interval < min_interval
+        || max_interval > std::numeric_limits<int>::max())
+      throw std::invalid_argument("invalid probe class");
+
+    boost::system::error_code error;
+    boost::asio::ip::address_v4 network =
+        boost::asio::ip::address_v4::from_string(spec.substr(0, slash), error);
+    if (error)
+      throw std::invalid_argument("invalid probe class address");
+
+    ProbeClass probe_class;
+    probe_class.mask = prefix ? ~0u << (32 - prefix) : 0;
+    probe_class.network = network.to_ulong() & probe_class.mask;
+    probe_class.min_interval_usec = (time_type) (min_interval * SEC_TO_USEC);
+    probe_class.max_interval_usec = (time_type) (max_interval * SEC_TO_USEC);
+    return probe_class;
+  }
+
+private:
+  std::vector<ProbeClass> classes;  // ostatnia - domyślna
+  time_type default_interval;       // odstęp -t w us
+  time_type tick;
+};
+
+#endif  // PROBE_SCHEDULE_H
@@ -0,0 +1,255 @@
+#ifndef RECEIVE_THREAD_H
+#define RECEIVE_THREAD_H
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <thread>
+#include <iostream>
+#include <pthread.h>
+#include <sched.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <endian.h>
+#include "common.h"
+#include "clock_source.h"
+#include "server.h"
+
+using boost::asio::ip::udp;
+using boost::asio::ip::icmp;
+
+const int RECEIVE_BUSY_POLL_USEC = 50;     // SO_BUSY_POLL wątku odbierającego
+const int RECEIVE_POLL_TIMEOUT_MS = 100;   // maks. czas oczekiwania w poll() wątku odbierającego
+const std::size_t RECEIVE_QUEUE_SIZE = 4096; // pojemność kolejki odpowiedzi (potęga 2)
+const std::size_t CACHE_LINE_SIZE = 64;      // rozmiar linii pamięci podręcznej
+
+/* Parametry wątku odbierającego (opcje -R, -Y, -F). */
+struct ReceiveThreadConfig {
+  bool enabled;       // czy odbierać w osobnym wątku
+  int cpu;            // procesor, do którego przypinamy wątek (-1 - bez przypinania)
+  bool spin;          // aktywne czekanie zamiast poll()
+  int rt_priority;    // priorytet SCHED_FIFO (0 - zwykły priorytet)
+};
+
+/* Kolejka jednego producenta i jednego konsumenta bez blokad
+ * (bufor cykliczny o pojemności N - 1 elementów, N potęgą dwójki).
+ * Indeksy producenta i konsumenta rozdzielone są jawnym wypełnieniem, a nie
+ * alignas - operator new sprzed C++17 nie zachowuje wyrównania do linii. */
+template <typename T, std::size_t N>
+class SpscQueue {
+  static_assert((N & (N - 1)) == 0, "SpscQueue size must be a power of two");
+public:
+  SpscQueue() : head(0), tail(0) {}
+
+  /* Wywoływane tylko przez producenta. Zwraca false, jeśli kolejka jest pełna. */
+  bool push(T const& value) {
+    std::size_t t = tail.load(std::memory_order_relaxed);
+    std::size_t next = (t + 1) & (N - 1);
+    if (next == head.load(std::memory_order_acquire))
+      return false;
+    data[t] = value;
+    tail.store(next, std::memory_order_release);
+    return true;
+  }
+
+  /* Wywoływane tylko przez konsumenta. Zwraca false, jeśli kolejka jest pusta. */
+  bool pop(T& value) {
+    std::size_t h = head.load(std::memory_order_relaxed);
+    if (h == tail.load(std::memory_order_acquire))
+      return false;
+    value = data[h];
+    head.store((h + 1) & (N - 1), std::memory_order_release);
+    return true;
+  }
+
+private:
+  typedef std::atomic<std::size_t> index_type;
+
+  T data[N];
+  char data_padding[CACHE_LINE_SIZE];         // osobne linie pamięci podręcznej
+  index_type head;                            //   dla konsumenta
+  char head_padding[CACHE_LINE_SIZE - sizeof(index_type)];
+  index_type tail;                            //   i producenta
+  char tail_padding[CACHE_LINE_SIZE - sizeof(index_type)];
+};
+
+/* Odpowiedź odebrana przez wątek odbierający, z czasem odbioru. */
+struct ReceivedReply {
+  int protocol;         // numer typu pomiaru (EnabledProbes)
+  uint32_t ip;          // adres nadawcy
+  long id;              // czas wysłania (UDP) lub numer sekwencyjny (ICMP)
+  time_type end_time;   // czas odbioru
+};
+
+/* Wątek, który samodzielnie odbiera odpowiedzi UDP i ICMP z gniazd
+ * 'udp_socket' i 'icmp_socket' (wysyłanie pozostaje w głównej pętli),
+ * zapisuje czas odbioru zaraz po odebraniu pakietu i przekazuje gotowe
+ * odpowiedzi do głównej pętli przez kolejkę SPSC. Opcjonalnie wątek jest
+ * przypięty do procesora, ma priorytet czasu rzeczywistego i czeka aktywnie. */
+class ReceiveThread {
+public:
+  ReceiveThread(boost::asio::io_service& io_service, servers_ptr servers, ProbeContext& context,
+      std::shared_ptr<udp::socket> udp_socket, std::shared_ptr<icmp::socket> icmp_socket,
+      ReceiveThreadConfig const& config) :
+          io_service(io_service),
+          servers(servers),
+          context(context),
+          udp_socket(udp_socket),
+          icmp_socket(icmp_socket),
+          config(config),
+          running(true),
+          drain_scheduled(false),
+          dropped(0) {
+    set_busy_poll(udp_socket->native_handle(), "UDP");
+    set_busy_poll(icmp_socket->native_handle(), "ICMP");
+    if (!config.spin && busy_poll_sysctl() <= 0)
+      std::cerr << "Receive thread: net.core.busy_poll is 0, poll() will sleep without busy "
+          "polling (use -Y to spin)\n";
+
+    thread = std::thread(&ReceiveThread::run, this);
+    configure_thread();
+  }
+
+  ~ReceiveThread() {
+    running = false;
+    thread.join();
+  }
+
+  /* Liczba odpowiedzi porzuconych z powodu przepełnienia kolejki. */
+  unsigned long get_dropped() const { return dropped; }
+
+private:
+  /* Ustawia SO_BUSY_POLL gniazda 'fd'. Odczyt bez blokowania odpytuje wtedy
+   * kartę sieciową (tryb -Y); poll() robi to tylko przy niezerowym sysctl
+   * net.core.busy_poll. Bez CAP_NET_ADMIN jądro może odmówić (EPERM). */
+  static void set_busy_poll(int fd, char const* name) {
+    int busy_poll = RECEIVE_BUSY_POLL_USEC;
+    if (setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &busy_poll, sizeof(busy_poll)) != 0)
+      std::cerr << "Failed to set SO_BUSY_POLL on " << name << " socket: "
+          << std::strerror(errno) << "\n";
+  }
+
+  /* Wartość sysctl net.core.busy_poll w us (-1, jeśli nie da się jej odczytać). */
+  static int busy_poll_sysctl() {
+    std::ifstream file("/proc/sys/net/core/busy_poll");
+    int value = -1;
+    file >> value;
+    return file ? value : -1;
+  }
+
+  /* Przypina wątek do procesora i ustawia priorytet czasu rzeczywistego. */
+  void configure_thread() {
+    if (config.cpu >= 0) {
+      cpu_set_t cpus;
+      CPU_ZERO(&cpus);
+      CPU_SET(config.cpu, &cpus);
+      if (pthread_setaffinity_np(thread.native_handle(), sizeof(cpus), &cpus) != 0)
+        std::cerr << "Failed to pin receive thread to CPU " << config.cpu << "\n";
+    }
+    if (config.rt_priority > 0) {
+      sched_param param;
+      param.sched_priority = config.rt_priority;
+      if (pthread_setschedparam(thread.native_handle(), SCHED_FIFO, &param) != 0)
+        std::cerr << "Failed to set real-time priority of receive thread\n";
+    }
+  }
+
+  /* Główna pętla wątku odbierającego. */
+  void run() {
+    pollfd fds[2] = {{udp_socket->native_handle(), POLLIN, 0},
+                     {icmp_socket->native_handle(), POLLIN, 0}};
+    while (running) {
+      if (!config.spin && poll(fds, 2, RECEIVE_POLL_TIMEOUT_MS) <= 0)
+        continue;
+      bool received = receive_udp();
+      received = receive_icmp() || received;
+      if (received)
+        schedule_drain();
+    }
+  }
+
+  /* Odbiera (bez blokowania) wszystkie oczekujące odpowiedzi UDP. */
+  bool receive_udp() {
+    bool received = false;
+    uint64_t buffer[2];
+    sockaddr_in sender;
+    socklen_t sender_len = sizeof(sender);
+    ssize_t length;
+    while ((length = recvfrom(udp_socket->native_handle(), buffer, sizeof(buffer), MSG_DONTWAIT,
+        reinterpret_cast<sockaddr*>(&sender), &sender_len)) >= 0) {
+      time_type end_time = get_time_nsec();
+      int protocol = EnabledProbes::find(ProbeTransport::UDP, ntohs(sender.sin_port));
+      if (length >= sizeof(uint64_t) && protocol >= 0)
+        received |= push(ReceivedReply{protocol, ntohl(sender.sin_addr.s_addr),
+            static_cast<long>(be64toh(buffer[0])), end_time});
+      sender_len = sizeof(sender);
+    }
+    return received;
+  }
+
+  /* Odbiera (bez blokowania) wszystkie oczekujące pakiety ICMP i wybiera
+   * z nich odpowiedzi Echo Reply z naszym identyfikatorem (pozostałe
+   * zliczane są jako odrzucone, tak jak odpowiedzi nieznanych serwerów). */
+  bool receive_icmp() {
+    bool received = false;
+    unsigned char buffer[BUFFER_SIZE];
+    ssize_t length;
+    while ((length = recv(icmp_socket->native_handle(), buffer, sizeof(buffer), MSG_DONTWAIT)) >= 0) {
+      time_type end_time = get_time_nsec();
+      uint32_t source;
+      uint16_t seq_num;
+      if (ProbeContext::parse_echo_reply(buffer, length, source, seq_num) && PROTOCOL::ICMP >= 0)
+        received |= push(ReceivedReply{PROTOCOL::ICMP, source, seq_num, end_time});
+      else
+        context.count_icmp(false);
+    }
+    return received;
+  }
+
+  bool push(ReceivedReply const& reply) {
+    if (queue.push(reply))
+      return true;
+    dropped++;
+    return false;
+  }
+
+  /* Zleca głównej pętli opróżnienie kolejki, o ile nie zostało już zlecone. */
+  void schedule_drain() {
+    if (!drain_scheduled.exchange(true))
+      io_service.post(boost::bind(&ReceiveThread::drain, this));
+  }
+
+  /* Wywoływane w głównej pętli: przekazuje odebrane odpowiedzi serwerom. */
+  void drain() {
+    drain_scheduled = false;
+    ReceivedReply reply;
+    while (queue.pop(reply)) {
+      auto it = servers->find(boost::asio::ip::address_v4(reply.ip));
+      if (reply.protocol == PROTOCOL::ICMP)
+        context.count_icmp(it != servers->end());
+      if (it == servers->end())
+        continue;       // ignoruj pakiet
+      it->second.receive_reply(reply.protocol, reply.id, reply.end_time);
+    }
+  }
+
+
+  boost::asio::io_service& io_service;
+  servers_ptr servers;
+  ProbeContext& context;        // statystyki gniazda ICMP
+  std::shared_ptr<udp::socket>  udp_socket;
+  std::shared_ptr<icmp::socket> icmp_socket;
+  ReceiveThreadConfig config;
+
+  std::thread thread;
+  std::atomic<bool> running;
+  std::atomic<bool> drain_scheduled;    // czy opróżnienie kolejki jest już zlecone
+  std::atomic<unsigned long> dropped;
+  SpscQueue<ReceivedReply, RECEIVE_QUEUE_SIZE> queue;
+};
+
+#endif  // RECEIVE_THREAD_H
@@ -3,78 +3,143 @@
 
 #include <iostream>
 #include <list>
+#include <functional>
+#include <memory>
 #include <boost/asio.hpp>
 #include <boost/bind.hpp>
 #include <endian.h>
 #include "common.h"
-#include "get_time_usec.h"
+#include "clock_source.h"
+#include "latency_history.h"
+#include "mdns_message.h"
+#include "probe_context.h"
+#include "probe_policy.h"
 
-/* ze strony http://www.boost.org/doc/libs/1_58_0/doc/html/boost_asio/examples/cpp03_examples.html */
-#include "icmp_header.hpp"
-
-using boost::asio::ip::address;
+using boost::asio::ip::address_v4;
 using boost::asio::ip::udp;
 using boost::asio::ip::tcp;
 using boost::asio::ip::icmp;
 
-class PrintServer;
+const std::size_t SERVER_SIZE_BUDGET = 720;    // największy dopuszczalny sizeof(Server) w B
+
+/* Zwięzłe statystyki jednego serwera. Ujemne opóźnienie oznacza brak pomiarów. */
+struct HostStats {
+  uint32_t ip;
+  float delay_sec[PROTOCOL_COUNT];    // średnie opóźnienie każdego protokołu w sekundach
+  float predicted_sec;                // opóźnienie przewidziane ze współrzędnych (opcja -V)
+  float predicted_error_sec;          // szacowany błąd przewidywania
+  float hour_delay_sec[PROTOCOL_COUNT];   // średnie opóźnienie z ostatniej godziny (historia)
+};
+
+/* Funkcja wywoływana dla każdego ukończonego pomiaru (protokół, opóźnienie w ns). */
+typedef std::function<void(int, time_type)> sample_listener;
 
 /* Klasa reprezentująca komputer o danym IP, który jest serwuje usługę
  * _opoznienia._udp.local i/lub _ssh._tcp.local. Gromadzi informacje
- * o danym serwerze i o pomiarach do niego wysłanych i zakończonych. */
+ * o danym serwerze i o pomiarach do niego wysłanych i zakończonych.
+ *
+ * Przechowuje tylko stan różny dla każdego serwera - pomiary trzymane są
+ * w tablicach stałego rozmiaru, a gniazda i bufory wysyłania są wspólne
+ * (ProbeContext). */
 class Server {
-  friend PrintServer;
 public:
-  Server(std::shared_ptr<address> ip, boost::asio::io_service& io_service,
-      std::shared_ptr<udp::socket> udp_socket, std::shared_ptr<icmp::socket> icmp_socket) :
+  Server(address_v4 const& ip, ProbeContext& context, int tcp_port = SSH_PORT) :
+          context(context),
           ip(ip),
-          io_service(io_service),
-          send_buffer(),
-          send_stream(&send_buffer),
-          udp_endpoint(*ip, UDP_PORT_DEFAULT),
-          icmp_endpoint(*ip, UDP_PORT_DEFAULT),
-          tcp_endpoint(*ip, SSH_PORT),
-          udp_socket(udp_socket),
-          icmp_socket(icmp_socket),
+          tcp_port(tcp_port),
           active_udp(false),
-          active_tcp(false) {}
-
-  Server(Server&& s) :
-          ip(std::move(s.ip)),
-          io_service(s.io_service),
-          send_buffer(),                          // !!!
-          send_stream(&send_buffer),              // !!!
-          udp_endpoint(std::move(s.udp_endpoint)),
-          icmp_endpoint(std::move(s.icmp_endpoint)),
-          tcp_endpoint(std::move(s.tcp_endpoint)),
-          udp_socket(std::move(s.udp_socket)),
-          icmp_socket(std::move(s.icmp_socket)),
-          active_udp(s.active_udp),
-          active_tcp(s.active_tcp) {}
+          active_tcp(false),
+          udp_ttl(0),
+          tcp_ttl(0),
+          queued(0),
+          tracking(new Tracking),
+          history(LatencyHistory::enabled() ? new LatencyHistory : nullptr) {
+    context.get_schedule().init(tracking->probe, ip.to_ulong(), get_time_nsec());
+    for (int proto = 0; proto < PROTOCOL_COUNT; proto++) {
+      context.get_detector().init(tracking->change[proto]);
+      finished_count[proto] = finished_next[proto] = 0;
+      for (int i = 0; i < MAX_DELAYED_QUERIES; i++)
+        waiting_start[proto][i] = 0;
+    }
+  }
+
+  /* Ustawia funkcję powiadamianą o każdym ukończonym pomiarze
+   * (pusta - wyłącza powiadamianie). */
+  void set_sample_listener(sample_listener const& new_listener) {
+    listener.reset(new_listener ? new sample_listener(new_listener) : nullptr);
+  }
+
+  /* Ustawia stały narzut pomiaru protokołu 'protocol' (w ns) odejmowany od
+   * wszystkich kolejnych pomiarów wszystkich serwerów. */
+  static void set_delay_baseline(int protocol, time_type baseline) {
+    delay_baseline()[protocol] = baseline;
+  }
 
 
   /* Zwraca średnie opóźnienie wszystkich protokołów w sekundach. */
   float delay_sec() {
     float result = 0;
     short proto_cnt = 0; // liczba aktywnych protokołów
-    for (int proto = PROTOCOL::UDP; proto < PROTOCOL_COUNT; proto++) {
-      if (!finished[proto].empty()) {
-        result += (float) delays_sum[proto] / finished[proto].size() / SEC_TO_USEC;
+    for (int proto = 0; proto < PROTOCOL_COUNT; proto++) {
+      if (finished_count[proto]) {
+        result += average_delay_sec(proto);
         proto_cnt++;
       }
     }
     return proto_cnt ? result / proto_cnt : 0;
   }
 
+  /* Zwraca średnie opóźnienia każdego protokołu (do publikacji statystyk). */
+  HostStats host_stats() const {
+    HostStats stats;
+    stats.ip = ip.to_ulong();
+    for (int proto = 0; proto < PROTOCOL_COUNT; proto++) {
+      stats.delay_sec[proto] = finished_count[proto] ? average_delay_sec(proto) : -1;
+      stats.hour_delay_sec[proto] = -1;     // uzupełniane przez StatsPublisher
+    }
+    stats.predicted_sec = stats.predicted_error_sec = -1;
+    return stats;
+  }
+
+  /* Podsumowanie pomiarów protokołu 'protocol' z przedziału [from, to]
+   * (zegar pomiarów, ns) z historii opóźnień - w rozdzielczości 1 s, 1 min
+   * albo 1 h, zależnie od tego, jak dawno jest 'from'. Bez historii (opcja -H)
+   * wynik jest pusty. */
+  RollupSummary query_history(int protocol, time_type from, time_type to,
+      bool quantiles = true) const {
+    if (history)
+      return history->query(protocol, from, to, get_time_nsec(), quantiles);
+    RollupSummary summary;
+    summary.clear(0);
+    return summary;
+  }
+
+  /* Zapomina ukończone i oczekujące pomiary wszystkich protokołów, np. gdy
+   * serwer przestaje być mierzony, żeby nie pokazywać starych średnich. */
+  void forget_delays() {
+    for (int proto = 0; proto < PROTOCOL_COUNT; proto++) {
+      finished_count[proto] = finished_next[proto] = 0;
+      for (int i = 0; i < MAX_DELAYED_QUERIES; i++)
+        waiting_start[proto][i] = 0;
+      context.get_detector().init(tracking->change[proto]);
+    }
+  }
+
+  /* Czy serwer jest mierzony którymkolwiek protokołem. */
+  bool is_active() const { return active_udp || active_tcp; }
+
+  /* Czy według harmonogramu nadszedł czas kolejnej rundy pomiarów. */
+  bool probe_due(time_type now) const { return now >= tracking->probe.next_probe; }
+
   /* Aktywuje pomiary przez UDP i ICMP. */
   void enable_udp(uint32_t ttl) {
     active_udp = true;
-    udp_ttl = get_time_usec() + ttl * SEC_TO_USEC;
+    udp_ttl = get_time_nsec() + ttl * (time_type) SEC_TO_NSEC;
   }
   /* Aktywuje pomiary przez TCP. */
   void enable_tcp(uint32_t ttl) {
     active_tcp = true;
-    tcp_ttl = get_time_usec() + ttl * SEC_TO_USEC;
+    tcp_ttl = get_time_nsec() + ttl * (time_type) SEC_TO_NSEC;
   }
   /* Dezaktywuje pomiary przez UDP i ICMP. */
   void disable_udp() {
@@ -83,168 +148,303 @@ public:
   }
   /* Dezaktywuje pomiary przez TCP. */
   void disable_tcp() {
-    active_udp = false;
-    tcp_sockets.clear();
+    active_tcp = false;
+    ResetVisitor visitor = {*this, ProbeService::SSH};
+    EnabledProbes::for_each(visitor);
     tcp_ttl = 0;
   }
 
-  /* Wysyła pakiety UDP, TCP, ICMP do aktywnych serwerów: */
+  /* Wysyła pomiary wszystkich typów, których usługi serwer ogłasza: */
   void send_queries() {
-    time_type start_time = get_time_usec();
-    /* jeśli wpisy się przedawniły, usuwamy je: */
-    if (active_udp && start_time > udp_ttl)
+    SendVisitor visitor = {*this, start_round(), get_time_nsec()};
+    EnabledProbes::for_each(visitor);
+  }
+
+  /* Rozpoczyna rundę pomiarów: usuwa przedawnione wpisy, wyznacza czas
+   * następnej rundy i zwraca maskę (1 << protokół) protokołów do zmierzenia. */
+  int start_round() {
+    time_type now = get_time_nsec();
+    expire(now);
+
+    int protocols = 0;
+    for (int proto = 0; proto < PROTOCOL_COUNT; proto++) {
+      if (measures(proto))
+        protocols |= 1 << proto;
+    }
+    if (protocols)
+      context.get_schedule().schedule_next(tracking->probe, now);
+    return protocols;
+  }
+
+  /* Wyłącza wpisy, których TTL minął przed chwilą 'now'; zgłasza
+   * zniknięcie serwera, gdy wygasł ostatni z nich. */
+  void expire(time_type now) {
+    bool was_active = is_active();
+    if (active_udp && now > udp_ttl)
       disable_udp();
-    if (active_tcp && start_time > tcp_ttl)
+    if (active_tcp && now > tcp_ttl)
       disable_tcp();
-    
-    if (active_udp) {
-      send_udp_query(start_time);
-      send_icmp_query(start_time);
-    }
-    if (active_tcp) {
-      send_tcp_query(start_time);
+    if (was_active && !is_active()) {
+      context.get_detector().host_gone(ip.to_ulong());
+      for (int proto = 0; proto < PROTOCOL_COUNT; proto++)
+        context.get_detector().init(tracking->change[proto]);   // po powrocie poziom od nowa
     }
   }
 
-  void receive_udp_query(time_type start_time, time_type end_time) {
-    finish_waiting_query(start_time, end_time, PROTOCOL::UDP);
+  /* Czy serwer jest mierzony typem pomiaru 'protocol' (-1 - wyłączonym). */
+  bool measures(int protocol) const {
+    return protocol >= 0 && service_active(EnabledProbes::service(protocol));
   }
 
-  void receive_icmp_query(long id, time_type end_time) {
-    finish_waiting_query(id, end_time, PROTOCOL::ICMP);
+  /* Wysyła pomiar typu 'protocol'. */
+  void send_query(int protocol) {
+    SendVisitor visitor = {*this, 1 << protocol, get_time_nsec()};
+    EnabledProbes::dispatch(protocol, visitor);
   }
 
-private:
-  void send_udp_query(time_type start_time) {
-    uint64_t be_start_time = htobe64(start_time);
-    send_buffer.consume(send_buffer.size());
-    send_stream.write(reinterpret_cast<const char *>(&be_start_time), sizeof(be_start_time));
+  /* Zaznacza, że pomiar protokołem 'protocol' czeka w kolejce na wysłanie.
+   * Zwraca false, jeśli już czekał. */
+  bool mark_queued(int protocol) {
+    if (queued & (1 << protocol))
+      return false;
+    queued |= 1 << protocol;
+    return true;
+  }
 
-    udp_socket->async_send_to(send_buffer.data(), udp_endpoint,
-        boost::bind(&Server::handle_send, this));
+  void clear_queued(int protocol) { queued &= ~(1 << protocol); }
 
-    add_waiting_query(start_time, start_time, PROTOCOL::UDP);
+  /* Obsługuje odpowiedź 'id' na pomiar typu 'protocol' odebraną w chwili 'end_time'. */
+  void receive_reply(int protocol, time_type id, time_type end_time) {
+    finish_waiting_query(id, end_time, protocol);
   }
 
-  void send_icmp_query(time_type start_time) {
-    ++icmp_id;
-    icmp_header icmp_header;
-    std::string icmp_message(even_decimal_to_bcd(ICMP_MESSAGE));
+  /* Interfejs dla typów pomiarów (probe_policy.h): */
+  address_v4 const& address() const { return ip; }
+  ProbeContext& probe_context() { return context; }
+  uint16_t get_tcp_port() const { return tcp_port; }
 
-    send_buffer.consume(send_buffer.size());
-    icmp_header.sequence_number(icmp_id);
-    compute_checksum(icmp_header, icmp_message.begin(), icmp_message.end());
-    send_stream << icmp_header << icmp_message;
-
-    icmp_socket->async_send_to(send_buffer.data(), icmp_endpoint,
-        boost::bind(&Server::handle_send, this));
+  /* Zapamiętuje wysłany pomiar typu 'protocol'. */
+  void probe_started(int protocol, time_type id, time_type start_time) {
+    add_waiting_query(id, start_time, protocol);
+  }
 
-    add_waiting_query(icmp_id, start_time, PROTOCOL::ICMP);
+  void probe_finished(int protocol, time_type id, time_type end_time) {
+    finish_waiting_query(id, end_time, protocol);
   }
 
-  void handle_send() {}
+  void probe_lost(int protocol, time_type id) {
+    unfinished_waiting_query(id, protocol);
+  }
 
-  void send_tcp_query(time_type start_time) {
-    ++tcp_id;
+  /* Zapisuje stan serwera w formacie binarnym (big endian): pozostałe TTL
+   * w sekundach (0 - nieaktywny) oraz ukończone pomiary każdego protokołu
+   * w us (od najstarszego). 'now' to czas zegara pomiarów. */
+  void write_snapshot(std::ostream& os, time_type now) const {
+    write_be(os, static_cast<uint32_t>(ip.to_ulong()));
+    write_be(os, static_cast<uint32_t>(active_udp && udp_ttl > now ? (udp_ttl - now) / SEC_TO_NSEC : 0));
+    write_be(os, static_cast<uint32_t>(active_tcp && tcp_ttl > now ? (tcp_ttl - now) / SEC_TO_NSEC : 0));
+    for (int proto = 0; proto < PROTOCOL_COUNT; proto++) {
+      int count = finished_count[proto];
+      write_be(os, static_cast<uint8_t>(count));
+      for (int i = 0; i < count; i++) {
+        int oldest = (finished_next[proto] + AVERAGED_MEASUREMENTS - count) % AVERAGED_MEASUREMENTS;
+        write_be(os, static_cast<uint32_t>(finished[proto][(oldest + i) % AVERAGED_MEASUREMENTS] / USEC_TO_NSEC));
+      }
+    }
+  }
 
-    tcp_sockets.push_front(tcp::socket(io_service, tcp::v4())); // nowy socket
+  /* Odtwarza TTL i ukończone pomiary zapisane przez write_snapshot
+   * (bez adresu, który wczytuje wywołujący). Od zapisanych TTL odejmowany
+   * jest czas 'elapsed_sec', który upłynął od zapisu. */
+  void read_snapshot(std::istream& is, uint32_t elapsed_sec) {
+    uint32_t udp_ttl_sec, tcp_ttl_sec;
+    read_be(is, udp_ttl_sec);
+    read_be(is, tcp_ttl_sec);
+    if (udp_ttl_sec > elapsed_sec)
+      enable_udp(udp_ttl_sec - elapsed_sec);
+    if (tcp_ttl_sec > elapsed_sec)
+      enable_tcp(tcp_ttl_sec - elapsed_sec);
+
+    for (int proto = 0; proto < PROTOCOL_COUNT; proto++) {
+      uint8_t count = 0;
+      read_be(is, count);
+      finished_count[proto] = finished_next[proto] = 0;
+      for (int i = 0; i < count && is; i++) {
+        uint32_t delay;
+        read_be(is, delay);
+        add_finished_query(delay * (time_type) USEC_TO_NSEC, proto);
+      }
+    }
+  }
 
-    tcp_sockets.back().async_connect(tcp_endpoint,
-        boost::bind(&Server::receive_tcp_query, this, tcp_id,
-            boost::asio::placeholders::error));
+private:
+  /* Stan harmonogramu i wykrywania zmian - poza obiektem, żeby Server
+   * mieścił się w SERVER_SIZE_BUDGET. */
+  struct Tracking {
+    ProbeState probe;                   // harmonogram pomiarów serwera
+    ChangeState change[PROTOCOL_COUNT]; // wykrywanie zmian opóźnień
+  };
+
+  /* Wysyła pomiary typów z maski 'protocols'. */
+  struct SendVisitor {
+    Server& server;
+    int protocols;
+    time_type start_time;
+
+    template <typename Policy, int Index>
+    void visit() {
+      if (protocols & (1 << Index))
+        Policy::template send<Index>(server, std::get<Index>(server.probe_states), start_time);
+    }
+  };
 
-    add_waiting_query(tcp_id, start_time, PROTOCOL::TCP);
+  /* Zwalnia zasoby typów pomiarów włączanych usługą 'service'. */
+  struct ResetVisitor {
+    Server& server;
+    ProbeService service;
 
-    if (tcp_sockets.size() >= MAX_DELAYED_QUERIES)
-      tcp_sockets.pop_back();            // usuwa pomiar jeśli jest za dużo
+    template <typename Policy, int Index>
+    void visit() {
+      if (Policy::service == service)
+        Policy::reset(std::get<Index>(server.probe_states));
+    }
+  };
+
+  /* Czy serwer ogłasza usługę 'service'. */
+  bool service_active(ProbeService service) const {
+    switch (service) {
+      case ProbeService::OPOZNIENIA: return active_udp;
+      case ProbeService::SSH: return active_tcp;
+      default: return active_udp || active_tcp;
+    }
   }
 
-  void receive_tcp_query(long id, boost::system::error_code const& error) {
-    if (error) {
-      unfinished_waiting_query(id, PROTOCOL::TCP);
-    } else {
-      finish_waiting_query(id, get_time_usec(), PROTOCOL::TCP);
+  void add_waiting_query(time_type id, time_type start_time, int protocol) {
+    time_type* starts = waiting_start[protocol];
+    for (int i = 0; i < MAX_DELAYED_QUERIES; i++) {
+      if (starts[i] && starts[i] + MAX_DELAY_TIME * SEC_TO_NSEC < start_time) {
+        starts[i] = 0;    // brak odpowiedzi - pomiar zgubiony
+        if (history)
+          history->add_loss(protocol, start_time);
+        context.get_detector().add_loss(tracking->change[protocol], ip.to_ulong(), protocol);
+        if (protocol == adaptive_protocol())
+          context.get_schedule().add_loss(tracking->probe);
+      }
+    }
+
+    int slot = 0;
+    for (int i = 0; i < MAX_DELAYED_QUERIES && starts[slot]; i++) {
+      if (!starts[i] || starts[i] < starts[slot])
+        slot = i;   // wolne miejsce albo najstarszy zaczęty pomiar
     }
+    waiting_id[protocol][slot] = static_cast<uint32_t>(id);
+    starts[slot] = start_time;
   }
 
-  void add_waiting_query(long id, time_type start_time, int protocol) {
-    if (waiting[protocol].size() >= MAX_DELAYED_QUERIES) {
-      waiting[protocol].pop_back();    // porzuć najstarszy zaczęty pomiar
+  /* Zwraca indeks oczekującego pomiaru o identyfikatorze 'id' lub -1.
+   * Porównywane są młodsze 32 bity - pomiar czeka najwyżej MAX_DELAY_TIME,
+   * więc identyfikatory UDP (czas wysłania w us) nie powtarzają się. */
+  int find_waiting_query(time_type id, int protocol) const {
+    for (int i = 0; i < MAX_DELAYED_QUERIES; i++) {
+      if (waiting_start[protocol][i] && waiting_id[protocol][i] == static_cast<uint32_t>(id))
+        return i;
     }
-    waiting[protocol].push_front(std::make_pair(id, start_time));
+    return -1;
+  }
+
+  /* Dodaje ukończony pomiar (ns), usuwając najstarszy, jeśli jest ich za dużo. */
+  void add_finished_query(time_type delay, int protocol) {
+    uint8_t& next = finished_next[protocol];
+    if (finished_count[protocol] < AVERAGED_MEASUREMENTS)
+      finished_count[protocol]++;
+    finished[protocol][next] = delay;   // nadpisuje najstarszy skończony pomiar
+    next = (next + 1) % AVERAGED_MEASUREMENTS;
+  }
+
+  /* Średnia ukończonych pomiarów protokołu 'protocol' w sekundach (liczona
+   * przy odczycie, żeby nie trzymać sumy w każdym serwerze). */
+  float average_delay_sec(int protocol) const {
+    time_type sum = 0;
+    for (int i = 0; i < finished_count[protocol]; i++)
+      sum += finished[protocol][i];
+    return (float) sum / finished_count[protocol] / SEC_TO_NSEC;
   }
 
   /* Kończy pomiar o identyfikatorze 'id'. */
-  void finish_waiting_query(long id, time_type end_time, int protocol) {
-    time_type diff_time;
-    auto init_query = waiting[protocol].begin();
-    while (init_query != waiting[protocol].end() && init_query->first != id)
-      ++init_query;
-
-    if (init_query != waiting[protocol].end()) {   // znaleziono; else ignoruj pomiar
-      diff_time = end_time - init_query->second;
-      waiting[protocol].erase(init_query);
-      if (finished[protocol].size() >= AVERAGED_MEASUREMENTS) {
-        /* usuń najstarszy skończony pomiar: */
-        delays_sum[protocol] -= finished[protocol].back();
-        finished[protocol].pop_back();
-      }
-      finished[protocol].push_front(diff_time);
-      delays_sum[protocol] += diff_time;
+  void finish_waiting_query(time_type id, time_type end_time, int protocol) {
+    int query = find_waiting_query(id, protocol);
+    if (query >= 0) {   // znaleziono; else ignoruj pomiar
+      time_type diff_time = end_time - waiting_start[protocol][query];
+      if (listener)
+        (*listener)(protocol, diff_time);
+      /* odejmujemy narzut pomiaru (jeśli został wyznaczony kalibracją): */
+      time_type baseline = delay_baseline()[protocol];
+      diff_time = diff_time > baseline ? diff_time - baseline : 0;
+      waiting_start[protocol][query] = 0;
+      if (history)
+        history->add_sample(protocol, end_time, diff_time);
+      context.get_detector().add_sample(tracking->change[protocol], ip.to_ulong(), protocol, diff_time);
+      if (protocol == adaptive_protocol())
+        context.get_schedule().add_sample(tracking->probe, diff_time);
+      add_finished_query(diff_time, protocol);
     }
   }
 
   /* Obsługuje nieukończony pomiar o identyfikatorze 'id'. */
-  void unfinished_waiting_query(long id, int protocol) {
-    auto init_query = waiting[protocol].begin();
-    while (init_query != waiting[protocol].end() && init_query->first != id)
-      ++init_query;
-
-    if (init_query != waiting[protocol].end()) {   // znaleziono; else ignoruj pomiar
-      waiting[protocol].erase(init_query);
-      if (finished[protocol].size() >= AVERAGED_MEASUREMENTS) {
-        /* usuń najstarszy skończony pomiar: */
-        delays_sum[protocol] -= finished[protocol].back();
-        finished[protocol].pop_back();
-      }
-      finished[protocol].push_front(MAX_DELAY_TIME * SEC_TO_USEC);
-      delays_sum[protocol] += MAX_DELAY_TIME * SEC_TO_USEC;
+  void unfinished_waiting_query(time_type id, int protocol) {
+    int query = find_waiting_query(id, protocol);
+    if (query >= 0) {   // znaleziono; else ignoruj pomiar
+      waiting_start[protocol][query] = 0;
+      if (history)
+        history->add_loss(protocol, get_time_nsec());
+      context.get_detector().add_loss(tracking->change[protocol], ip.to_ulong(), protocol);
+      if (protocol == adaptive_protocol())
+        context.get_schedule().add_loss(tracking->probe);
+      add_finished_query(MAX_DELAY_TIME * SEC_TO_NSEC, protocol);
     }
   }
 
-  /* Konwertuje liczbę w zapisie 10 o parzystej liczbie cyfr do systemu BCD. */
-  std::string even_decimal_to_bcd(std::string const& decimal) {
-    std::string result(decimal.size() / 2, '\0');
-    for (int i = 0; i < decimal.size(); i++)
-      result[i / 2] += ((decimal[i] - '0') & 0x0F) << (i % 2 ? 0 : 4);  // shift parzystych
-    return result;
+  /* Typ pomiaru, którego pomiary decydują o częstości pomiarów serwera
+   * (pierwszy mierzony na liście EnabledProbes). */
+  int adaptive_protocol() const {
+    for (int proto = 0; proto < PROTOCOL_COUNT; proto++) {
+      if (measures(proto))
+        return proto;
+    }
+    return -1;
   }
 
+  /* Narzut pomiaru każdego protokołu wspólny dla wszystkich serwerów. */
+  static time_type* delay_baseline() {
+    static time_type baseline[PROTOCOL_COUNT] = {0};
+    return baseline;
+  }
 
 
-  std::shared_ptr<address> ip;
-  boost::asio::io_service& io_service;
-  boost::asio::streambuf send_buffer; // bufor do wysyłania
-  std::ostream send_stream;           // strumień do wysyłania
 
-  udp::endpoint  udp_endpoint;
-  icmp::endpoint icmp_endpoint;
-  tcp::endpoint  tcp_endpoint;
-  std::shared_ptr<udp::socket>    udp_socket;  // gniazdo używane do wszstkich pakietów UDP
-  std::shared_ptr<icmp::socket>   icmp_socket; // gniazdo używane do wszstkich pakietów ICMP
-  std::list<tcp::socket>          tcp_sockets;
+  ProbeContext& context;              // gniazda i bufory wspólne dla wszystkich serwerów
+  EnabledProbes::States probe_states; // stan każdego typu pomiaru (gniazda TCP, numery)
 
+  address_v4 ip;
+  uint16_t tcp_port;                  // port TcpConnectProbe<0>
   bool active_udp;                    // czy pomiary UDP i ICMP są aktywne
   bool active_tcp;                    // czy pomiary TCP są aktywne
-  time_type udp_ttl;                  // TTL serwera UDP
+  time_type udp_ttl;                  // TTL serwera UDP (zegar pomiarów, ns)
   time_type tcp_ttl;                  // TTL serwera TCP
 
-  unsigned long tcp_id;
-  unsigned long icmp_id;
-
-  std::list<time_type> finished[PROTOCOL_COUNT];    // lista ukończonych pomiarów
-  std::list<std::pair<long, time_type> > waiting[PROTOCOL_COUNT]; // lista oczekujących pomiarów
-  time_type delays_sum[PROTOCOL_COUNT];             // suma opóźnień
+  time_type finished[PROTOCOL_COUNT][AVERAGED_MEASUREMENTS];  // ukończone pomiary w ns (bufor cykliczny)
+  uint8_t finished_count[PROTOCOL_COUNT];           // liczba ukończonych pomiarów
+  uint8_t finished_next[PROTOCOL_COUNT];            // miejsce na kolejny pomiar
+  uint8_t queued;                     // protokoły czekające w kolejce ProbeBudget
+  // oczekujące pomiary: czas wysłania (0 - wolne miejsce) i młodsze bity identyfikatora
+  time_type waiting_start[PROTOCOL_COUNT][MAX_DELAYED_QUERIES];
+  uint32_t waiting_id[PROTOCOL_COUNT][MAX_DELAYED_QUERIES];
+
+  std::unique_ptr<Tracking> tracking; // harmonogram i wykrywanie zmian (poza obiektem)
+  std::unique_ptr<sample_listener> listener;  // powiadamiany o ukończonych pomiarach (opcjonalny)
+  std::unique_ptr<LatencyHistory> history;  // historia opóźnień (opcja -H, poza obiektem)
 };
 
+static_assert(sizeof(Server) <= SERVER_SIZE_BUDGET, "Server exceeds its per-host memory budget");
+
 #endif  // SERVER_H
\ No newline at end of file
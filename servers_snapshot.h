@@ -0,0 +1,114 @@
+#ifndef SERVERS_SNAPSHOT_H
+#define SERVERS_SNAPSHOT_H
+
+#include <cstdio>
+#include <fstream>
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include "common.h"
+#include "clock_timer.h"
+#include "get_time_usec.h"
+#include "server.h"
+#include "mdns_message.h"
+
+using boost::asio::ip::address;
+using boost::asio::ip::address_v4;
+
+const int SNAPSHOT_INTERVAL = 5;      // co ile sekund zapisywać stan serwerów do pliku
+
+/* Okresowo zapisuje znane serwery (pozostałe TTL i ostatnie pomiary) do
+ * pliku binarnego i wczytuje je przy starcie programu, dzięki czemu po
+ * restarcie pomiary do wciąż ważnych serwerów są wznawiane od razu,
+ * a mDNS odświeża je w tle.
+ *
+ * Format pliku (big endian):
+ *   magic (4B) | wersja (2B) | czas zapisu w s (4B) | liczba serwerów (4B) | serwery...
+ * Format serwera - patrz Server::write_snapshot. */
+class ServersSnapshot {
+public:
+  ServersSnapshot(boost::asio::io_service& io_service, servers_ptr servers,
+      ProbeContext& context, std::string const& path) :
+          timer(io_service),
+          context(context),
+          servers(servers),
+          path(path) {
+    if (!path.empty()) {    // pusta ścieżka - zapisywanie wyłączone
+      load();
+      reset_timer();
+    }
+  }
+
+private:
+  /* Wczytuje serwery z pliku, pomijając te, których TTL już minął. */
+  void load() {
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+      return;             // brak pliku - zaczynamy od pustej mapy
+
+    uint32_t magic = 0, saved_at = 0, count = 0;
+    uint16_t version = 0;
+    read_be(file, magic);
+    read_be(file, version);
+    read_be(file, saved_at);
+    read_be(file, count);
+    if (!file || magic != SNAPSHOT_MAGIC || version != SNAPSHOT_VERSION) {
+      std::cerr << "Ignoring invalid snapshot file " << path << "\n";
+      return;
+    }
+
+    uint32_t now_sec = get_time_usec() / SEC_TO_USEC;
+    uint32_t elapsed_sec = now_sec > saved_at ? now_sec - saved_at : 0;
+    for (uint32_t i = 0; i < count && file; i++) {
+      uint32_t ip;
+      read_be(file, ip);
+      auto iter = servers->emplace(address(address_v4(ip)),
+          Server(address_v4(ip), context)).first;
+      iter->second.read_snapshot(file, elapsed_sec);
+      if (!iter->second.is_active())
+        servers->erase(iter);         // wpis przedawnił się w czasie przerwy
+    }
+    if (!file)
+      std::cerr << "Snapshot file " << path << " is truncated\n";
+  }
+
+  /* Zapisuje wszystkie serwery do pliku tymczasowego, a następnie
+   * podmienia nim poprzedni plik (żeby nie zostawić połowy zapisu). */
+  void save() {
+    std::string tmp_path = path + ".tmp";
+    time_type now = get_time_nsec();     // TTL liczone są na zegarze pomiarów
+    std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+
+    write_be(file, SNAPSHOT_MAGIC);
+    write_be(file, SNAPSHOT_VERSION);
+    write_be(file, static_cast<uint32_t>(get_time_usec() / SEC_TO_USEC));
+    write_be(file, static_cast<uint32_t>(servers->size()));
+    for (auto it = servers->begin(); it != servers->end(); ++it)
+      it->second.write_snapshot(file, now);
+    file.close();
+
+    if (file)
+      std::rename(tmp_path.c_str(), path.c_str());
+    else
+      std::cerr << "Failed to write snapshot file " << tmp_path << "\n";
+
+    reset_timer();
+  }
+
+  /* Ustawia timer na kolejny zapis za SNAPSHOT_INTERVAL sekund. */
+  void reset_timer() {
+    timer.expires_from_now(boost::posix_time::seconds(SNAPSHOT_INTERVAL));
+    timer.async_wait(boost::bind(&ServersSnapshot::save, this));
+  }
+
+
+  static const uint32_t SNAPSHOT_MAGIC = 0x4f505a53;  // "OPZS"
+  static const uint16_t SNAPSHOT_VERSION = 1;
+
+  clock_timer timer;
+  ProbeContext& context;      // gniazda wspólne dla wczytanych serwerów
+
+  servers_ptr servers;
+  std::string path;       // ścieżka pliku ze stanem (pusta - wyłączone)
+};
+
+#endif  // SERVERS_SNAPSHOT_H
@@ -0,0 +1,152 @@
+#ifndef STATS_PUBLISHER_H
+#define STATS_PUBLISHER_H
+
+#include <atomic>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include "common.h"
+#include "clock_timer.h"
+#include "get_time_usec.h"
+#include "server.h"
+#include "matrix_exchange.h"
+#include "coordinates.h"
+
+/* Niezmienny obraz statystyk wszystkich serwerów z chwili publikacji. */
+struct StatsSnapshot {
+  uint64_t epoch;             // numer publikacji
+  time_type published_at;     // czas publikacji
+  std::vector<HostStats> hosts;
+  std::vector<MatrixRowStats> matrix;   // wiersze macierzy floty (opcja -X)
+};
+
+/* Publikuje obrazy statystyk mierzone w głównej pętli dla czytelników
+ * z innych wątków (UI, eksport). Publikacja i odczyt nie używają blokad:
+ * aktualny obraz jest wskaźnikiem atomowym, a stare obrazy zwalniane są
+ * według epok (EBR) - dopiero gdy żaden czytelnik nie może ich już używać.
+ *
+ * Publikuje tylko jeden wątek (ten, który ma dostęp do mapy serwerów).
+ * Każdy czytelnik rejestruje się raz (register_reader) i otacza odczyt
+ * parą acquire/release. */
+class StatsPublisher {
+public:
+  StatsPublisher(boost::asio::io_service& io_service, servers_ptr servers, float interval) :
+      timer(io_service),
+      servers(servers),
+      interval(interval),
+      matrix(nullptr),
+      coordinates(nullptr),
+      current(new StatsSnapshot{0, 0, std::vector<HostStats>(), std::vector<MatrixRowStats>()}),
+      global_epoch(1),
+      readers_count(0) {
+    for (int i = 0; i < MAX_STATS_READERS; i++)
+      reader_epochs[i] = QUIESCENT;
+    publish();
+  }
+
+  ~StatsPublisher() {
+    delete current.load();
+    for (int i = 0; i < retired.size(); i++)
+      delete retired[i].first;
+  }
+
+  /* Dołącza do publikowanych obrazów podsumowania wierszy macierzy 'matrix'
+   * (należącej do wątku publikującego). */
+  void set_matrix(LatencyMatrix const* matrix) {
+    this->matrix = matrix;
+  }
+
+  /* Dołącza do statystyk serwerów opóźnienia przewidziane przez 'coordinates'
+   * (należące do wątku publikującego). */
+  void set_coordinates(CoordinateExchange const* coordinates) {
+    this->coordinates = coordinates;
+  }
+
+  /* Rejestruje czytelnika i zwraca jego numer (lub -1, gdy brak miejsca). */
+  int register_reader() {
+    int slot = readers_count++;
+    return slot < MAX_STATS_READERS ? slot : -1;
+  }
+
+  /* Zwraca aktualny obraz; jest on ważny do wywołania release(slot). */
+  StatsSnapshot const* acquire(int slot) {
+    reader_epochs[slot] = global_epoch.load();
+    return current.load();
+  }
+
+  void release(int slot) {
+    reader_epochs[slot] = QUIESCENT;
+  }
+
+private:
+  /* Publikuje nowy obraz statystyk i zwalnia obrazy, których nikt już nie czyta. */
+  void publish() {
+    StatsSnapshot* snapshot = new StatsSnapshot;
+    snapshot->published_at = get_time_usec();
+    snapshot->hosts.reserve(servers->size());
+    time_type now = get_time_nsec();
+    for (auto it = servers->begin(); it != servers->end(); ++it) {
+      snapshot->hosts.push_back(it->second.host_stats());
+      HostStats& stats = snapshot->hosts.back();
+      for (int proto = 0; proto < PROTOCOL_COUNT && LatencyHistory::enabled(); proto++) {
+        RollupSummary hour = it->second.query_history(proto, now - 3600 * (time_type) SEC_TO_NSEC, now, false);
+        stats.hour_delay_sec[proto] = hour.count ? hour.mean_usec / SEC_TO_USEC : -1;
+      }
+      if (coordinates)
+        coordinates->predict(stats.ip, stats.predicted_sec, stats.predicted_error_sec);
+    }
+    if (matrix) {
+      snapshot->matrix.reserve(matrix->size());
+      for (int row = 0; row < matrix->size(); row++)
+        snapshot->matrix.push_back(matrix->row_stats(row));
+    }
+
+    snapshot->epoch = global_epoch.load();
+    StatsSnapshot* old = current.exchange(snapshot);
+    retired.push_back(std::make_pair(old, ++global_epoch));
+    reclaim();
+
+    timer.expires_from_now(boost::posix_time::microseconds((long) (interval * SEC_TO_USEC)));
+    timer.async_wait(boost::bind(&StatsPublisher::publish, this));
+  }
+
+  /* Obraz wycofany w epoce 'e' może zostać zwolniony, gdy każdy czytelnik
+   * jest poza sekcją odczytu albo zaczął ją w epoce >= e (a więc widział
+   * już nowszy obraz). */
+  void reclaim() {
+    uint64_t min_epoch = global_epoch.load();
+    for (int i = 0; i < MAX_STATS_READERS; i++) {
+      uint64_t e = reader_epochs[i].load();
+      if (e != QUIESCENT && e < min_epoch)
+        min_epoch = e;
+    }
+
+    auto it = retired.begin();
+    while (it != retired.end()) {
+      if (it->second <= min_epoch) {
+        delete it->first;
+        it = retired.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+
+  static const int MAX_STATS_READERS = 8;
+  static const uint64_t QUIESCENT = 0;    // czytelnik poza sekcją odczytu
+
+  clock_timer timer;
+  servers_ptr servers;
+  float interval;                         // co ile sekund publikować
+  LatencyMatrix const* matrix;            // macierz floty (lub nullptr)
+  CoordinateExchange const* coordinates;  // współrzędne sieciowe (lub nullptr)
+
+  std::atomic<StatsSnapshot*> current;    // aktualny obraz
+  std::atomic<uint64_t> global_epoch;
+  std::atomic<uint64_t> reader_epochs[MAX_STATS_READERS];  // epoka początku odczytu
+  std::atomic<int> readers_count;
+  std::vector<std::pair<StatsSnapshot*, uint64_t> > retired;  // (obraz, epoka wycofania)
+};
+
+#endif  // STATS_PUBLISHER_H
@@ -13,17 +13,24 @@ const std::string CLR_SCR       = "\033[2J\033[H";
 
 const unsigned char KEY_UP   = 'q';
 const unsigned char KEY_DOWN = 'a';
+const unsigned char KEY_MATRIX = 'm';   // przełącza widok serwerów i macierzy floty
+const unsigned char KEY_ALERTS = 'e';   // przełącza widok serwerów i alarmów
 
 using boost::asio::ip::tcp;
 
 class TelnetConnection {
 public:
-  TelnetConnection(boost::asio::io_service& io_service, std::vector<PrintServer> const& servers_table) :
+  TelnetConnection(boost::asio::io_service& io_service, std::vector<PrintServer> const& servers_table,
+      std::vector<PrintServer> const& matrix_table, std::vector<PrintServer> const& alerts_table) :
     send_buffer(),
     send_stream(&send_buffer),
     socket(io_service),
     active(false),
-    servers_table(servers_table) {}
+    servers_table(servers_table),
+    matrix_table(matrix_table),
+    alerts_table(alerts_table),
+    view(0),
+    table_position(0) {}
 
   tcp::socket& get_socket() { return socket; }
   bool is_active() const { return active; }
@@ -54,9 +61,10 @@ public:
     send_buffer.consume(send_buffer.size());  // wyczyść bufor
     
     /* Wysyłamy znaki CLR_SCR i kolejno 24 wiersze tabelki. */
+    std::vector<PrintServer> const& table = current_table();
     send_stream << CLR_SCR;
-    for (int i = table_position; i < servers_table.size() && i < table_position + UI_SCREEN_HEIGHT; ++i) {
-      send_stream << servers_table[i];
+    for (int i = table_position; i < table.size() && i < table_position + UI_SCREEN_HEIGHT; ++i) {
+      send_stream << table[i];
     }
 
     boost::asio::async_write(socket, send_buffer.data(),
@@ -71,7 +79,9 @@ private:
       deactivate();   // koniec połączenia
     } else {
 
-      for (auto it = recv_buffer.begin(); it != recv_buffer.end(); ++it) {
+      /* tylko odebrane znaki - 'm' i 'e' przełączają widok, więc nie możemy
+       * powtarzać znaków z poprzedniego odbioru: */
+      for (auto it = recv_buffer.begin(); it != recv_buffer.begin() + bytes_transferred; ++it) {
         handle_keypress(*it);
       }
 
@@ -87,12 +97,21 @@ private:
         table_position--;
       }
     } else if (key == KEY_DOWN) {
-      if (table_position < servers_table.size() - 1) {
+      if (table_position < (int) current_table().size() - 1) {
         table_position++;
       }
+    } else if (key == KEY_MATRIX || key == KEY_ALERTS) {
+      view = view == key ? 0 : key;
+      table_position = 0;
     }
   }
 
+  std::vector<PrintServer> const& current_table() const {
+    if (view == KEY_MATRIX)
+      return matrix_table;
+    return view == KEY_ALERTS ? alerts_table : servers_table;
+  }
+
   /* Funkcja negocjująca odpowiednie opcje z klientem telnet. */
   void negotiate_options(std::string const& options) {
     boost::system::error_code error;
@@ -110,6 +129,9 @@ private:
   bool active;                // czy połączenie jest aktywne
 
   const std::vector<PrintServer>& servers_table;  // referencja do tabelki
+  const std::vector<PrintServer>& matrix_table;   // wiersze macierzy floty
+  const std::vector<PrintServer>& alerts_table;   // alarmy, od najnowszego
+  unsigned char view;         // klawisz wyświetlanego widoku (0 - serwery)
   int table_position;         // aktualna pozycja wyświetlanej tabelki
 };
 
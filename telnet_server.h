@@ -1,23 +1,34 @@
 #ifndef TELNET_SERVER_H
 #define TELNET_SERVER_H
 
+#include <deque>
 #include <boost/asio.hpp>
 #include <boost/bind.hpp>
 #include "common.h"
+#include "clock_timer.h"
+#include "change_detector.h"
 #include "telnet_connection.h"
-#include "server.h"
 #include "print_server.h"
+#include "stats_publisher.h"
 
 using boost::asio::ip::tcp;
 
+const std::size_t ALERT_UI_HISTORY = 100;  // alarmy pamiętane przez UI
+
+/* Serwer interfejsu telnet. Działa we własnym wątku i czyta statystyki
+ * wyłącznie z obrazów publikowanych przez StatsPublisher, a alarmy
+ * z kolejki alarmów (ostatnie ALERT_UI_HISTORY). */
 class TelnetServer {
 public:
-  TelnetServer(boost::asio::io_service& io_service, servers_ptr servers,
-      int ui_port, float ui_refresh_interval) :
+  TelnetServer(boost::asio::io_service& io_service, StatsPublisher& publisher,
+      AlertQueue const& alerts, int ui_port, float ui_refresh_interval) :
           io_service(io_service),
           timer(io_service, boost::posix_time::seconds(0)),
           tcp_acceptor(io_service, tcp::endpoint(tcp::v4(), ui_port)),
-          servers(servers),
+          publisher(publisher),
+          reader_slot(publisher.register_reader()),
+          alerts(alerts),
+          alerts_cursor(0),
           new_connection(),
           ui_refresh_interval(ui_refresh_interval) {
 
@@ -29,7 +40,8 @@ public:
 private:
   /* Akceptuje nowe połączenia: */
   void start_accept() {
-    new_connection = std::make_shared<TelnetConnection>(io_service, servers_table);
+    new_connection = std::make_shared<TelnetConnection>(io_service, servers_table, matrix_table,
+        alerts_table);
 
     tcp_acceptor.async_accept(new_connection->get_socket(),
         boost::bind(&TelnetServer::handle_accept, this,
@@ -50,6 +62,7 @@ private:
    * oraz usuwa nieaktywne połączenia z listy połączeń. */
   void init_updates() {
     build_servers_table();
+    build_alerts_table();
 
     for (auto it = connections.begin(); it != connections.end();) {
       if ((*it)->is_active()) {
@@ -72,32 +85,81 @@ private:
 
   /* Buduje tablicę drukowalnych i posortowanych serwerów. */
   void build_servers_table() {
+    if (reader_slot < 0)
+      return;
+    StatsSnapshot const* snapshot = publisher.acquire(reader_slot);
+    std::vector<HostStats> const& hosts = snapshot->hosts;
+
     float max_delay = 0;     // maksymalne opóźnienie w sekundach
-    for (auto it = servers->begin(); it != servers->end(); ++it) {
-      if (it->second.delay_sec() > max_delay) {
-        max_delay = it->second.delay_sec();
+    for (auto it = hosts.begin(); it != hosts.end(); ++it) {
+      if (PrintServer::delay_sec(*it) > max_delay) {
+        max_delay = PrintServer::delay_sec(*it);
       }
     }
 
     servers_table.clear();
-    servers_table.reserve(servers->size());
-    for (auto it = servers->begin(); it != servers->end(); ++it) {
-      servers_table.push_back(PrintServer((*it).second, max_delay));
+    servers_table.reserve(hosts.size());
+    for (auto it = hosts.begin(); it != hosts.end(); ++it) {
+      servers_table.push_back(PrintServer(*it, max_delay));
     }
+
+    build_matrix_table(snapshot->matrix);
+    publisher.release(reader_slot);
+
     /* Sortujemy malejąco po czasach: */
     std::sort(servers_table.begin(), servers_table.end());
+    std::sort(matrix_table.begin(), matrix_table.end());
+  }
+
+  /* Dołącza nowe alarmy do tablicy alarmów (najnowszy na początku). */
+  void build_alerts_table() {
+    LatencyAlert alert;
+    uint64_t missed = 0;
+    bool changed = false;
+    while (alerts.poll(alerts_cursor, alert, missed)) {
+      recent_alerts.push_front(alert);
+      if (recent_alerts.size() > ALERT_UI_HISTORY)
+        recent_alerts.pop_back();
+      changed = true;
+    }
+    if (!changed)
+      return;
+    alerts_table.clear();
+    alerts_table.reserve(recent_alerts.size());
+    for (auto it = recent_alerts.begin(); it != recent_alerts.end(); ++it)
+      alerts_table.push_back(PrintServer(*it));
+  }
+
+  /* Buduje tablicę wierszy macierzy floty (węzłów mierzących). */
+  void build_matrix_table(std::vector<MatrixRowStats> const& rows) {
+    float max_delay = 0;
+    for (auto it = rows.begin(); it != rows.end(); ++it)
+      max_delay = std::max(max_delay, it->mean_delay_sec);
+
+    matrix_table.clear();
+    matrix_table.reserve(rows.size());
+    for (auto it = rows.begin(); it != rows.end(); ++it) {
+      if (it->measured)
+        matrix_table.push_back(PrintServer(*it, max_delay));
+    }
   }
 
 
   boost::asio::io_service& io_service;
-  boost::asio::deadline_timer timer;
+  clock_timer timer;
   tcp::acceptor tcp_acceptor;
 
-  servers_ptr servers;
+  StatsPublisher& publisher;
+  int reader_slot;        // numer czytelnika w 'publisher'
+  AlertQueue const& alerts;
+  uint64_t alerts_cursor;   // ostatni odczytany alarm
+  std::deque<LatencyAlert> recent_alerts;
   std::list<std::shared_ptr<TelnetConnection> > connections;
   std::shared_ptr<TelnetConnection> new_connection;
 
   std::vector<PrintServer> servers_table;
+  std::vector<PrintServer> matrix_table;
+  std::vector<PrintServer> alerts_table;
 
   float ui_refresh_interval;
 };
@@ -0,0 +1,552 @@
+/* Symulacja na czasie wirtualnym: uruchamia klasę MeasurementClient programu
+ * (klient mDNS, serwery, harmonogram i budżet pomiarów, publikacja statystyk)
+ * bez gniazd, z transportem w pamięci (packet_sink), na zegarze wirtualnym
+ * (virtual_time_usec i liczniki clock_timer). Godziny działania floty
+ * symulowane są w sekundach, a wyniki przy tym samym ziarnie są identyczne.
+ *
+ * Symulowana sieć ma N komputerów (adresy od 10.64.0.1) z usługą
+ * _opoznienia._udp. Komputer i ma opóźnienie w obie strony
+ * d + i % (j + 1) ms, do którego każdy pakiet dostaje losowo od 0 do J ms;
+ * pakiety pomiarowe gubione są z prawdopodobieństwem l. Komputery odpowiadają
+ * na pytania mDNS (PTR + A w sekcji Additional) po opóźnieniu sieci
+ * i losowych 20-120 ms, na pomiary UDP jak MeasurementServer, a na ICMP Echo
+ * jak jądro. Z opcją -u komputery włączają się i wyłączają: czasy działania
+ * i przerwy mają rozkład wykładniczy o średnich -u i -w sekund.
+ *
+ * Czas płynie krokami -q ms: w kroku dostarczane są (każdy w swojej chwili)
+ * pakiety symulowanej sieci, a na końcu kroku obsługiwane są liczniki czasu
+ * programu. Co -i sekund czasu symulacji wypisywany jest wiersz statystyk:
+ * liczba działających komputerów, wykrytych i aktywnych serwerów, błąd
+ * średniego opóźnienia UDP względem wprowadzonego i liczba pomiarów na
+ * sekundę. Na koniec wypisywane jest przyspieszenie względem czasu
+ * rzeczywistego, liczba alarmów wykrywania zmian i suma kontrolna tablicy
+ * serwerów (do porównywania przebiegów). Przed symulacją sprawdzane jest,
+ * czy najszersze wiersze interfejsu telnetu mają UI_SCREEN_WIDTH znaków
+ * i czy wygaśnięcie samego wpisu _ssh._tcp wyłącza tylko pomiary TCP,
+ * a wygaśnięcie wszystkich wpisów serwera zgłasza alarm HOST_GONE.
+ *
+ * Pomiary TCP nie są symulowane (komputery nie ogłaszają _ssh._tcp).
+ *
+ * Użycie: virtual-sim [-n komputery] [-d opóźnienie_ms] [-j rozrzut_ms]
+ *                     [-J zmienność_ms] [-l gubienie_%] [-D czas_s] [-q krok_ms]
+ *                     [-u średnie_działanie_s] [-w średnia_przerwa_s]
+ *                     [-i raport_s] [-r ziarno] [-t odstęp_s] [-T odstęp_mdns_s]
+ *                     [-b budżet] [-A] */
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <map>
+#include <functional>
+#include <stdexcept>
+#include <cstring>
+#include <sys/time.h>
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <endian.h>
+
+#include "common.h"
+#include "get_time_usec.h"
+#include "clock_source.h"
+#include "mdns_message.h"
+#include "measurement_client.h"
+#include "probe_context.h"
+#include "print_server.h"
+#include "server.h"
+
+using boost::asio::ip::udp;
+using boost::asio::ip::address;
+using boost::asio::ip::address_v4;
+
+const uint32_t VSIM_BASE_ADDRESS = 0x0A400001;    // 10.64.0.1 - adres pierwszego komputera
+const time_type VSIM_EPOCH_USEC = 1500000000ULL * SEC_TO_USEC;  // początek czasu wirtualnego
+const std::string VSIM_PEER_PREFIX = "sim";
+
+
+/* Parametry symulacji. */
+struct SimConfig {
+  int peers = 1000;
+  int delay_ms = 5;           // bazowe opóźnienie w obie strony
+  int spread_ms = 0;          // komputer i ma opóźnienie delay_ms + i % (spread_ms + 1)
+  float jitter_ms = 0;        // losowe opóźnienie każdego pakietu (0..jitter_ms)
+  float loss = 0;             // prawdopodobieństwo zgubienia pomiaru (0..1)
+  int duration_sec = 3600;    // czas symulacji
+  int tick_ms = 1;            // krok czasu
+  float up_mean_sec = 0;      // średni czas działania komputera (0 - bez zmian floty)
+  float down_mean_sec = 60;   // średnia przerwa w działaniu
+  int report_sec = 300;       // co ile sekund symulacji wypisywać statystyki
+  unsigned seed = 1;
+
+  int interval = MEASUREMENT_INTERVAL_DEFAULT;      // opcje programu
+  int mdns_interval = MDNS_INTERVAL_DEFAULT;
+  float probe_budget = PROBE_BUDGET_DEFAULT;
+  bool adaptive = ADAPTIVE_PROBING_DEFAULT;
+};
+
+/* Symulowany komputer. */
+struct SimPeer {
+  address_v4 ip;
+  time_type delay_usec;       // opóźnienie w obie strony (bez losowej zmienności)
+  bool up;                    // czy działa
+  std::string ptr_response;   // gotowa odpowiedź na pytanie PTR (PTR + A)
+  std::string a_response;     // gotowa odpowiedź na pytanie A
+};
+
+
+/* Sieć w pamięci: kolejka zdarzeń (dostarczeń pakietów i zmian floty)
+ * uporządkowana według czasu wirtualnego, a przy równym czasie - według
+ * kolejności dodania. */
+class SimNetwork {
+public:
+  SimNetwork(SimConfig const& config) :
+      config(config),
+      random_generator(config.seed),
+      unit(0, 1),
+      peers_up(0),
+      probes(0),
+      events(0),
+      servers(nullptr),
+      mdns_transport(nullptr),
+      opoznienia_service(OPOZNIENIA_SERVICE) {
+    for (int i = 0; i < config.peers; i++)
+      add_peer(i);
+  }
+
+  /* Łączy sieć z programem, któremu dostarcza odpowiedzi. */
+  void attach(MeasurementClient& client) {
+    servers = client.get_servers();
+    mdns_transport = &client.get_mdns_transport();
+  }
+
+  /* packet_sink programu: planuje odpowiedzi na wysłany pakiet. */
+  bool send(int ip_protocol, address_v4 const& destination, uint16_t port,
+      unsigned char const* data, std::size_t length) {
+    if (ip_protocol == IPPROTO_UDP && port == MDNS_PORT) {
+      answer_query(data, length);
+      return true;
+    }
+    probes++;
+    SimPeer* peer = find_peer(destination);
+    if (!peer || !peer->up || unit(random_generator) < config.loss)
+      return true;        // pakiet wysłany, ale nikt nie odpowie
+    time_type arrival = get_time_usec() + packet_delay(*peer);
+
+    if (ip_protocol == IPPROTO_UDP && port == UDP_PORT_DEFAULT && length >= sizeof(uint64_t)) {
+      uint64_t be_start_time;
+      std::memcpy(&be_start_time, data, sizeof(be_start_time));
+      schedule(arrival, boost::bind(&SimNetwork::deliver_udp, this, udp::endpoint(peer->ip, port),
+          be64toh(be_start_time)));
+    } else if (ip_protocol == IPPROTO_ICMP && length >= 8) {
+      schedule(arrival, boost::bind(&SimNetwork::deliver_icmp, this, echo_reply(peer->ip, data, length)));
+    }
+    return true;
+  }
+
+  /* Wykonuje zdarzenia do chwili 'end' włącznie, każde w swoim czasie. */
+  void run_until(time_type end) {
+    while (!queue.empty() && queue.begin()->first <= end) {
+      auto event = queue.begin();
+      virtual_time_usec() = std::max(virtual_time_usec(), event->first);
+      std::function<void()> action;
+      action.swap(event->second);
+      queue.erase(event);
+      action();
+      events++;
+    }
+  }
+
+  /* Planuje zmiany floty (opcja -u): każdy komputer zaczyna w stanie losowym
+   * zgodnym z proporcją średnich czasów działania i przerwy. */
+  void start_churn() {
+    if (config.up_mean_sec <= 0)
+      return;
+    float up_fraction = config.up_mean_sec / (config.up_mean_sec + config.down_mean_sec);
+    for (int i = 0; i < peers.size(); i++) {
+      set_up(i, unit(random_generator) < up_fraction);
+      schedule_toggle(i);
+    }
+  }
+
+  /* Wprowadzone opóźnienie komputera o adresie 'ip' w us (z połową średniej
+   * zmienności) lub -1, jeśli to nie nasz adres. */
+  double expected_delay_usec(uint32_t ip) const {
+    uint32_t index = ip - VSIM_BASE_ADDRESS;
+    if (ip < VSIM_BASE_ADDRESS || index >= peers.size())
+      return -1;
+    return peers[index].delay_usec + config.jitter_ms * 1000 / 2;
+  }
+
+  int get_peers_up() const { return peers_up; }
+  unsigned long get_probes() const { return probes; }
+  unsigned long get_events() const { return events; }
+
+private:
+  void add_peer(int index) {
+    SimPeer peer;
+    peer.ip = address_v4(VSIM_BASE_ADDRESS + index);
+    peer.delay_usec = (config.delay_ms + index % (config.spread_ms + 1)) * 1000L;
+    peer.up = true;
+
+    uint16_t ptr = static_cast<uint16_t>(QTYPE::PTR);
+    uint16_t a = static_cast<uint16_t>(QTYPE::A);
+    MdnsDomainName name(VSIM_PEER_PREFIX + std::to_string(index) + '.' + OPOZNIENIA_SERVICE);
+    MdnsResponse ptr_response;
+    ptr_response.add_answer(MdnsAnswer(opoznienia_service, ptr, INTERNET_CLASS, TTL_DEFAULT, name));
+    ptr_response.add_additional(MdnsAnswer(name, a, INTERNET_CLASS, TTL_DEFAULT, peer.ip.to_ulong()));
+    MdnsResponse a_response;
+    a_response.add_answer(MdnsAnswer(name, a, INTERNET_CLASS, TTL_DEFAULT, peer.ip.to_ulong()));
+    std::ostringstream ptr_wire, a_wire;
+    ptr_wire << ptr_response;
+    a_wire << a_response;
+    peer.ptr_response = ptr_wire.str();
+    peer.a_response = a_wire.str();
+
+    peers.push_back(peer);
+    peers_up++;
+  }
+
+  SimPeer* find_peer(address_v4 const& ip) {
+    uint32_t index = ip.to_ulong() - VSIM_BASE_ADDRESS;
+    return ip.to_ulong() >= VSIM_BASE_ADDRESS && index < peers.size() ? &peers[index] : nullptr;
+  }
+
+  time_type packet_delay(SimPeer const& peer) {
+    return peer.delay_usec + static_cast<time_type>(config.jitter_ms * 1000 * unit(random_generator));
+  }
+
+  void schedule(time_type time, std::function<void()> const& action) {
+    queue.insert(std::make_pair(time, action));
+  }
+
+  /* Odpowiada na pytania mDNS: na PTR - wszystkie działające komputery,
+   * na A - właściciel nazwy. */
+  void answer_query(unsigned char const* data, std::size_t length) {
+    std::istringstream stream(std::string(reinterpret_cast<char const*>(data), length));
+    MdnsQuery query;
+    try {
+      if (!query.try_read(stream))
+        return;
+    } catch (InvalidMdnsMessageException const&) {
+      return;
+    }
+    std::vector<MdnsQuestion> const& questions = query.get_questions();
+    for (int q = 0; q < questions.size(); q++) {
+      if (questions[q].get_qtype() == static_cast<uint16_t>(QTYPE::PTR)
+          && questions[q].get_name() == opoznienia_service) {
+        for (int i = 0; i < peers.size(); i++)
+          schedule_mdns_response(peers[i], peers[i].ptr_response);
+      } else if (questions[q].get_qtype() == static_cast<uint16_t>(QTYPE::A)) {
+        std::string label = questions[q].get_name().label(0);
+        if (label.compare(0, VSIM_PEER_PREFIX.size(), VSIM_PEER_PREFIX) != 0)
+          continue;
+        uint32_t index = std::strtoul(label.c_str() + VSIM_PEER_PREFIX.size(), NULL, 10);
+        if (index < peers.size())
+          schedule_mdns_response(peers[index], peers[index].a_response);
+      }
+    }
+  }
+
+  void schedule_mdns_response(SimPeer const& peer, std::string const& response) {
+    if (!peer.up)
+      return;
+    time_type responder_delay = 1000L * (MDNS_SHARED_DELAY_MIN_MS
+        + unit(random_generator) * (MDNS_SHARED_DELAY_MAX_MS - MDNS_SHARED_DELAY_MIN_MS));
+    schedule(get_time_usec() + packet_delay(peer) + responder_delay,
+        boost::bind(&SimNetwork::deliver_mdns, this, udp::endpoint(peer.ip, MDNS_PORT),
+          boost::cref(response)));
+  }
+
+  /* Pakiet IP z odpowiedzią Echo Reply od 'source' na żądanie ICMP 'request'. */
+  static std::string echo_reply(address_v4 const& source, unsigned char const* request, std::size_t length) {
+    std::string packet(20, '\0');
+    packet[0] = 0x45;                       // IPv4, nagłówek 20 bajtów
+    packet[9] = IPPROTO_ICMP;
+    uint32_t ip = source.to_ulong();
+    for (int i = 0; i < 4; i++)
+      packet[12 + i] = (ip >> (24 - 8 * i)) & 0xFF;
+    packet.append(reinterpret_cast<char const*>(request), length);
+    packet[20] = icmp_header::echo_reply;
+    return packet;
+  }
+
+  void deliver_udp(udp::endpoint const& sender, time_type id) {
+    MeasurementClient::dispatch_udp_reply(*servers, sender, id, get_time_nsec());
+  }
+
+  void deliver_icmp(std::string const& packet) {
+    MeasurementClient::dispatch_icmp_reply(*servers,
+        reinterpret_cast<unsigned char const*>(packet.data()), packet.size(), get_time_nsec());
+  }
+
+  void deliver_mdns(udp::endpoint const& sender, std::string const& response) {
+    mdns_transport->receive_packet(response.data(), response.size(), sender);
+  }
+
+  void set_up(int index, bool up) {
+    if (peers[index].up != up)
+      peers_up += up ? 1 : -1;
+    peers[index].up = up;
+  }
+
+  /* Planuje następną zmianę stanu komputera 'index'. */
+  void schedule_toggle(int index) {
+    float mean_sec = peers[index].up ? config.up_mean_sec : config.down_mean_sec;
+    std::exponential_distribution<float> duration(1 / mean_sec);
+    schedule(get_time_usec() + static_cast<time_type>(duration(random_generator) * SEC_TO_USEC),
+        boost::bind(&SimNetwork::toggle, this, index));
+  }
+
+  void toggle(int index) {
+    set_up(index, !peers[index].up);
+    schedule_toggle(index);
+  }
+
+
+  SimConfig const& config;
+  std::mt19937 random_generator;
+  std::uniform_real_distribution<float> unit;
+  std::vector<SimPeer> peers;
+  int peers_up;
+  unsigned long probes;       // wysłane pomiary
+  unsigned long events;       // wykonane zdarzenia
+  std::multimap<time_type, std::function<void()> > queue;  // czas -> zdarzenie
+
+  servers_ptr servers;
+  MdnsTransport* mdns_transport;
+  const MdnsDomainName opoznienia_service;
+};
+
+
+/* Wypisuje wiersz statystyk w chwili 'now'. */
+void report(std::ostream& os, SimNetwork const& network, servers_map const& servers,
+    time_type now, unsigned long probes, int report_sec, double wall_sec) {
+  int active = 0, measured = 0;
+  double error_sum = 0, max_error = 0;
+  for (auto it = servers.begin(); it != servers.end(); ++it) {
+    if (!it->second.is_active())
+      continue;
+    active++;
+    HostStats stats = it->second.host_stats();
+    double expected = network.expected_delay_usec(stats.ip);
+    if (PROTOCOL::UDP >= 0 && stats.delay_sec[PROTOCOL::UDP] >= 0 && expected >= 0) {
+      double error_ms = std::abs(stats.delay_sec[PROTOCOL::UDP] * SEC_TO_USEC - expected) / 1000;
+      error_sum += error_ms;
+      max_error = std::max(max_error, error_ms);
+      measured++;
+    }
+  }
+  os << (now - VSIM_EPOCH_USEC) / SEC_TO_USEC << ' ' << network.get_peers_up() << ' '
+      << servers.size() << ' ' << active << ' ' << (measured ? error_sum / measured : 0) << ' '
+      << max_error << ' ' << (float) probes / report_sec << ' ' << wall_sec << std::endl;
+}
+
+/* Suma kontrolna (FNV-1a) adresów, stanu i opóźnień wszystkich serwerów. */
+uint64_t servers_checksum(servers_map const& servers) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (auto it = servers.begin(); it != servers.end(); ++it) {
+    HostStats stats = it->second.host_stats();
+    std::vector<uint32_t> words(1, stats.ip);
+    words.push_back(it->second.is_active());
+    for (int proto = 0; proto < PROTOCOL_COUNT; proto++) {
+      uint32_t bits;
+      std::memcpy(&bits, &stats.delay_sec[proto], sizeof(bits));
+      words.push_back(bits);
+    }
+    for (int i = 0; i < words.size(); i++) {
+      for (int byte = 0; byte < 4; byte++)
+        hash = (hash ^ ((words[i] >> (8 * byte)) & 0xFF)) * 1099511628211ULL;
+    }
+  }
+  return hash;
+}
+
+/* Sprawdza, czy wiersze interfejsu z najdłuższymi liczbami (wszystkie
+ * protokoły, trend, przewidywanie ze współrzędnych, najdłuższy adres) mają
+ * dokładnie UI_SCREEN_WIDTH znaków przy każdym położeniu liczb. */
+bool check_widest_rows() {
+  HostStats host;
+  host.ip = 0xFFFFFFFF;                   // 255.255.255.255
+  for (int proto = 0; proto < PROTOCOL_COUNT; proto++) {
+    host.delay_sec[proto] = 0.000312456f;
+    host.hour_delay_sec[proto] = 0.000212345f;
+  }
+  host.predicted_sec = 0.000298765f;
+  host.predicted_error_sec = 7.81e-05f;
+  MatrixRowStats row;
+  row.origin = host.ip;
+  row.measured = 1000000;
+  row.mean_delay_sec = 0.000312456f;
+  row.max_delay_sec = 0.000312456f;
+
+  float max_delays[] = {0, 0.000312456f, 1};
+  for (int i = 0; i < 3; i++) {
+    std::ostringstream host_row, matrix_row;
+    host_row << PrintServer(host, max_delays[i]);
+    matrix_row << PrintServer(row, max_delays[i]);
+    if (host_row.str().size() != UI_SCREEN_WIDTH || matrix_row.str().size() != UI_SCREEN_WIDTH)
+      return false;
+  }
+  return true;
+}
+
+/* Sprawdza wygasanie wpisów serwera: po wygaśnięciu samego wpisu _ssh._tcp
+ * serwer nadal jest mierzony przez UDP i ICMP, a nie jest już przez TCP
+ * (także w kolejnych rundach). Przesuwa czas wirtualny o TTL_DEFAULT + 1 s. */
+bool check_ssh_expiry(boost::asio::io_service& io_service) {
+  ProbeScheduleConfig schedule_config = {MEASUREMENT_INTERVAL_DEFAULT, false, std::vector<ProbeClass>()};
+  ProbeContext context(io_service, std::make_shared<udp::socket>(io_service),
+      std::make_shared<icmp::socket>(io_service), schedule_config);
+  Server server(address_v4(VSIM_BASE_ADDRESS), context);
+  server.enable_udp(2 * TTL_DEFAULT);
+  server.enable_tcp(TTL_DEFAULT);
+
+  virtual_time_usec() += (TTL_DEFAULT + 1) * SEC_TO_USEC;
+  for (int round = 0; round < 2; round++) {
+    server.expire(get_time_nsec());
+    if (!server.is_active() || server.measures(PROTOCOL::TCP)
+        || (PROTOCOL::UDP >= 0 && !server.measures(PROTOCOL::UDP)))
+      return false;
+  }
+  return true;
+}
+
+/* Liczba nowych (od 'cursor') alarmów HOST_GONE serwera 'ip'. */
+int count_host_gone(ProbeContext const& context, uint64_t& cursor, uint32_t ip) {
+  int count = 0;
+  LatencyAlert alert;
+  uint64_t missed = 0;
+  while (context.get_detector().get_alerts().poll(cursor, alert, missed)) {
+    if (alert.kind == AlertKind::HOST_GONE && alert.ip == ip)
+      count++;
+  }
+  return count;
+}
+
+/* Sprawdza alarm zniknięcia serwera: serwer tylko z _ssh._tcp zgłaszany jest
+ * po wygaśnięciu tego wpisu, a serwer z obiema usługami - dopiero po
+ * wygaśnięciu obu, raz. Przesuwa czas wirtualny o 2 * TTL_DEFAULT + 2 s. */
+bool check_host_gone(boost::asio::io_service& io_service) {
+  ProbeScheduleConfig schedule_config = {MEASUREMENT_INTERVAL_DEFAULT, false, std::vector<ProbeClass>()};
+  ProbeContext context(io_service, std::make_shared<udp::socket>(io_service),
+      std::make_shared<icmp::socket>(io_service), schedule_config);
+  Server tcp_only(address_v4(VSIM_BASE_ADDRESS), context);
+  Server dual(address_v4(VSIM_BASE_ADDRESS + 1), context);
+  tcp_only.enable_tcp(TTL_DEFAULT);
+  dual.enable_udp(2 * TTL_DEFAULT);
+  dual.enable_tcp(TTL_DEFAULT);
+  uint64_t cursor = context.get_detector().get_alerts().head();
+
+  virtual_time_usec() += (TTL_DEFAULT + 1) * SEC_TO_USEC;
+  tcp_only.expire(get_time_nsec());
+  dual.expire(get_time_nsec());
+  if (tcp_only.is_active() || count_host_gone(context, cursor, VSIM_BASE_ADDRESS) != 1
+      || !dual.is_active() || count_host_gone(context, cursor, VSIM_BASE_ADDRESS + 1) != 0)
+    return false;
+
+  virtual_time_usec() += (TTL_DEFAULT + 1) * SEC_TO_USEC;
+  for (int round = 0; round < 2; round++)
+    dual.expire(get_time_nsec());
+  return !dual.is_active() && count_host_gone(context, cursor, VSIM_BASE_ADDRESS + 1) == 1;
+}
+
+void parse_arguments(int argc, char const *argv[], SimConfig& config) {
+  for (int arg = 1; arg < argc; ++arg) {
+    if (strcmp(argv[arg], "-A") == 0) {
+      config.adaptive = true;
+    } else if (arg == argc - 1) {
+      throw std::invalid_argument("parsing error");
+    } else {
+      std::string value(argv[arg + 1]);
+      if (strcmp(argv[arg], "-n") == 0)      config.peers = std::stoi(value);
+      else if (strcmp(argv[arg], "-d") == 0) config.delay_ms = std::stoi(value);
+      else if (strcmp(argv[arg], "-j") == 0) config.spread_ms = std::stoi(value);
+      else if (strcmp(argv[arg], "-J") == 0) config.jitter_ms = std::stof(value);
+      else if (strcmp(argv[arg], "-l") == 0) config.loss = std::stof(value) / 100;
+      else if (strcmp(argv[arg], "-D") == 0) config.duration_sec = std::stoi(value);
+      else if (strcmp(argv[arg], "-q") == 0) config.tick_ms = std::stoi(value);
+      else if (strcmp(argv[arg], "-u") == 0) config.up_mean_sec = std::stof(value);
+      else if (strcmp(argv[arg], "-w") == 0) config.down_mean_sec = std::stof(value);
+      else if (strcmp(argv[arg], "-i") == 0) config.report_sec = std::stoi(value);
+      else if (strcmp(argv[arg], "-r") == 0) config.seed = std::stoul(value);
+      else if (strcmp(argv[arg], "-t") == 0) config.interval = std::stoi(value);
+      else if (strcmp(argv[arg], "-T") == 0) config.mdns_interval = std::stoi(value);
+      else if (strcmp(argv[arg], "-b") == 0) config.probe_budget = std::stof(value);
+      else throw std::invalid_argument("unkown argument type");
+      arg++;
+    }
+  }
+  if (config.peers <= 0 || config.tick_ms <= 0 || config.report_sec <= 0 || config.down_mean_sec <= 0)
+    throw std::invalid_argument("non-positive value");
+}
+
+int main(int argc, char const *argv[]) {
+  SimConfig config;
+  try {
+    parse_arguments(argc, argv, config);
+  } catch (std::logic_error const& e) {
+    std::cerr << "Error parsing arguments: " << e.what() << "\n";
+    return 1;
+  }
+
+  if (!check_widest_rows()) {
+    std::cerr << "UI rows exceed " << UI_SCREEN_WIDTH << " characters\n";
+    return 1;
+  }
+
+  virtual_time_usec() = VSIM_EPOCH_USEC;    // przed utworzeniem liczników czasu
+  boost::asio::io_service io_service;
+  if (!check_ssh_expiry(io_service)) {
+    std::cerr << "Expired _ssh._tcp record changed UDP/ICMP probing\n";
+    return 1;
+  }
+  if (!check_host_gone(io_service)) {
+    std::cerr << "Expired servers not reported as gone\n";
+    return 1;
+  }
+  virtual_time_usec() = VSIM_EPOCH_USEC;
+  SimNetwork network(config);
+
+  ProbeScheduleConfig schedule_config = {config.interval, config.adaptive, std::vector<ProbeClass>()};
+  CalibrationConfig calibration_config = {0, 0, false};
+  ReceiveThreadConfig receive_thread_config = {false, RECEIVE_THREAD_CPU_DEFAULT, false, 0};
+  MatrixExchangeConfig matrix_config = {false, MATRIX_PORT_DEFAULT, MATRIX_EXPORT_PATH_DEFAULT};
+  CoordinateConfig coordinate_config = {0, VIVALDI_PORT_DEFAULT};
+  MeasurementClient client(io_service, UDP_PORT_DEFAULT, UI_PORT_DEFAULT, schedule_config,
+      config.mdns_interval, UI_REFRESH_INTERVAL_DEFAULT, SNAPSHOT_PATH_DEFAULT, calibration_config,
+      receive_thread_config, config.probe_budget, matrix_config, coordinate_config,
+      boost::bind(&SimNetwork::send, &network, _1, _2, _3, _4, _5));
+  network.attach(client);
+  network.start_churn();
+
+  auto wall_start = std::chrono::steady_clock::now();
+  time_type tick = config.tick_ms * 1000L;
+  time_type end = VSIM_EPOCH_USEC + config.duration_sec * SEC_TO_USEC;
+  time_type next_report = VSIM_EPOCH_USEC + config.report_sec * SEC_TO_USEC;
+  unsigned long reported_probes = 0;
+
+  std::cout << "time_s peers_up discovered active mean_err_ms max_err_ms probes_per_s wall_s\n";
+  for (time_type now = VSIM_EPOCH_USEC; now < end; now += tick) {
+    network.run_until(now + tick);
+    virtual_time_usec() = now + tick;
+    io_service.poll();
+
+    if (now + tick >= next_report) {
+      double wall_sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+      report(std::cout, network, *client.get_servers(), now + tick,
+          network.get_probes() - reported_probes, config.report_sec, wall_sec);
+      reported_probes = network.get_probes();
+      next_report += config.report_sec * SEC_TO_USEC;
+    }
+  }
+
+  double wall_sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+  std::cout << "simulated " << config.duration_sec << " s in " << wall_sec << " s (x"
+      << config.duration_sec / wall_sec << "), events " << network.get_events()
+      << ", failed sends " << client.get_probe_context().get_failed_sends()
+      << ", alerts " << client.get_alerts().head() << "\n"
+      << "checksum " << std::hex << servers_checksum(*client.get_servers()) << std::dec << std::endl;
+  return 0;
+}